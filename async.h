@@ -0,0 +1,333 @@
+#pragma once
+
+#include <QObject>
+#include <QCoreApplication>
+#include <QDebug>
+#include <coroutine>
+#include <concepts>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+
+namespace Async
+{
+	class Cancelled : public std::exception // deliberately not a std::runtime_error so the usual error handlers don't swallow it
+	{
+	public:
+		const char* what() const noexcept override { return "Operation was cancelled"; }
+	};
+
+	class Token
+	{
+	public:
+		using Handler=std::function<void()>;
+		Token() : state(std::make_shared<State>()) { }
+		void Cancel()
+		{
+			if (state->cancelled) return;
+			state->cancelled=true;
+			std::unordered_map<int,Handler> handlers;
+			handlers.swap(state->handlers);
+			for (auto &[id,handler] : handlers) handler();
+		}
+		bool Cancelled() const { return state->cancelled; }
+		void Bind(QObject *context)
+		{
+			// no context object on purpose, the connection has to outlive the
+			// thing it's watching so the cancellation actually goes through
+			QObject::connect(context,&QObject::destroyed,[state=std::weak_ptr<State>(state)]() {
+				if (std::shared_ptr<State> candidate=state.lock(); candidate) Token(candidate).Cancel();
+			});
+		}
+		int Subscribe(Handler handler)
+		{
+			int id=state->next++;
+			state->handlers.try_emplace(id,std::move(handler));
+			return id;
+		}
+		void Unsubscribe(int id) { state->handlers.erase(id); }
+	protected:
+		struct State
+		{
+			bool cancelled=false;
+			int next=0;
+			std::unordered_map<int,Handler> handlers;
+		};
+		std::shared_ptr<State> state;
+		Token(std::shared_ptr<State> state) : state(state) { }
+	};
+
+	//! Resumes a suspended coroutine from the event loop rather than from whoever happens to be on the stack
+	inline void Post(std::coroutine_handle<> handle)
+	{
+		QMetaObject::invokeMethod(QCoreApplication::instance(),[handle]() {
+			handle.resume();
+		},Qt::QueuedConnection);
+	}
+
+	class Latch
+	{
+	public:
+		Latch(int count,std::coroutine_handle<> waiter) : count(count), waiter(waiter) { }
+		std::coroutine_handle<> Arrive() { return --count == 0 ? waiter : std::noop_coroutine(); }
+	protected:
+		int count;
+		std::coroutine_handle<> waiter;
+	};
+
+	struct PromiseBase
+	{
+		Token token;
+		std::coroutine_handle<> continuation;
+		Latch *latch=nullptr;
+		bool detached=false;
+		std::exception_ptr exception;
+
+		std::suspend_always initial_suspend() noexcept { return {}; }
+
+		struct FinalAwaiter
+		{
+			bool await_ready() noexcept { return false; }
+			template <typename TPromise> std::coroutine_handle<> await_suspend(std::coroutine_handle<TPromise> handle) noexcept
+			{
+				PromiseBase &promise=handle.promise();
+				if (promise.continuation) return promise.continuation;
+				if (promise.latch) return promise.latch->Arrive();
+				if (promise.detached)
+				{
+					// nobody is waiting on a detached task, so it has to clean up after itself
+					promise.Report();
+					handle.destroy();
+				}
+				return std::noop_coroutine();
+			}
+			void await_resume() noexcept { }
+		};
+		FinalAwaiter final_suspend() noexcept { return {}; }
+
+		void unhandled_exception() noexcept { exception=std::current_exception(); }
+
+		void Report() noexcept
+		{
+			if (!exception) return;
+			try
+			{
+				std::rethrow_exception(exception);
+			}
+			catch (const Cancelled &)
+			{
+			}
+			catch (const std::exception &exception)
+			{
+				qWarning() << "Unhandled exception in detached task:" << exception.what();
+			}
+			catch (...)
+			{
+				qWarning() << "Unhandled exception in detached task";
+			}
+		}
+	};
+
+	template <typename T> concept TaskPromise=std::derived_from<T,PromiseBase>;
+
+	template <typename T=void> class Task;
+
+	namespace Implementation
+	{
+		template <typename T>
+		struct Promise : PromiseBase
+		{
+			std::optional<T> value;
+			Task<T> get_return_object() noexcept;
+			template <std::convertible_to<T> TValue> void return_value(TValue &&result) { value.emplace(std::forward<TValue>(result)); }
+			T Result()
+			{
+				if (exception) std::rethrow_exception(exception);
+				return std::move(*value);
+			}
+		};
+
+		template <>
+		struct Promise<void> : PromiseBase
+		{
+			Task<void> get_return_object() noexcept;
+			void return_void() noexcept { }
+			void Result()
+			{
+				if (exception) std::rethrow_exception(exception);
+			}
+		};
+	}
+
+	template <typename T>
+	class Task
+	{
+	public:
+		using promise_type=Implementation::Promise<T>;
+		using Handle=std::coroutine_handle<promise_type>;
+		using Value=T;
+		Task(Handle handle) : handle(handle) { }
+		Task(const Task &other)=delete;
+		Task(Task &&other) noexcept : handle(std::exchange(other.handle,{})) { }
+		Task& operator=(const Task &other)=delete;
+		Task& operator=(Task &&other) noexcept
+		{
+			if (this != &other)
+			{
+				if (handle) handle.destroy();
+				handle=std::exchange(other.handle,{});
+			}
+			return *this;
+		}
+		~Task()
+		{
+			if (handle) handle.destroy();
+		}
+
+		/*!
+		 * \brief Runs the task without anyone waiting on it
+		 * \param context When this object is destroyed, the task is cancelled
+		 *
+		 * The task owns itself after this and frees its own frame when it
+		 * finishes. Cancellation is swallowed, but any other exception that
+		 * escapes the coroutine body is reported through qWarning() since
+		 * there is nobody left to catch it.
+		 */
+		void Start(QObject *context=nullptr)
+		{
+			if (!handle) return;
+			promise_type &promise=handle.promise();
+			if (context) promise.token.Bind(context);
+			promise.detached=true;
+			std::exchange(handle,{}).resume();
+		}
+
+		struct Awaiter
+		{
+			Handle handle;
+			bool await_ready() const noexcept { return !handle || handle.done(); }
+			template <TaskPromise TPromise> std::coroutine_handle<> await_suspend(std::coroutine_handle<TPromise> waiter) noexcept
+			{
+				handle.promise().token=waiter.promise().token;
+				handle.promise().continuation=waiter;
+				return handle;
+			}
+			T await_resume() { return handle.promise().Result(); }
+		};
+		Awaiter operator co_await() const & noexcept { return {handle}; }
+
+		void Latch(Async::Latch *latch,const Token &token)
+		{
+			handle.promise().latch=latch;
+			handle.promise().token=token;
+			handle.resume();
+		}
+
+		T Result() { return handle.promise().Result(); }
+	protected:
+		Handle handle;
+	};
+
+	namespace Implementation
+	{
+		template <typename T> Task<T> Promise<T>::get_return_object() noexcept { return {std::coroutine_handle<Promise<T>>::from_promise(*this)}; }
+		inline Task<void> Promise<void>::get_return_object() noexcept { return {std::coroutine_handle<Promise<void>>::from_promise(*this)}; }
+
+		template <typename... T>
+		struct AllAwaiter
+		{
+			std::tuple<Task<T>...> tasks;
+			std::optional<Latch> latch;
+			AllAwaiter(Task<T>&&... tasks) : tasks(std::move(tasks)...) { }
+			bool await_ready() const noexcept { return false; }
+			template <TaskPromise TPromise> bool await_suspend(std::coroutine_handle<TPromise> waiter)
+			{
+				// start at one more than the number of tasks so a task that
+				// finishes immediately can't resume us while we're still in here
+				latch.emplace(static_cast<int>(sizeof...(T))+1,waiter);
+				std::apply([this,&token=waiter.promise().token](Task<T>&... task) {
+					(task.Latch(&*latch,token),...);
+				},tasks);
+				return latch->Arrive() != waiter;
+			}
+			std::tuple<T...> await_resume()
+			{
+				return std::apply([](Task<T>&... task) {
+					return std::tuple<T...>{task.Result()...};
+				},tasks);
+			}
+		};
+	}
+
+	//! Runs all of the tasks at the same time and resumes once every one of them has finished
+	template <typename... T>
+	Task<std::tuple<T...>> WhenAll(Task<T>... tasks)
+	{
+		Implementation::AllAwaiter<T...> all(std::move(tasks)...);
+		co_return co_await all;
+	}
+
+	//! Gives the event loop a chance to run before continuing
+	struct Yield
+	{
+		bool await_ready() const noexcept { return false; }
+		void await_suspend(std::coroutine_handle<> handle) { Post(handle); }
+		void await_resume() const noexcept { }
+	};
+
+	//! Suspends the coroutine on an external callback-driven operation, honoring cancellation
+	template <typename T>
+	class Operation
+	{
+	public:
+		using Starter=std::function<void(std::function<void(T)>)>;
+		Operation(Starter start,std::function<void()> abort=nullptr) : start(start), abort(abort), state(std::make_shared<State>()) { }
+		bool await_ready() const noexcept { return false; }
+		template <TaskPromise TPromise> void await_suspend(std::coroutine_handle<TPromise> waiter)
+		{
+			Token token=waiter.promise().token;
+			state->waiter=waiter;
+			state->token=token;
+			if (token.Cancelled())
+			{
+				state->done=true;
+				Post(waiter);
+				return;
+			}
+			state->subscription=token.Subscribe([state=state,abort=abort]() {
+				if (state->done) return;
+				state->done=true;
+				if (abort) abort();
+				Post(state->waiter);
+			});
+			start([state=state](T result) {
+				if (state->done) return;
+				state->done=true;
+				state->token.Unsubscribe(state->subscription);
+				state->result.emplace(std::move(result));
+				state->waiter.resume();
+			});
+		}
+		T await_resume()
+		{
+			if (!state->result) throw Cancelled();
+			return std::move(*state->result);
+		}
+	protected:
+		struct State
+		{
+			std::coroutine_handle<> waiter;
+			Token token;
+			int subscription=-1;
+			bool done=false;
+			std::optional<T> result;
+		};
+		Starter start;
+		std::function<void()> abort;
+		std::shared_ptr<State> state;
+	};
+}
@@ -0,0 +1,287 @@
+#pragma once
+
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QDateTime>
+#include <QStringList>
+#include <bitset>
+#include <concepts>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+/*!
+ * \brief Binds JSON payloads directly into plain structs
+ *
+ * A struct lists its fields once in a static constexpr Fields() function that
+ * returns a tuple built from JSON::Required() and JSON::Optional(). Decoding
+ * walks each JSON object exactly once, matching keys against that table, and
+ * throws a JSON::Error naming the full path of the first field that is missing
+ * or has the wrong type.
+ */
+namespace JSON
+{
+	class Error : public std::runtime_error
+	{
+	public:
+		Error(const QString &message) : std::runtime_error(message.toStdString()) { }
+	};
+
+	//! Location inside the document, only turned into a string when something goes wrong
+	struct Path
+	{
+		const Path *parent=nullptr;
+		std::string_view key;
+		qsizetype index=-1;
+
+		QString String() const
+		{
+			QString result=parent ? parent->String() : QString();
+			if (index >= 0) return result.append(u'[').append(QString::number(index)).append(u']');
+			if (key.empty()) return result;
+			if (!result.isEmpty()) result.append(u'.');
+			return result.append(QLatin1String(key.data(),static_cast<qsizetype>(key.size())));
+		}
+	};
+
+	inline Error Mismatch(const Path &path,const char *expected)
+	{
+		return Error(QString("Expected %1 at %2").arg(expected,path.parent ? path.String() : QStringLiteral("root")));
+	}
+
+	template <typename TStruct,typename TMember>
+	struct Field
+	{
+		std::string_view key;
+		TMember TStruct::*member;
+		bool required;
+	};
+
+	template <typename TStruct,typename TMember>
+	constexpr Field<TStruct,TMember> Required(std::string_view key,TMember TStruct::*member)
+	{
+		return {key,member,true};
+	}
+
+	template <typename TStruct,typename TMember>
+	constexpr Field<TStruct,TMember> Optional(std::string_view key,TMember TStruct::*member)
+	{
+		return {key,member,false};
+	}
+
+	template <typename T> concept Bound=requires { T::Fields(); };
+
+	template <typename T> struct Decoder;
+
+	template <typename T>
+	void Decode(const QJsonValue &value,T &target,const Path &path)
+	{
+		Decoder<T>::Decode(value,target,path);
+	}
+
+	template <>
+	struct Decoder<QString>
+	{
+		static void Decode(const QJsonValue &value,QString &target,const Path &path)
+		{
+			if (!value.isString()) throw Mismatch(path,"string");
+			target=value.toString();
+		}
+	};
+
+	template <>
+	struct Decoder<bool>
+	{
+		static void Decode(const QJsonValue &value,bool &target,const Path &path)
+		{
+			if (!value.isBool()) throw Mismatch(path,"boolean");
+			target=value.toBool();
+		}
+	};
+
+	template <std::integral T> requires (!std::same_as<T,bool>)
+	struct Decoder<T>
+	{
+		static void Decode(const QJsonValue &value,T &target,const Path &path)
+		{
+			if (!value.isDouble()) throw Mismatch(path,"number");
+			target=static_cast<T>(value.toInteger());
+		}
+	};
+
+	template <>
+	struct Decoder<double>
+	{
+		static void Decode(const QJsonValue &value,double &target,const Path &path)
+		{
+			if (!value.isDouble()) throw Mismatch(path,"number");
+			target=value.toDouble();
+		}
+	};
+
+	template <>
+	struct Decoder<QDateTime>
+	{
+		static void Decode(const QJsonValue &value,QDateTime &target,const Path &path)
+		{
+			if (!value.isString()) throw Mismatch(path,"date");
+			target=QDateTime::fromString(value.toString(),Qt::ISODate);
+			if (!target.isValid()) throw Mismatch(path,"date");
+		}
+	};
+
+	template <>
+	struct Decoder<QJsonObject>
+	{
+		static void Decode(const QJsonValue &value,QJsonObject &target,const Path &path)
+		{
+			if (!value.isObject()) throw Mismatch(path,"object");
+			target=value.toObject();
+		}
+	};
+
+	template <>
+	struct Decoder<QStringList>
+	{
+		static void Decode(const QJsonValue &value,QStringList &target,const Path &path)
+		{
+			if (!value.isArray()) throw Mismatch(path,"array");
+			const QJsonArray array=value.toArray();
+			target.reserve(array.size());
+			for (qsizetype index=0; index < array.size(); index++)
+			{
+				QString &entry=target.emplace_back();
+				JSON::Decode(array.at(index),entry,{.parent=&path,.key={},.index=index});
+			}
+		}
+	};
+
+	template <typename T>
+	struct Decoder<std::vector<T>>
+	{
+		static void Decode(const QJsonValue &value,std::vector<T> &target,const Path &path)
+		{
+			if (!value.isArray()) throw Mismatch(path,"array");
+			const QJsonArray array=value.toArray();
+			target.resize(array.size());
+			for (qsizetype index=0; index < array.size(); index++) JSON::Decode(array.at(index),target[index],{.parent=&path,.key={},.index=index});
+		}
+	};
+
+	//! Keeps whichever elements of an array decode, for lists where one malformed entry shouldn't cost the rest
+	template <typename T>
+	struct Lenient
+	{
+		std::vector<T> entries;
+		QStringList skipped;
+	};
+
+	template <typename T>
+	struct Decoder<Lenient<T>>
+	{
+		static void Decode(const QJsonValue &value,Lenient<T> &target,const Path &path)
+		{
+			if (!value.isArray()) throw Mismatch(path,"array");
+			const QJsonArray array=value.toArray();
+			target.entries.reserve(array.size());
+			for (qsizetype index=0; index < array.size(); index++)
+			{
+				T entry{};
+				try
+				{
+					JSON::Decode(array.at(index),entry,{.parent=&path,.key={},.index=index});
+				}
+
+				catch (const Error &exception)
+				{
+					target.skipped.append(QString::fromUtf8(exception.what()));
+					continue;
+				}
+				target.entries.push_back(std::move(entry));
+			}
+		}
+	};
+
+	template <typename T>
+	struct Decoder<std::optional<T>>
+	{
+		static void Decode(const QJsonValue &value,std::optional<T> &target,const Path &path)
+		{
+			if (value.isNull()) return;
+			JSON::Decode(value,target.emplace(),path);
+		}
+	};
+
+	template <Bound T>
+	struct Decoder<T>
+	{
+		static constexpr auto FIELDS=T::Fields();
+		static constexpr std::size_t COUNT=std::tuple_size_v<decltype(FIELDS)>;
+
+		static void Decode(const QJsonValue &value,T &target,const Path &path)
+		{
+			if (!value.isObject()) throw Mismatch(path,"object");
+			const QJsonObject object=value.toObject();
+			std::bitset<COUNT> found;
+			for (auto entry=object.constBegin(); entry != object.constEnd(); ++entry)
+				Match(entry.key(),entry.value(),target,path,found,std::make_index_sequence<COUNT>{});
+			Verify(path,found,std::make_index_sequence<COUNT>{});
+		}
+
+	protected:
+		template <std::size_t... INDEX>
+		static void Match(const QString &key,const QJsonValue &value,T &target,const Path &path,std::bitset<COUNT> &found,std::index_sequence<INDEX...>)
+		{
+			// stops at the first field whose key matches, so each entry is converted at most once
+			(... || Assign<INDEX>(key,value,target,path,found));
+		}
+
+		template <std::size_t INDEX>
+		static bool Assign(const QString &key,const QJsonValue &value,T &target,const Path &path,std::bitset<COUNT> &found)
+		{
+			const auto &field=std::get<INDEX>(FIELDS);
+			if (key != QLatin1String(field.key.data(),static_cast<qsizetype>(field.key.size()))) return false;
+			found.set(INDEX);
+			if (value.isNull() && !field.required) return true;
+			JSON::Decode(value,target.*field.member,{.parent=&path,.key=field.key});
+			return true;
+		}
+
+		template <std::size_t... INDEX>
+		static void Verify(const Path &path,const std::bitset<COUNT> &found,std::index_sequence<INDEX...>)
+		{
+			(Require<INDEX>(path,found),...);
+		}
+
+		template <std::size_t INDEX>
+		static void Require(const Path &path,const std::bitset<COUNT> &found)
+		{
+			const auto &field=std::get<INDEX>(FIELDS);
+			if (field.required && !found.test(INDEX)) throw Error(QString("Missing field %1").arg(Path{.parent=&path,.key=field.key}.String()));
+		}
+	};
+
+	template <typename T>
+	T Decode(const QJsonValue &value)
+	{
+		T result{};
+		JSON::Decode(value,result,Path{});
+		return result;
+	}
+
+	template <typename T>
+	T Decode(const QByteArray &data)
+	{
+		QJsonParseError jsonError={
+			.offset=0,
+			.error=QJsonParseError::NoError
+		};
+		const QJsonDocument json=QJsonDocument::fromJson(data,&jsonError);
+		if (jsonError.error != QJsonParseError::NoError) throw Error(jsonError.errorString());
+		if (json.isArray()) return Decode<T>(QJsonValue(json.array()));
+		return Decode<T>(QJsonValue(json.object()));
+	}
+}
@@ -3,11 +3,15 @@
 #include <QApplication>
 #include <QTimeZone>
 #include <QNetworkReply>
+#include <QElapsedTimer>
 #include <ranges>
 #include "bot.h"
 #include "globals.h"
 #include "network.h"
 #include "twitch.h"
+#include "cache.h"
+#include "decode.h"
+#include "library.h"
 
 const char *COMMANDS_LIST_FILENAME="commands.json";
 const char *COMMAND_TYPE_NATIVE="native";
@@ -46,9 +50,8 @@ const char *TWITCH_API_OPERATION_EMOTE_ONLY="emote only";
 const char *TWITCH_API_OPERATION_STREAM_TITLE="stream title";
 const char *TWITCH_API_OPERATION_STREAM_CATEGORY="stream category";
 const char *TWITCH_API_OPERATION_LOAD_BADGES="badges";
+const char *TWITCH_API_OPERATION_LOAD_EMOTES="emotes";
 const char *TWITCH_API_OPERATION_SHOUTOUT="shoutout";
-const char *TWITCH_API_ERROR_TEMPLATE_INCOMPLETE="Response from requesting %1 was incomplete";
-const char *TWITCH_API_ERROR_TEMPLATE_UNKNOWN="Something went wrong obtaining %1";
 const char *TWITCH_API_ERROR_TEMPLATE_JSON_PARSE="Error parsing %1 JSON: %2";
 const char *TWITCH_API_ERROR_AUTH="Auth token or client ID missing or invalid";
 const char16_t *CHAT_BADGE_BROADCASTER=u"broadcaster";
@@ -97,6 +100,7 @@ Bot::Bot(Music::Player &musicPlayer,Security &security,QObject *parent) : QObjec
 	settingDeniedCommandVideo(SETTINGS_CATEGORY_COMMANDS,"Denied"),
 	settingCommandCooldown(SETTINGS_CATEGORY_COMMANDS,"Cooldown",10), // in minutes
 	settingUptimeHistory(SETTINGS_CATEGORY_COMMANDS,"UptimeHistory",0),
+	settingSongRequestLimit(SETTINGS_CATEGORY_COMMANDS,"SongRequestLimit",2), // songs waiting to be played per viewer
 	settingCommandNameAgenda(SETTINGS_CATEGORY_COMMANDS,"Agenda","agenda"),
 	settingCommandNameStreamCategory(SETTINGS_CATEGORY_COMMANDS,"StreamCategory","category"),
 	settingCommandNameStreamTitle(SETTINGS_CATEGORY_COMMANDS,"StreamTitle","title"),
@@ -106,6 +110,7 @@ Bot::Bot(Music::Player &musicPlayer,Security &security,QObject *parent) : QObjec
 	settingCommandNameHTML(SETTINGS_CATEGORY_COMMANDS,"HTML","html"),
 	settingCommandNameLimit(SETTINGS_CATEGORY_COMMANDS,"Limit","limit"),
 	settingCommandNamePanic(SETTINGS_CATEGORY_COMMANDS,"Panic","panic"),
+	settingCommandNameSongRequest(SETTINGS_CATEGORY_COMMANDS,"SongRequest","request"),
 	settingCommandNameShoutout(SETTINGS_CATEGORY_COMMANDS,"Shoutout","so"),
 	settingCommandNameSong(SETTINGS_CATEGORY_COMMANDS,"Song","song"),
 	settingCommandNameTimezone(SETTINGS_CATEGORY_COMMANDS,"Timezone","timezone"),
@@ -123,6 +128,7 @@ Bot::Bot(Music::Player &musicPlayer,Security &security,QObject *parent) : QObjec
 	DeclareCommand({settingCommandNameHTML,"Format the chat message as HTML",CommandType::NATIVE,false},NativeCommandFlag::HTML);
 	DeclareCommand({settingCommandNameLimit,"Limit frequency of viewer's commands with a cooldown",CommandType::NATIVE,true},NativeCommandFlag::LIMIT);
 	DeclareCommand({settingCommandNamePanic,"Crash Celeste",CommandType::NATIVE,true},NativeCommandFlag::PANIC);
+	DeclareCommand({settingCommandNameSongRequest,"Request a song from the vibe playlist by its title or artist",CommandType::NATIVE,false},NativeCommandFlag::REQUEST);
 	DeclareCommand({settingCommandNameShoutout,"Call attention to another streamer's channel",CommandType::NATIVE,false},NativeCommandFlag::SHOUTOUT);
 	DeclareCommand({settingCommandNameSong,"Show the title, album, and artist of the song that is currently playing",CommandType::NATIVE,false},NativeCommandFlag::SONG);
 	DeclareCommand({settingCommandNameTimezone,"Display the timezone of the system the bot is running on",CommandType::NATIVE,false},NativeCommandFlag::TIMEZONE);
@@ -133,9 +139,14 @@ Bot::Bot(Music::Player &musicPlayer,Security &security,QObject *parent) : QObjec
 	LoadViewerAttributes();
 
 	if (settingRoasts) LoadRoasts();
-	LoadBadgeIconURLs();
 	StartClocks();
 
+	// the broadcaster's ID is only known once security has finished talking to Twitch, and badges and emotes don't change when it reauthorizes
+	connect(&security,&Security::Initialized,this,[this]() {
+		LoadBadgeIconURLs().Start(this);
+		PrefetchEmotes().Start(this);
+	},Qt::SingleShotConnection);
+
 	lastRaid=QDateTime::currentDateTime().addMSecs(static_cast<qint64>(0)-static_cast<qint64>(settingRaidInterruptDuration));
 
 	connect(&vibeKeeper,&Music::Player::Print,this,&Bot::Print);
@@ -350,6 +361,11 @@ const Command::Lookup& Bot::Commands() const
 	return commands;
 }
 
+const Bot::NativeCommandFlagLookup& Bot::NativeCommandFlags() const
+{
+	return nativeCommandFlags;
+}
+
 bool Bot::LoadViewerAttributes() // FIXME: have this throw an exception rather than return a bool
 {
 	QFile viewerAttributesFile(Filesystem::DataPath().filePath(VIEWER_ATTRIBUTES_FILENAME));
@@ -480,45 +496,74 @@ void Bot::LoadRoasts()
 	roaster.Sources(File::List{static_cast<QString>(settingRoasts),Command::FileListFilters(CommandType::AUDIO)});
 }
 
-void Bot::LoadBadgeIconURLs()
+Async::Task<void> Bot::LoadBadgeIconURLs()
 {
-	Network::Request::Send({Twitch::Endpoint(Twitch::ENDPOINT_BADGES)},Network::Method::GET,[this](QNetworkReply *reply) {
-		static const char *JSON_KEY_ID="id";
-		static const char *JSON_KEY_SET_ID="set_id";
-		static const char *JSON_KEY_VERSIONS="versions";
-		static const char *JSON_KEY_IMAGE_URL="image_url_1x";
+	const Network::Headers headers={
+		{NETWORK_HEADER_AUTHORIZATION,security.Bearer(security.OAuthToken())},
+		{NETWORK_HEADER_CLIENT_ID,security.ClientID()}
+	};
+
+	// each list is stored on its own so a failed request for one doesn't cost the other
+	// channel badges come second so they replace global ones of the same name, like custom subscriber badges
+	StoreBadgeIconURLs(co_await Network::Request::Await({Twitch::Endpoint(Twitch::ENDPOINT_BADGES)},Network::Method::GET,{},headers));
+	StoreBadgeIconURLs(co_await Network::Request::Await({Twitch::Endpoint(Twitch::ENDPOINT_CHANNEL_BADGES)},Network::Method::GET,{
+		{QUERY_PARAMETER_BROADCASTER_ID,security.AdministratorID()}
+	},headers));
+
+	// download every badge in the background so none of them have to be fetched mid-stream
+	for (const auto &[set,versions] : badgeIconURLs)
+	{
+		for (const auto &[version,url] : versions) Cache::Assets::Shared().Fetch(QString(Cache::KEY_BADGE).arg(url),url,Network::Priority::LOW);
+	}
+}
 
-		const JSON::ParseResult parsedJSON=JSON::Parse(reply->readAll());
-		if (!parsedJSON)
+void Bot::StoreBadgeIconURLs(const Network::Reply &reply)
+{
+	if (reply.error)
+	{
+		emit Print(QString("Failed to download badge list: %1").arg(reply.errorString),TWITCH_API_OPERATION_LOAD_BADGES);
+		return;
+	}
+
+	try
+	{
+		const Twitch::Helix::Listing<Twitch::Helix::BadgeSet> response=JSON::Decode<Twitch::Helix::Listing<Twitch::Helix::BadgeSet>>(reply.body);
+		for (const QString &skipped : response.data.skipped) emit Print(QString(TWITCH_API_ERROR_TEMPLATE_JSON_PARSE).arg(TWITCH_API_OPERATION_LOAD_BADGES,skipped));
+		for (const Twitch::Helix::BadgeSet &set : response.data.entries)
 		{
-			emit Print(QString(TWITCH_API_ERROR_TEMPLATE_JSON_PARSE).arg(TWITCH_API_OPERATION_LOAD_BADGES,parsedJSON.error));
-			return;
+			for (const Twitch::Helix::BadgeVersion &version : set.versions) badgeIconURLs[set.id][version.id]=version.imageURL; // NOTE: I'm not sure how to construct in place here
 		}
+	}
+
+	catch (const JSON::Error &exception)
+	{
+		emit Print(QString(TWITCH_API_ERROR_TEMPLATE_JSON_PARSE).arg(TWITCH_API_OPERATION_LOAD_BADGES,exception.what()));
+	}
+}
 
-		const QJsonObject object=parsedJSON().object();
-		auto jsonFieldData=object.find(JSON::Keys::DATA);
-		if (jsonFieldData == object.end()) return;
-		const QJsonArray jsonFieldArray=jsonFieldData->toArray();
-		for (const QJsonValue &set : jsonFieldArray)
+Async::Task<void> Bot::PrefetchEmotes()
+{
+	try
+	{
+		Network::Reply reply=co_await Network::Request::Await({Twitch::Endpoint(Twitch::ENDPOINT_CHANNEL_EMOTES)},Network::Method::GET,{
+			{QUERY_PARAMETER_BROADCASTER_ID,security.AdministratorID()}
+		},{
+			{NETWORK_HEADER_AUTHORIZATION,security.Bearer(security.OAuthToken())},
+			{NETWORK_HEADER_CLIENT_ID,security.ClientID()}
+		});
+		if (reply.error)
 		{
-			const QJsonObject objectBadgeSet=set.toObject();
-			auto jsonFieldSetID=objectBadgeSet.find(JSON_KEY_SET_ID);
-			auto jsonFieldVersions=objectBadgeSet.find(JSON_KEY_VERSIONS);
-			if (jsonFieldSetID == objectBadgeSet.end() || jsonFieldVersions == objectBadgeSet.end()) return;
-			const QJsonArray jsonFieldVersionsArray=jsonFieldVersions->toArray();
-			for (const QJsonValue &version : jsonFieldVersionsArray)
-			{
-				const QJsonObject objectImageVersions=version.toObject();
-				auto jsonFieldID=objectImageVersions.find(JSON_KEY_ID);
-				auto jsonFieldVersionURL=objectImageVersions.find(JSON_KEY_IMAGE_URL);
-				if (jsonFieldID == objectImageVersions.end() || jsonFieldVersionURL == objectImageVersions.end()) return;
-				badgeIconURLs[jsonFieldSetID->toString()][jsonFieldID->toString()]=jsonFieldVersionURL->toString(); // NOTE: I'm not sure how to construct in place here
-			}
+			emit Print(QString("Failed to download emote list: %1").arg(reply.errorString),TWITCH_API_OPERATION_LOAD_EMOTES);
+			co_return;
 		}
-	},{},{
-		{NETWORK_HEADER_AUTHORIZATION,security.Bearer(security.OAuthToken())},
-		{NETWORK_HEADER_CLIENT_ID,security.ClientID()}
-	});
+		const Twitch::Helix::Listing<Twitch::Helix::Emote> response=JSON::Decode<Twitch::Helix::Listing<Twitch::Helix::Emote>>(reply.body);
+		for (const Twitch::Helix::Emote &emote : response.data.entries) Cache::Assets::Shared().Fetch(QString(Cache::KEY_EMOTE).arg(emote.id),Twitch::Content(Twitch::ENDPOINT_EMOTES).arg(emote.id),Network::Priority::LOW);
+	}
+
+	catch (const JSON::Error &exception)
+	{
+		emit Print(QString(TWITCH_API_ERROR_TEMPLATE_JSON_PARSE).arg(TWITCH_API_OPERATION_LOAD_EMOTES,exception.what()));
+	}
 }
 
 void Bot::StartClocks()
@@ -587,6 +632,16 @@ void Bot::Subscription(const QString &login,const QString &displayName)
 	viewer->second.subscribed=true;
 }
 
+void Bot::GiftSubscription(const QString &gifter,const unsigned int count)
+{
+	if (static_cast<QString>(settingSubscriptionSound).isEmpty())
+	{
+		emit Print("No audio path set for subscriptions","announce gift subscription");
+		return;
+	}
+	emit AnnounceGiftSubscription(gifter,count,settingSubscriptionSound);
+}
+
 void Bot::Raid(const QString &viewer,const unsigned int viewers)
 {
 	lastRaid=QDateTime::currentDateTime();
@@ -868,22 +923,9 @@ std::optional<QString> Bot::DownloadBadgeIcon(const QString &badge,const QString
 	if (badgeIconVersions == badgeIconURLs.end()) return std::nullopt;
 	auto badgeIconVersion=badgeIconVersions->second.find(version);
 	if (badgeIconVersion == badgeIconVersions->second.end()) return std::nullopt;
-	const QString badgeIconURL=badgeIconVersion->second;
-	static const QString CHAT_BADGE_ICON_PATH_TEMPLATE=Filesystem::TemporaryPath().filePath(QString("%1_%2.png"));
-	QString badgePath=CHAT_BADGE_ICON_PATH_TEMPLATE.arg(badge,version);
-	if (!QFile(badgePath).exists())
-	{
-		Network::Request::Send(badgeIconURL,Network::Method::GET,[this,badgeIconURL,badgePath](QNetworkReply *downloadReply) {
-			if (downloadReply->error())
-			{
-				emit Print(QString("Failed to download badge %1: %2").arg(badgeIconURL,downloadReply->errorString()));
-				return;
-			}
-			if (!QImage::fromData(downloadReply->readAll()).save(badgePath)) emit Print(QString("Failed to save badge %2").arg(badgePath));
-			emit RefreshChat();
-		});
-	}
-	return badgePath;
+	const QString key=QString(Cache::KEY_BADGE).arg(badgeIconVersion->second);
+	Cache::Assets::Shared().Fetch(key,badgeIconVersion->second);
+	return Cache::Assets::URL(key).toString();
 }
 
 int Bot::ParseEmoteNamesAndDownloadImages(std::vector<Chat::Emote> &emotes,const QStringView &textWindow)
@@ -901,19 +943,9 @@ int Bot::ParseEmoteNamesAndDownloadImages(std::vector<Chat::Emote> &emotes,const
 
 void Bot::DownloadEmote(Chat::Emote &emote)
 {
-	emote.path=Filesystem::TemporaryPath().filePath(QString("%1.png").arg(emote.id));
-	if (!QFile(emote.path).exists())
-	{
-		Network::Request::Send(Twitch::Content(Twitch::ENDPOINT_EMOTES).arg(emote.id),Network::Method::GET,[this,emote](QNetworkReply *downloadReply) {
-			if (downloadReply->error())
-			{
-				emit Print(QString("Failed to download emote %1: %2").arg(emote.name,downloadReply->errorString()));
-				return;
-			}
-			if (!QImage::fromData(downloadReply->readAll()).save(emote.path)) emit Print(QString("Failed to save emote %1 to %2").arg(emote.name,emote.path));
-			emit RefreshChat();
-		});
-	}
+	const QString key=QString(Cache::KEY_EMOTE).arg(emote.id);
+	emote.path=Cache::Assets::URL(key).toString();
+	Cache::Assets::Shared().Fetch(key,Twitch::Content(Twitch::ENDPOINT_EMOTES).arg(emote.id));
 }
 
 std::optional<QString> Bot::ParseCommandIfExists(QStringView &message)
@@ -1043,17 +1075,14 @@ void Bot::DispatchCommandViaCommandObject(const Command &command,const QString &
 			case NativeCommandFlag::PANIC:
 				DispatchPanic(viewer.DisplayName());
 				break;
+			case NativeCommandFlag::REQUEST:
+				DispatchSongRequest(viewer,command.Message());
+				break;
 			case NativeCommandFlag::SHOUTOUT:
 				DispatchShoutout(command);
 				break;
 			case NativeCommandFlag::SONG:
-				if (Music::Metadata metadata=vibeKeeper.Metadata(); !metadata.title.isEmpty() && !metadata.artist.isEmpty() && !metadata.cover.isNull())
-				{
-					if (metadata.album.isEmpty())
-						emit ShowCurrentSong(metadata.title,metadata.artist,metadata.cover);
-					else
-						emit ShowCurrentSong(metadata.title,metadata.album,metadata.artist,metadata.cover);
-				}
+				if (Music::Metadata metadata=vibeKeeper.Metadata(); !metadata.title.isEmpty() && !metadata.artist.isEmpty() && metadata.cover) AnnounceCurrentSong(metadata).Start(this);
 				break;
 			case NativeCommandFlag::TIMEZONE:
 				emit ShowTimezone(QDateTime::currentDateTime().timeZone().displayName(QDateTime::currentDateTime().timeZone().isDaylightTime(QDateTime::currentDateTime()) ? QTimeZone::DaylightTime : QTimeZone::StandardTime,QTimeZone::LongName));
@@ -1104,36 +1133,18 @@ void Bot::DispatchCommandList()
 void Bot::DispatchFollowage(const Viewer::Local &viewer)
 {
 	Network::Request::Send({Twitch::Endpoint(Twitch::ENDPOINT_USER_FOLLOWS)},Network::Method::GET,[this,viewer](QNetworkReply *reply) {
-		const JSON::ParseResult parsedJSON=JSON::Parse(reply->readAll());
-		if (!parsedJSON)
-		{
-			emit Print(QString(TWITCH_API_ERROR_TEMPLATE_JSON_PARSE).arg(TWITCH_API_OPERATION_USER_FOLLOWS,parsedJSON.error));
-			return;
-		}
-
-		const QJsonObject object=parsedJSON().object();
-		auto jsonFieldData=object.find(JSON::Keys::DATA);
-		if (jsonFieldData == object.end())
+		QDateTime start;
+		try
 		{
-			emit Print(QString(TWITCH_API_ERROR_TEMPLATE_UNKNOWN).arg(TWITCH_API_OPERATION_USER_FOLLOWS));
-			return;
+			start=Twitch::Helix::First<Twitch::Helix::Follower>(reply->readAll()).followedAt; // because I fill in both from_id and to_id fields, there is only one result, so just grab the first one out of the array
 		}
 
-		const QJsonArray jsonUsers=jsonFieldData->toArray();
-		if (jsonUsers.size() < 1)
+		catch (const JSON::Error &exception)
 		{
-			emit Print(QString(TWITCH_API_ERROR_TEMPLATE_INCOMPLETE).arg(TWITCH_API_OPERATION_USER_FOLLOWS));
+			emit Print(QString(TWITCH_API_ERROR_TEMPLATE_JSON_PARSE).arg(TWITCH_API_OPERATION_USER_FOLLOWS,exception.what()));
 			return;
 		}
 
-		const QJsonObject jsonUserDetails=jsonUsers.at(0).toObject(); // because I fill in both from_id and to_id fields, there is only one result, so just grab the first one out of the array
-		auto jsonFieldFollowDate=jsonUserDetails.find("followed_at");
-		if (jsonFieldFollowDate == jsonUserDetails.end())
-		{
-			emit Print(QString(TWITCH_API_ERROR_TEMPLATE_INCOMPLETE).arg(TWITCH_API_OPERATION_USER_FOLLOWS));
-			return;
-		}
-		const QDateTime start=QDateTime::fromString(jsonFieldFollowDate->toString(),Qt::ISODate);
 		std::chrono::milliseconds duration=static_cast<std::chrono::milliseconds>(start.msecsTo(QDateTime::currentDateTimeUtc()));
 		std::chrono::years years=std::chrono::duration_cast<std::chrono::years>(duration);
 		std::chrono::months months=std::chrono::duration_cast<std::chrono::months>(duration-years);
@@ -1168,48 +1179,77 @@ void Bot::DispatchShoutout(Command command)
 
 void Bot::DispatchShoutout(const QString &streamer)
 {
-	Viewer::Remote *profile=new Viewer::Remote(security,streamer);
-	connect(profile,&Viewer::Remote::Recognized,profile,[this](const Viewer::Local &profile) {
-		// native Twitch shoutout
-		Network::Request::Send({Twitch::Endpoint(Twitch::ENDPOINT_SHOUTOUTS)},Network::Method::POST,[this,streamerID=profile.ID()](QNetworkReply *reply) {
-			// 204 is successful
-			switch (reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt())
-			{
-			case 400:
-				emit Print(u"Invalid or missing information in request"_s,TWITCH_API_OPERATION_SHOUTOUT);
-				return;
-			case 401:
-				emit Print(TWITCH_API_ERROR_AUTH,TWITCH_API_OPERATION_SHOUTOUT);
-				return;
-			case 403:
-				emit Print(u"User attempting shoutout is not a moderator"_s,TWITCH_API_OPERATION_SHOUTOUT);
-				return;
-			case 429:
-				emit Print(u"Shoutout feature is still in cooldown"_s,TWITCH_API_OPERATION_SHOUTOUT);
-				return;
-			}
+	PerformShoutout(streamer).Start(this);
+}
 
-			if (reply->error())
-			{
-				emit Print(u"Failed to perform shoutout for unknown reason"_s,TWITCH_API_OPERATION_SHOUTOUT);
-				return;
-			}
-		},{
-			{"from_broadcaster_id",security.AdministratorID()},
-			{"to_broadcaster_id",profile.ID()},
-			{"moderator_id",security.AdministratorID()}
-		},{
-			{NETWORK_HEADER_AUTHORIZATION,StringConvert::ByteArray(QString("Bearer %1").arg(static_cast<QString>(security.OAuthToken())))},
-			{NETWORK_HEADER_CLIENT_ID,security.ClientID()},
-			{Network::CONTENT_TYPE,Network::CONTENT_TYPE_FORM} // Error code 400 can also be cause by missing content type
-		});
-		// bot shoutout
-		Viewer::ProfileImage::Remote *profileImage=profile.ProfileImage();
-		connect(profileImage,&Viewer::ProfileImage::Remote::Retrieved,profileImage,[this,displayName=profile.DisplayName(),description=profile.Description()](std::shared_ptr<QImage> profileImage) {
-			emit Shoutout(displayName,description,profileImage);
-		},Qt::QueuedConnection);
-	},Qt::QueuedConnection);
-	connect(profile,&Viewer::Remote::Print,this,&Bot::Print);
+Async::Task<void> Bot::PerformShoutout(QString streamer)
+{
+	try
+	{
+		const Viewer::Local profile=co_await Viewer::Remote::Lookup(security,streamer);
+		// native Twitch shoutout and bot shoutout go out at the same time
+		auto [shoutedOut,profileImage]=co_await Async::WhenAll(RequestShoutout(profile.ID()),Viewer::ProfileImage::Remote::Download(profile.ProfileImageURL()));
+		emit Shoutout(profile.DisplayName(),profile.Description(),profileImage);
+	}
+
+	catch (const std::runtime_error &exception)
+	{
+		emit Print(exception.what(),TWITCH_API_OPERATION_SHOUTOUT);
+	}
+}
+
+Async::Task<void> Bot::AnnounceCurrentSong(Music::Metadata metadata)
+{
+	// album covers are often far larger than they'll ever be shown, so they're decoded off the GUI thread at screen size and kept that way
+	const QImage cover=co_await Music::MetadataCache::Shared().Cover(metadata.path,Decode::Pool::ScreenBound());
+	if (cover.isNull())
+	{
+		emit Print(QString("Failed to decode album cover for %1").arg(metadata.title),u"current song"_s);
+		co_return;
+	}
+
+	if (metadata.album.isEmpty())
+		emit ShowCurrentSong(metadata.title,metadata.artist,cover);
+	else
+		emit ShowCurrentSong(metadata.title,metadata.album,metadata.artist,cover);
+}
+
+Async::Task<bool> Bot::RequestShoutout(QString streamerID)
+{
+	Network::Reply reply=co_await Network::Request::Await({Twitch::Endpoint(Twitch::ENDPOINT_SHOUTOUTS)},Network::Method::POST,{
+		{"from_broadcaster_id",security.AdministratorID()},
+		{"to_broadcaster_id",streamerID},
+		{"moderator_id",security.AdministratorID()}
+	},{
+		{NETWORK_HEADER_AUTHORIZATION,StringConvert::ByteArray(QString("Bearer %1").arg(static_cast<QString>(security.OAuthToken())))},
+		{NETWORK_HEADER_CLIENT_ID,security.ClientID()},
+		{Network::CONTENT_TYPE,Network::CONTENT_TYPE_FORM} // Error code 400 can also be cause by missing content type
+	});
+
+	// 204 is successful
+	switch (reply.status)
+	{
+	case 400:
+		emit Print(u"Invalid or missing information in request"_s,TWITCH_API_OPERATION_SHOUTOUT);
+		co_return false;
+	case 401:
+		emit Print(TWITCH_API_ERROR_AUTH,TWITCH_API_OPERATION_SHOUTOUT);
+		co_return false;
+	case 403:
+		emit Print(u"User attempting shoutout is not a moderator"_s,TWITCH_API_OPERATION_SHOUTOUT);
+		co_return false;
+	case 429:
+		emit Print(u"Shoutout feature is still in cooldown"_s,TWITCH_API_OPERATION_SHOUTOUT);
+		co_return false;
+	}
+
+	if (reply.error)
+	{
+		emit Print(u"Failed to perform shoutout for unknown reason"_s,TWITCH_API_OPERATION_SHOUTOUT);
+		co_return false;
+	}
+
+	co_return true;
 }
 
 void Bot::DispatchUptime(bool total)
@@ -1231,37 +1271,18 @@ void Bot::DispatchUptime(bool total)
 			return;
 		}
 
-		const JSON::ParseResult parsedJSON=JSON::Parse(reply->readAll());
-		if (!parsedJSON)
+		QDateTime start;
+		try
 		{
-			emit Print(QString(TWITCH_API_ERROR_TEMPLATE_JSON_PARSE).arg(TWITCH_API_OPERATION_STREAM_INFORMATION,parsedJSON.error));
-			return;
-		}
-
-		const QJsonObject object=parsedJSON().object();
-		auto jsonFieldData=object.find(JSON::Keys::DATA);
-		if (jsonFieldData == object.end())
-		{
-			emit Print(QString(TWITCH_API_ERROR_TEMPLATE_UNKNOWN).arg(TWITCH_API_OPERATION_STREAM_INFORMATION));
-			return;
+			start=Twitch::Helix::First<Twitch::Helix::Stream>(reply->readAll()).startedAt; // we're only specifying one user ID so just grab the first result in the array
 		}
 
-		const QJsonArray jsonUsers=jsonFieldData->toArray();
-		if (jsonUsers.size() < 1)
+		catch (const JSON::Error &exception)
 		{
-			emit Print(QString(TWITCH_API_ERROR_TEMPLATE_INCOMPLETE).arg(TWITCH_API_OPERATION_STREAM_INFORMATION));
+			emit Print(QString(TWITCH_API_ERROR_TEMPLATE_JSON_PARSE).arg(TWITCH_API_OPERATION_STREAM_INFORMATION,exception.what()));
 			return;
 		}
 
-		const QJsonObject details=jsonUsers.at(0).toObject(); // we're only specifying one user ID so just grab the first result in the array
-		auto jsonFieldStartDate=details.find("started_at");
-		if (jsonFieldStartDate == details.end())
-		{
-			emit Print(QString(TWITCH_API_ERROR_TEMPLATE_INCOMPLETE).arg(TWITCH_API_OPERATION_STREAM_INFORMATION));
-			return;
-		}
-
-		const QDateTime start=QDateTime::fromString(jsonFieldStartDate->toString(),Qt::ISODate);
 		std::chrono::milliseconds duration=static_cast<std::chrono::milliseconds>(start.msecsTo(QDateTime::currentDateTimeUtc()));
 		if (total) duration+=std::chrono::minutes(static_cast<qint64>(settingUptimeHistory));
 		std::chrono::hours hours=std::chrono::duration_cast<std::chrono::hours>(duration);
@@ -1344,6 +1365,43 @@ void Bot::AdjustVibeVolume(Command command)
 	}
 }
 
+void Bot::DispatchSongRequest(const Viewer::Local &viewer,const QString &query)
+{
+	static const char *OPERATION="song request";
+
+	if (query.trimmed().isEmpty())
+	{
+		emit Print(QString("%1 asked for a song without saying which one").arg(viewer.DisplayName()),OPERATION);
+		return;
+	}
+
+	QElapsedTimer clock;
+	clock.start();
+	const std::vector<Music::SearchIndex::Match> matches=Music::Library::Shared().Search(query);
+	const qint64 elapsed=clock.nsecsElapsed()/1000;
+	if (matches.empty())
+	{
+		emit Print(QString(R"(No song matches "%1" (requested by %2))").arg(query,viewer.DisplayName()),OPERATION);
+		return;
+	}
+
+	const Music::SearchIndex::Match &match=matches.front();
+	emit Print(QString(R"(Matched "%1" to %2 by %3 in %4 microseconds)").arg(query,match.title,match.artist,QString::number(elapsed)),OPERATION);
+	if (vibeKeeper.Requested(match.path))
+	{
+		emit Print(QString("%1 is already playing or waiting to be played").arg(match.title),OPERATION);
+		return;
+	}
+	if (vibeKeeper.Requests(viewer.Name()) >= static_cast<int>(settingSongRequestLimit))
+	{
+		emit Print(QString("%1 already has as many songs waiting as they're allowed").arg(viewer.DisplayName()),OPERATION);
+		return;
+	}
+
+	vibeKeeper.Request(match.path,viewer.Name());
+	emit AnnounceSongRequest(viewer.DisplayName(),match.title,match.artist);
+}
+
 void Bot::ToggleEmoteOnly()
 {
 	Network::Request::Send({Twitch::Endpoint(Twitch::ENDPOINT_CHAT_SETTINGS)},Network::Method::GET,[this](QNetworkReply *reply) {
@@ -1363,40 +1421,15 @@ void Bot::ToggleEmoteOnly()
 			return;
 		}
 
-		const JSON::ParseResult parsedJSON=JSON::Parse(reply->readAll());
-		if (!parsedJSON)
+		try
 		{
-			emit Print(QString(TWITCH_API_ERROR_TEMPLATE_JSON_PARSE).arg(TWITCH_API_OPERATION_EMOTE_ONLY,parsedJSON.error));
-			return;
+			EmoteOnly(!Twitch::Helix::First<Twitch::Helix::ChatSettings>(reply->readAll()).emoteMode);
 		}
 
-		const QJsonObject object=parsedJSON().object();
-		auto jsonFieldData=object.find(JSON::Keys::DATA);
-		if (jsonFieldData == object.end())
+		catch (const JSON::Error &exception)
 		{
-			emit Print(QString(TWITCH_API_ERROR_TEMPLATE_UNKNOWN).arg(TWITCH_API_OPERATION_EMOTE_ONLY));
-			return;
-		}
-
-		const QJsonArray details=jsonFieldData->toArray();
-		if (details.size() < 1)
-		{
-			emit Print(QString(TWITCH_API_ERROR_TEMPLATE_INCOMPLETE).arg(TWITCH_API_OPERATION_EMOTE_ONLY));
-			return;
+			emit Print(QString(TWITCH_API_ERROR_TEMPLATE_JSON_PARSE).arg(TWITCH_API_OPERATION_EMOTE_ONLY,exception.what()));
 		}
-
-		const QJsonObject fields=details.at(0).toObject();
-		auto jsonFieldEmoteMode=fields.find("emote_mode");
-		if (jsonFieldEmoteMode == fields.end())
-		{
-			emit Print(QString(TWITCH_API_ERROR_TEMPLATE_INCOMPLETE).arg(TWITCH_API_OPERATION_EMOTE_ONLY));
-			return;
-		}
-
-		if (jsonFieldEmoteMode->toBool())
-			EmoteOnly(false);
-		else
-			EmoteOnly(true);
 	},{
 		{QUERY_PARAMETER_BROADCASTER_ID,security.AdministratorID()},
 		{QUERY_PARAMETER_MODERATOR_ID,security.AdministratorID()}
@@ -1462,62 +1495,44 @@ void Bot::StreamTitle(const QString &title)
 
 void Bot::StreamCategory(const QString &category)
 {
-	Network::Request::Send({Twitch::Endpoint(Twitch::ENDPOINT_GAME_INFORMATION)},Network::Method::GET,[this,category](QNetworkReply *reply) {
-		const JSON::ParseResult parsedJSON=JSON::Parse(reply->readAll());
-		if (!parsedJSON)
-		{
-			Print (QString(TWITCH_API_ERROR_TEMPLATE_JSON_PARSE).arg(TWITCH_API_OPERATION_STREAM_CATEGORY,parsedJSON.error));
-			return;
-		}
+	ChangeStreamCategory(category).Start(this);
+}
 
-		const QJsonObject object=parsedJSON().object();
-		auto jsonFieldData=object.find(JSON::Keys::DATA);
-		if (jsonFieldData == object.end())
-		{
-			emit Print(QString(TWITCH_API_ERROR_TEMPLATE_UNKNOWN).arg(TWITCH_API_OPERATION_STREAM_CATEGORY));
-			return;
-		}
+Async::Task<void> Bot::ChangeStreamCategory(QString category)
+{
+	const Network::Reply lookup=co_await Network::Request::Await({Twitch::Endpoint(Twitch::ENDPOINT_GAME_INFORMATION)},Network::Method::GET,{
+		{"name",category}
+	},{
+		{NETWORK_HEADER_AUTHORIZATION,security.Bearer(security.OAuthToken())},
+		{NETWORK_HEADER_CLIENT_ID,security.ClientID()},
+		{Network::CONTENT_TYPE,Network::CONTENT_TYPE_JSON},
+	});
 
-		const QJsonArray details=jsonFieldData->toArray();
-		if (details.size() < 1)
-		{
-			emit Print(QString(TWITCH_API_ERROR_TEMPLATE_INCOMPLETE).arg(TWITCH_API_OPERATION_STREAM_CATEGORY));
-			return;
-		}
+	QString categoryID;
+	try
+	{
+		categoryID=Twitch::Helix::First<Twitch::Helix::Game>(lookup.body).id;
+	}
 
-		const QJsonObject fields=details.at(0).toObject();
-		auto jsonFieldID=fields.find("id");
-		if (jsonFieldID == fields.end())
-		{
-			emit Print(QString(TWITCH_API_ERROR_TEMPLATE_INCOMPLETE).arg(TWITCH_API_OPERATION_STREAM_CATEGORY));
-			return;
-		}
+	catch (const JSON::Error &exception)
+	{
+		emit Print(QString(TWITCH_API_ERROR_TEMPLATE_JSON_PARSE).arg(TWITCH_API_OPERATION_STREAM_CATEGORY,exception.what()));
+		co_return;
+	}
 
-		const QString categoryID=jsonFieldID->toString();
-		Network::Request::Send({Twitch::Endpoint(Twitch::ENDPOINT_CHANNEL_INFORMATION)},Network::Method::PATCH,[this,category,categoryID](QNetworkReply *reply) {
-			if (reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() != 204)
-			{
-				emit Print("Failed to change stream category");
-				return;
-			}
-			emit Print(QString(R"(Stream category changed to "%1")").arg(category));
-		},{
-			{QUERY_PARAMETER_BROADCASTER_ID,security.AdministratorID()}
-		},{
-			{NETWORK_HEADER_AUTHORIZATION,security.Bearer(security.OAuthToken())},
-			{NETWORK_HEADER_CLIENT_ID,security.ClientID()},
-			{Network::CONTENT_TYPE,Network::CONTENT_TYPE_JSON},
-		},
-		{
-			QJsonDocument(QJsonObject({{"game_id",categoryID}})).toJson(QJsonDocument::Compact)
-		});
-	},{
-		{"name",category}
+	const Network::Reply update=co_await Network::Request::Await({Twitch::Endpoint(Twitch::ENDPOINT_CHANNEL_INFORMATION)},Network::Method::PATCH,{
+		{QUERY_PARAMETER_BROADCASTER_ID,security.AdministratorID()}
 	},{
 		{NETWORK_HEADER_AUTHORIZATION,security.Bearer(security.OAuthToken())},
 		{NETWORK_HEADER_CLIENT_ID,security.ClientID()},
 		{Network::CONTENT_TYPE,Network::CONTENT_TYPE_JSON},
-	});
+	},QJsonDocument(QJsonObject({{"game_id",categoryID}})).toJson(QJsonDocument::Compact));
+	if (update.status != 204)
+	{
+		emit Print("Failed to change stream category");
+		co_return;
+	}
+	emit Print(QString(R"(Stream category changed to "%1")").arg(category));
 }
 
 std::optional<CommandType> Bot::ValidCommandType(const QString &type)
@@ -12,6 +12,7 @@
 #include "entities.h"
 #include "settings.h"
 #include "security.h"
+#include "network.h"
 
 enum class NativeCommandFlag
 {
@@ -23,6 +24,7 @@ enum class NativeCommandFlag
 	HTML,
 	LIMIT,
 	PANIC,
+	REQUEST,
 	SHOUTOUT,
 	SONG,
 	TIMEZONE,
@@ -45,6 +47,7 @@ public:
 	void EmoteOnly(bool enable);
 	void SaveViewerAttributes(bool reset);
 	const Command::Lookup& Commands() const;
+	const NativeCommandFlagLookup& NativeCommandFlags() const;
 	const Command::Lookup& DeserializeCommands(const QJsonDocument &json);
 	QJsonDocument LoadDynamicCommands();
 	File::List DeserializeVibePlaylist(const QJsonDocument &json);
@@ -87,6 +90,7 @@ protected:
 	ApplicationSetting settingDeniedCommandVideo;
 	ApplicationSetting settingCommandCooldown;
 	ApplicationSetting settingUptimeHistory;
+	ApplicationSetting settingSongRequestLimit;
 	ApplicationSetting settingCommandNameAgenda;
 	ApplicationSetting settingCommandNameStreamCategory;
 	ApplicationSetting settingCommandNameStreamTitle;
@@ -96,6 +100,7 @@ protected:
 	ApplicationSetting settingCommandNameHTML;
 	ApplicationSetting settingCommandNameLimit;
 	ApplicationSetting settingCommandNamePanic;
+	ApplicationSetting settingCommandNameSongRequest;
 	ApplicationSetting settingCommandNameShoutout;
 	ApplicationSetting settingCommandNameSong;
 	ApplicationSetting settingCommandNameTimezone;
@@ -110,7 +115,9 @@ protected:
 	void StageRedemptionCommand(const QString &name,const QJsonObject &jsonObject);
 	bool LoadViewerAttributes();
 	void LoadRoasts();
-	void LoadBadgeIconURLs();
+	Async::Task<void> LoadBadgeIconURLs();
+	Async::Task<void> PrefetchEmotes();
+	void StoreBadgeIconURLs(const Network::Reply &reply);
 	void StartClocks();
 	std::optional<CommandType> ValidCommandType(const QString &type);
 	int ParseEmoteNamesAndDownloadImages(std::vector<Chat::Emote> &emotes,const QStringView &textWindow);
@@ -131,13 +138,17 @@ protected:
 	void ToggleLimitViewer(const QString &target);
 	void ToggleVibeKeeper();
 	void AdjustVibeVolume(Command command);
+	void DispatchSongRequest(const Viewer::Local &viewer,const QString &query);
 	void StreamTitle(const QString &title);
 	void StreamCategory(const QString &category);
+	Async::Task<void> PerformShoutout(QString streamer);
+	Async::Task<void> AnnounceCurrentSong(Music::Metadata metadata);
+	Async::Task<bool> RequestShoutout(QString streamerID);
+	Async::Task<void> ChangeStreamCategory(QString category);
 signals:
 	void Print(const QString &message,const QString operation=QString(),const QString subsystem=QString("bot core"));
 	void ChatMessage(std::shared_ptr<Chat::Message> message);
 	void DeleteChatMessage(const QString &id);
-	void RefreshChat();
 	void AnnounceArrival(const QString &name,std::shared_ptr<QImage> profileImage,const QString &audioPath);
 	void PlayVideo(const QString &path);
 	void PlayAudio(const QString &name,const QString &message,const QString &path);
@@ -156,10 +167,12 @@ signals:
 	void ShowPortraitVideo(const QString &path);
 	void AnnounceRedemption(const QString &name,const QString &rewardTitle,const QString &message);
 	void AnnounceSubscription(const QString &name,const QString &audioPath);
+	void AnnounceGiftSubscription(const QString &gifter,const unsigned int count,const QString &audioPath);
 	void AnnounceRaid(const QString &viewer,const unsigned int viewers,const QString &audioPath);
 	void AnnounceCheer(const QString &viewer,const unsigned int count,const QString &message,const QString &videoPath);
 	void AnnounceTextWall(const QString &message,const QString &audioPath);
 	void AnnounceDeniedCommand(const QString &videoPath);
+	void AnnounceSongRequest(const QString &name,const QString &song,const QString &artist);
 	void Welcomed(const QString &user);
 public slots:
 	void ParseChatMessage(const QString &prefix,const QString &source,const QStringList &parameters,const QString &message);
@@ -167,6 +180,7 @@ public slots:
 	void DispatchCommandViaSubsystem(JSON::SignalPayload *response,const QString &name,const QString &login);
 	void Ping();
 	void Subscription(const QString &login,const QString &displayName);
+	void GiftSubscription(const QString &gifter,const unsigned int count);
 	void Redemption(const QString &login,const QString &name,const QString &rewardTitle,const QString &message);
 	void Raid(const QString &viewer,const unsigned int viewers);
 	void Cheer(const QString &viewer,const unsigned int count,const QString &message);
@@ -0,0 +1,366 @@
+#include <QSaveFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QCryptographicHash>
+#include <algorithm>
+#include <cstring>
+#include "cache.h"
+#include "globals.h"
+
+const char *SETTINGS_CATEGORY_CACHE="Cache";
+const char *CACHE_DIRECTORY="cache";
+const char *CACHE_BLOB_DIRECTORY="blobs";
+const char *CACHE_INDEX_FILENAME="index";
+const quint32 CACHE_INDEX_MAGIC=0x43454c41; // "CELA"
+const quint32 CACHE_INDEX_VERSION=1;
+const quint32 CACHE_INDEX_INITIAL_CAPACITY=1024;
+
+namespace Cache
+{
+	Assets::Assets(QObject *parent) : QObject(parent),
+		directory(Filesystem::DataPath().filePath(CACHE_DIRECTORY)),
+		blobs(directory.filePath(CACHE_BLOB_DIRECTORY)),
+		index(directory.filePath(CACHE_INDEX_FILENAME)),
+		header(nullptr),
+		entries(nullptr),
+		total(0),
+		settingSizeLimit(SETTINGS_CATEGORY_CACHE,"SizeLimit",256) // megabytes
+	{
+	}
+
+	Assets& Assets::Shared()
+	{
+		static Assets assets;
+		return assets;
+	}
+
+	QUrl Assets::URL(const QString &key)
+	{
+		QUrl url;
+		url.setScheme(SCHEME_ASSET);
+		url.setPath(key);
+		return url;
+	}
+
+	bool Assets::Open()
+	{
+		static const char *OPERATION="open";
+
+		if (!blobs.mkpath(blobs.absolutePath()))
+		{
+			emit Print(QString("Failed to create directory %1").arg(blobs.absolutePath()),OPERATION);
+			return false;
+		}
+
+		if (!index.open(QIODevice::ReadWrite))
+		{
+			emit Print(QString("Failed to open index %1: %2").arg(index.fileName(),index.errorString()),OPERATION);
+			return false;
+		}
+
+		if (!Map()) return false;
+		Validate();
+		emit Print(QString("%1 entries, %2 KB").arg(QString::number(lookup.size()),QString::number(total/1024)),OPERATION);
+		return true;
+	}
+
+	bool Assets::Map()
+	{
+		static const char *OPERATION="map index";
+
+		if (index.size() < static_cast<qint64>(sizeof(Header)) && !Reset()) return false;
+
+		uchar *mapping=index.map(0,index.size());
+		if (!mapping)
+		{
+			emit Print(QString("Failed to map index: %1").arg(index.errorString()),OPERATION);
+			return false;
+		}
+		header=reinterpret_cast<Header*>(mapping);
+		entries=reinterpret_cast<Slot*>(mapping+sizeof(Header));
+
+		if (header->magic != CACHE_INDEX_MAGIC || header->version != CACHE_INDEX_VERSION || index.size() != static_cast<qint64>(sizeof(Header)+header->capacity*sizeof(Slot)))
+		{
+			emit Print("Index is damaged or from an older version, starting over",OPERATION);
+			index.unmap(mapping);
+			header=nullptr;
+			entries=nullptr;
+			if (!Reset()) return false;
+			return Map();
+		}
+
+		return true;
+	}
+
+	bool Assets::Reset()
+	{
+		static const char *OPERATION="reset index";
+
+		Header fresh={
+			.magic=CACHE_INDEX_MAGIC,
+			.version=CACHE_INDEX_VERSION,
+			.capacity=CACHE_INDEX_INITIAL_CAPACITY,
+			.reserved=0
+		};
+		// resizing fills the slots with zeroes, which marks all of them vacant
+		if (!index.resize(0) || !index.resize(sizeof(Header)+fresh.capacity*sizeof(Slot)) || !index.seek(0) || index.write(reinterpret_cast<const char*>(&fresh),sizeof(Header)) != sizeof(Header) || !index.flush())
+		{
+			emit Print(QString("Failed to reset index: %1").arg(index.errorString()),OPERATION);
+			return false;
+		}
+		return true;
+	}
+
+	bool Assets::Grow()
+	{
+		static const char *OPERATION="grow index";
+
+		const quint32 capacity=header->capacity;
+		index.unmap(reinterpret_cast<uchar*>(header));
+		header=nullptr;
+		entries=nullptr;
+		if (!index.resize(sizeof(Header)+capacity*2*sizeof(Slot)))
+		{
+			emit Print(QString("Failed to grow index: %1").arg(index.errorString()),OPERATION);
+			Recover();
+			return false;
+		}
+
+		uchar *mapping=index.map(0,index.size());
+		if (!mapping)
+		{
+			emit Print(QString("Failed to map index: %1").arg(index.errorString()),OPERATION);
+			index.resize(sizeof(Header)+capacity*sizeof(Slot)); // back to the size the header describes, so it maps as it was
+			Recover();
+			return false;
+		}
+		header=reinterpret_cast<Header*>(mapping);
+		entries=reinterpret_cast<Slot*>(mapping+sizeof(Header));
+		header->capacity=capacity*2;
+		for (quint32 slot=header->capacity; slot > capacity; slot--) vacancies.push_back(slot-1);
+		return true;
+	}
+
+	void Assets::Recover()
+	{
+		static const char *OPERATION="recover index";
+
+		// mapping again may have started the index over, so what's in memory has to be rebuilt from it either way
+		if (Map())
+		{
+			Validate();
+			return;
+		}
+
+		emit Print("Index is unavailable, nothing will be cached until restart",OPERATION);
+		lookup.clear();
+		references.clear();
+		vacancies.clear();
+		total=0;
+	}
+
+	void Assets::Validate()
+	{
+		static const char *OPERATION="validate";
+
+		lookup.clear();
+		references.clear();
+		vacancies.clear();
+		total=0;
+
+		// this is the only place the cache touches the filesystem for entries it already knows about
+		int dropped=0;
+		for (quint32 slot=header->capacity; slot > 0; slot--)
+		{
+			Slot &entry=entries[slot-1];
+			if (entry.key)
+			{
+				const QString name=BlobName(entry);
+				QFileInfo blob(blobs.filePath(name));
+				if (blob.exists() && blob.size() == entry.size && !lookup.contains(entry.key))
+				{
+					lookup[entry.key]=slot-1;
+					if (references[name]++ == 0) total+=entry.size;
+					continue;
+				}
+				std::memset(&entry,0,sizeof(Slot));
+				dropped++;
+			}
+			vacancies.push_back(slot-1);
+		}
+		if (dropped > 0) emit Print(QString("Dropped %1 entries with missing or damaged files").arg(dropped),OPERATION);
+
+		int orphans=0;
+		for (const QString &name : blobs.entryList(QDir::Files|QDir::Hidden))
+		{
+			if (references.contains(name)) continue;
+			if (blobs.remove(name)) orphans++;
+		}
+		if (orphans > 0) emit Print(QString("Removed %1 files not in the index").arg(orphans),OPERATION);
+
+		Evict(header->capacity);
+	}
+
+	bool Assets::Contains(const QString &key) const
+	{
+		return lookup.contains(Hash(key));
+	}
+
+	std::optional<QString> Assets::Path(const QString &key)
+	{
+		if (!entries) return std::nullopt;
+		auto candidate=lookup.find(Hash(key));
+		if (candidate == lookup.end()) return std::nullopt;
+		Slot &entry=entries[candidate->second];
+		entry.used=QDateTime::currentMSecsSinceEpoch();
+		return blobs.filePath(BlobName(entry));
+	}
+
+	QImage Assets::Image(const QString &key)
+	{
+		std::optional<QString> path=Path(key);
+		if (!path) return {};
+		return QImage(*path);
+	}
+
+	std::optional<QString> Assets::Store(const QString &key,const QByteArray &data)
+	{
+		static const char *OPERATION="store";
+
+		if (!entries) return std::nullopt;
+
+		const QByteArray digest=QCryptographicHash::hash(data,QCryptographicHash::Sha1);
+		const QString name=QString::fromLatin1(digest.toHex());
+		const QString path=blobs.filePath(name);
+		if (!references.contains(name))
+		{
+			QSaveFile file(path);
+			if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size() || !file.commit())
+			{
+				emit Print(QString("Failed to write %1 for %2: %3").arg(path,key,file.errorString()),OPERATION);
+				return std::nullopt;
+			}
+		}
+
+		const quint64 hash=Hash(key);
+		if (auto existing=lookup.find(hash); existing != lookup.end())
+		{
+			if (BlobName(entries[existing->second]) == name)
+			{
+				entries[existing->second].used=QDateTime::currentMSecsSinceEpoch();
+				return path;
+			}
+			Release(existing->second);
+		}
+		if (vacancies.empty() && !Grow()) return std::nullopt;
+
+		const quint32 slot=vacancies.back();
+		vacancies.pop_back();
+		Slot &entry=entries[slot];
+		entry.key=hash;
+		std::copy(digest.begin(),digest.end(),entry.content.begin());
+		entry.size=static_cast<quint32>(data.size());
+		entry.used=QDateTime::currentMSecsSinceEpoch();
+		lookup[hash]=slot;
+		if (references[name]++ == 0) total+=data.size();
+
+		Evict(slot);
+		return path;
+	}
+
+	void Assets::Fetch(const QString &key,const QUrl &url,Network::Priority priority,Waiter waiter)
+	{
+		if (std::optional<QString> path=Path(key); path)
+		{
+			if (waiter) waiter(path);
+			return;
+		}
+
+		auto [candidate,idle]=pending.try_emplace(key);
+		if (waiter) candidate->second.push_back(std::move(waiter));
+		if (!idle) return; // already on its way
+
+		Network::Request::Send(url,Network::Method::GET,[this,key,url](QNetworkReply *reply) {
+			std::optional<QString> path;
+			if (reply->error())
+				emit Print(QString("Failed to download %1: %2").arg(url.toString(),reply->errorString()),"fetch");
+			else
+				path=Store(key,reply->readAll());
+
+			// take the waiters out first, since one of them may ask for the same key again
+			std::vector<Waiter> waiters;
+			if (auto candidate=pending.find(key); candidate != pending.end())
+			{
+				waiters=std::move(candidate->second);
+				pending.erase(candidate);
+			}
+			if (path)
+				emit Fetched(key);
+			else
+				emit Failed(key);
+			for (const Waiter &waiter : waiters) waiter(path);
+		},{},{},{},priority);
+	}
+
+	void Assets::Release(quint32 slot)
+	{
+		Slot &entry=entries[slot];
+		const QString name=BlobName(entry);
+		lookup.erase(entry.key);
+		if (auto reference=references.find(name); reference != references.end() && --reference->second == 0)
+		{
+			references.erase(reference);
+			total-=entry.size;
+			blobs.remove(name);
+		}
+		std::memset(&entry,0,sizeof(Slot));
+		vacancies.push_back(slot);
+	}
+
+	void Assets::Evict(quint32 keep)
+	{
+		const qint64 limit=static_cast<qint64>(settingSizeLimit)*1024*1024;
+		if (total <= limit) return;
+
+		std::vector<quint32> occupied;
+		occupied.reserve(lookup.size());
+		for (const auto &[key,slot] : lookup)
+		{
+			if (slot != keep) occupied.push_back(slot);
+		}
+		std::sort(occupied.begin(),occupied.end(),[this](quint32 left,quint32 right) {
+			return entries[left].used < entries[right].used;
+		});
+
+		int evicted=0;
+		for (quint32 slot : occupied)
+		{
+			if (total <= limit) break;
+			Release(slot);
+			evicted++;
+		}
+		emit Print(QString("Evicted %1 entries, %2 KB remaining").arg(QString::number(evicted),QString::number(total/1024)),"evict");
+	}
+
+	QString Assets::BlobName(const Slot &slot) const
+	{
+		return QString::fromLatin1(QByteArray(slot.content.data(),slot.content.size()).toHex());
+	}
+
+	quint64 Assets::Hash(const QString &key)
+	{
+		// FNV-1a, because the index outlives the process and qHash() is seeded per run
+		quint64 hash=14695981039346656037ull;
+		for (QChar character : key)
+		{
+			hash^=character.unicode();
+			hash*=1099511628211ull;
+		}
+		return hash ? hash : 1;
+	}
+
+	ApplicationSetting& Assets::SizeLimit()
+	{
+		return settingSizeLimit;
+	}
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <QObject>
+#include <QFile>
+#include <QDir>
+#include <QUrl>
+#include <QImage>
+#include <unordered_map>
+#include <optional>
+#include <vector>
+#include <array>
+#include <functional>
+#include "settings.h"
+#include "network.h"
+
+namespace Cache
+{
+	inline const char *SCHEME_ASSET="asset";
+	inline const char *KEY_EMOTE="emote/v2/%1";
+	inline const char *KEY_BADGE="badge/%1";
+	inline const char *KEY_PROFILE_IMAGE="profile/%1";
+	inline const char *KEY_COVER="cover/%1";
+
+	/*!
+	 * \brief Persistent store for downloaded images, shared by every image consumer
+	 *
+	 * Blobs are named by the SHA-1 of their content, so the same image stored
+	 * under several keys only takes up space once. The index that maps keys to
+	 * blobs is a memory-mapped file, which keeps lookups and recency updates off
+	 * the filesystem. Entries are checked against their blobs when the cache is
+	 * opened and the least recently used ones are evicted once the total size
+	 * passes the configured limit. Downloads are tracked by key while they are in
+	 * flight, so asking for the same asset again only adds a waiter.
+	 */
+	class Assets : public QObject
+	{
+		Q_OBJECT
+	public:
+		using Waiter=std::function<void(const std::optional<QString> &path)>;
+		Assets(QObject *parent=nullptr);
+		bool Open();
+		bool Contains(const QString &key) const;
+		std::optional<QString> Path(const QString &key);
+		std::optional<QString> Store(const QString &key,const QByteArray &data);
+		void Fetch(const QString &key,const QUrl &url,Network::Priority priority=Network::Priority::NORMAL,Waiter waiter=nullptr);
+		QImage Image(const QString &key);
+		ApplicationSetting& SizeLimit();
+		static QUrl URL(const QString &key);
+		static Assets& Shared();
+	protected:
+		struct Header
+		{
+			quint32 magic;
+			quint32 version;
+			quint32 capacity;
+			quint32 reserved;
+		};
+		struct Slot
+		{
+			quint64 key; // 0 marks a vacant slot
+			std::array<char,20> content;
+			quint32 size;
+			qint64 used;
+		};
+		QDir directory;
+		QDir blobs;
+		QFile index;
+		Header *header;
+		Slot *entries;
+		std::unordered_map<quint64,quint32> lookup;
+		std::unordered_map<QString,int> references;
+		std::vector<quint32> vacancies;
+		std::unordered_map<QString,std::vector<Waiter>> pending;
+		qint64 total;
+		ApplicationSetting settingSizeLimit;
+		bool Map();
+		bool Reset();
+		bool Grow();
+		void Recover();
+		void Validate();
+		void Release(quint32 slot);
+		void Evict(quint32 keep);
+		QString BlobName(const Slot &slot) const;
+		static quint64 Hash(const QString &key);
+	signals:
+		void Print(const QString &message,const QString operation=QString(),const QString subsystem=QString("asset cache"));
+		void Fetched(const QString &key);
+		void Failed(const QString &key);
+	};
+}
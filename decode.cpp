@@ -0,0 +1,85 @@
+#include <QBuffer>
+#include <QElapsedTimer>
+#include <QGuiApplication>
+#include <QScreen>
+#include <QThread>
+#include "decode.h"
+
+namespace Decode
+{
+	Pool::Pool(QObject *parent) : QObject(parent)
+	{
+		// leave a core for the GUI thread
+		workers.setMaxThreadCount(std::max(1,QThread::idealThreadCount()-1));
+		workers.setThreadPriority(QThread::LowPriority);
+	}
+
+	Async::Task<QImage> Pool::File(QString path,QSize bound)
+	{
+		co_return co_await Run([path,bound]() {
+			QImageReader reader(path);
+			return Read(reader,bound);
+		});
+	}
+
+	Async::Task<QImage> Pool::Data(QByteArray data,QSize bound)
+	{
+		co_return co_await Run([data,bound]() {
+			QBuffer buffer;
+			buffer.setData(data);
+			QImageReader reader(&buffer);
+			return Read(reader,bound);
+		});
+	}
+
+	Async::Task<QImage> Pool::Scale(QImage image,QSize size)
+	{
+		co_return co_await Run([image,size]() {
+			return image.scaled(size,Qt::IgnoreAspectRatio,Qt::SmoothTransformation).convertToFormat(QImage::Format_ARGB32_Premultiplied);
+		});
+	}
+
+	Async::Task<QImage> Pool::Run(std::function<QImage()> job)
+	{
+		co_return co_await Async::Operation<QImage>([this,job](std::function<void(QImage)> resume) {
+			workers.start([this,job,resume]() {
+				QElapsedTimer timer;
+				timer.start();
+				QImage image=job();
+				const qint64 elapsed=timer.nsecsElapsed()/1000;
+				QMetaObject::invokeMethod(this,[this,image,elapsed,resume]() {
+					emit Decoded(elapsed,image.size());
+					resume(image);
+				},Qt::QueuedConnection);
+			});
+		});
+	}
+
+	QImage Pool::Read(QImageReader &reader,const QSize &bound)
+	{
+		const QSize size=reader.size();
+		if (size.isValid() && bound.isValid() && (size.width() > bound.width() || size.height() > bound.height())) reader.setScaledSize(size.scaled(bound,Qt::KeepAspectRatio));
+		QImage image=reader.read();
+		if (image.isNull()) return image;
+
+		// not every format knows how to scale while it decodes, and some don't know their size up front
+		if (bound.isValid() && (image.width() > bound.width() || image.height() > bound.height())) image=image.scaled(bound,Qt::KeepAspectRatio,Qt::SmoothTransformation);
+		return image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+	}
+
+	QSize Pool::ScreenBound()
+	{
+		// nothing is ever shown larger than the screen, so there's no point decoding more than that
+		const QScreen *screen=QGuiApplication::primaryScreen();
+		if (!screen) return {};
+		const QSize size=screen->size()*screen->devicePixelRatio();
+		const int side=std::max(size.width(),size.height());
+		return {side,side};
+	}
+
+	Pool& Pool::Shared()
+	{
+		static Pool pool;
+		return pool;
+	}
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <QObject>
+#include <QImage>
+#include <QImageReader>
+#include <QThreadPool>
+#include <functional>
+#include "async.h"
+
+namespace Decode
+{
+	/*!
+	 * \brief Decodes images on a pool of worker threads so the event loop never waits on one
+	 *
+	 * Images are decoded straight to the size they'll be shown at with
+	 * QImageReader::setScaledSize, which lets formats like JPEG skip most of
+	 * the work and keeps the full resolution image out of memory entirely.
+	 * Results are handed back on the GUI thread already in a format that
+	 * paints without another conversion.
+	 */
+	class Pool : public QObject
+	{
+		Q_OBJECT
+	public:
+		Pool(QObject *parent=nullptr);
+		Async::Task<QImage> File(QString path,QSize bound);
+		Async::Task<QImage> Data(QByteArray data,QSize bound);
+		Async::Task<QImage> Scale(QImage image,QSize size);
+		Async::Task<QImage> Run(std::function<QImage()> job);
+		static QImage Read(QImageReader &reader,const QSize &bound);
+		static QSize ScreenBound();
+		static Pool& Shared();
+	protected:
+		QThreadPool workers;
+	signals:
+		void Decoded(qint64 microseconds,const QSize &size);
+	};
+}
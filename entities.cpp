@@ -2,12 +2,21 @@
 #include <QDir>
 #include <QJsonDocument>
 #include <QJsonArray>
+#include <QBuffer>
+#include <QImageReader>
+#include <QStringDecoder>
+#include <QtEndian>
 #include <algorithm>
 #include <cstring>
+#include <cmath>
+#include <numbers>
 #include "entities.h"
 #include "globals.h"
 #include "network.h"
 #include "twitch.h"
+#include "cache.h"
+#include "decode.h"
+#include "library.h"
 
 Q_DECLARE_METATYPE(std::chrono::milliseconds)
 
@@ -120,17 +129,41 @@ namespace Music
 	Player::Player(bool loop,int initialVolume,QObject *parent) : QObject(parent),
 		player(this),
 		output(this),
+		upcomingPlayer(this),
+		upcomingOutput(this),
+		current(&player),
+		upcoming(&upcomingPlayer),
 		loop(loop),
+		level(0),
+		fade(1),
 		settingSuppressedVolume("Volume","SuppressedLevel",10),
-		volumeAdjustment(&output,"volume")
+		settingCrossfade("Volume","Crossfade",0), // in milliseconds, 0 switches songs the moment one ends
+		settingNormalize("Volume","Normalize",true),
+		settingLoudnessTarget("Volume","LoudnessTarget",-18), // LUFS, the ReplayGain 2.0 reference level
+		volumeAdjustment(this,"level")
 	{
 		player.setAudioOutput(&output);
-		player.audioOutput()->setVolume(TranslateVolume(initialVolume));
+		upcomingPlayer.setAudioOutput(&upcomingOutput);
+		Level(TranslateVolume(initialVolume));
 
-		connect(&player,&QMediaPlayer::errorOccurred,this,&Player::MediaError);
-		connect(&player,&QMediaPlayer::playbackStateChanged,this,&Player::StateChanged);
-		connect(&player,&QMediaPlayer::mediaStatusChanged,this,&Player::MediaStatusChanged);
+		for (QMediaPlayer *deck : {&player,&upcomingPlayer})
+		{
+			connect(deck,&QMediaPlayer::errorOccurred,this,&Player::MediaError);
+			connect(deck,&QMediaPlayer::playbackStateChanged,this,&Player::StateChanged);
+			connect(deck,&QMediaPlayer::mediaStatusChanged,this,&Player::MediaStatusChanged);
+			connect(deck,&QMediaPlayer::positionChanged,this,&Player::PositionChanged);
+			connect(deck,&QMediaPlayer::sourceChanged,this,[this,deck](const QUrl &source) {
+				gains[deck]=Gain(source);
+				Mix();
+			});
+			gains[deck]=1;
+		}
 		connect(&volumeAdjustment,&QPropertyAnimation::finished,this,&Player::VolumeMuted);
+		connect(&crossfade,&QVariantAnimation::valueChanged,this,[this](const QVariant &value) {
+			fade=value.toReal();
+			Mix();
+		});
+		connect(&crossfade,&QVariantAnimation::finished,this,&Player::Crossfaded);
 	}
 
 	void Player::Start(QUrl source)
@@ -141,7 +174,7 @@ namespace Music
 
 	void Player::Start()
 	{
-		if (!Empty()) player.play();
+		if (!Empty()) current->play();
 	}
 
 	bool Player::Empty()
@@ -156,35 +189,67 @@ namespace Music
 
 	void Player::Stop()
 	{
-		player.pause();
+		if (crossfade.state() == QAbstractAnimation::Running)
+		{
+			crossfade.stop();
+			Crossfaded();
+		}
+		current->pause();
 	}
 
 	bool Player::Playing() const
 	{
-		return player.playbackState() == QMediaPlayer::PlayingState;
+		return current->playbackState() == QMediaPlayer::PlayingState;
+	}
+
+	qreal Player::Level() const
+	{
+		return level;
+	}
+
+	void Player::Level(qreal level)
+	{
+		this->level=level;
+		Mix();
+	}
+
+	void Player::Mix()
+	{
+		// equal power, so the overall loudness doesn't dip in the middle of a crossfade
+		current->audioOutput()->setVolume(level*gains[current]*std::sin(fade*std::numbers::pi/2));
+		upcoming->audioOutput()->setVolume(level*gains[upcoming]*std::cos(fade*std::numbers::pi/2));
+	}
+
+	qreal Player::Gain(const QUrl &source)
+	{
+		// the output can't go past full volume, so songs quieter than the target are left alone rather than boosted
+		if (!settingNormalize || source.isEmpty()) return 1;
+		const std::optional<double> loudness=Library::Shared().Loudness(source.toLocalFile());
+		if (!loudness) return 1;
+		return std::min(1.0,std::pow(10.0,(static_cast<qreal>(settingLoudnessTarget)-*loudness)/20));
 	}
 
 	void Player::DuckVolume(bool duck)
 	{
-		if (TranslateVolume(player.audioOutput()->volume()) < static_cast<int>(settingSuppressedVolume)) return;
+		if (TranslateVolume(level) < static_cast<int>(settingSuppressedVolume)) return;
 
 		if (duck)
 		{
 			if (volumeAdjustment.state() == QAbstractAnimation::Running) volumeAdjustment.pause();
-			volumeAdjustment.setStartValue(player.audioOutput()->volume());
-			player.audioOutput()->setVolume(TranslateVolume(static_cast<int>(settingSuppressedVolume)));
+			volumeAdjustment.setStartValue(level);
+			Level(TranslateVolume(static_cast<int>(settingSuppressedVolume)));
 		}
 		else
 		{
 			qreal originalVolume=volumeAdjustment.startValue().toFloat();
-			if (player.audioOutput()->volume() < originalVolume) player.audioOutput()->setVolume(originalVolume);
+			if (level < originalVolume) Level(originalVolume);
 			if (volumeAdjustment.state() == QAbstractAnimation::Paused) volumeAdjustment.resume();
 		}
 	}
 
 	void Player::Volume(int volume)
 	{
-		player.audioOutput()->setVolume(TranslateVolume(volume));
+		Level(TranslateVolume(volume));
 	}
 
 	void Player::Volume(int targetVolume,std::chrono::seconds duration)
@@ -192,24 +257,29 @@ namespace Music
 		if (volumeAdjustment.state() == QAbstractAnimation::Paused) return;
 
 		emit Print(QString("Adjusting volume from %1% to %2% over %3 seconds").arg(
-			StringConvert::Integer(TranslateVolume(player.audioOutput()->volume())),
+			StringConvert::Integer(TranslateVolume(level)),
 			StringConvert::Integer(targetVolume),
 			StringConvert::Integer(duration.count())
 		),"volume fade");
 
 		if (volumeAdjustment.state() == QAbstractAnimation::Running) volumeAdjustment.stop();
 		volumeAdjustment.setDuration(TimeConvert::Milliseconds(duration).count());
-		volumeAdjustment.setStartValue(player.audioOutput()->volume());
+		volumeAdjustment.setStartValue(level);
 		volumeAdjustment.setEndValue(TranslateVolume(targetVolume));
 		volumeAdjustment.start();
 	}
 
 	void Player::VolumeMuted()
 	{
-		if (player.audioOutput()->volume() == 0.0f)
+		if (level == 0.0)
 		{
 			emit Print(QString("Silencing vibe player"));
-			player.stop();
+			if (crossfade.state() == QAbstractAnimation::Running)
+			{
+				crossfade.stop();
+				Crossfaded();
+			}
+			current->stop();
 		}
 	}
 
@@ -217,18 +287,7 @@ namespace Music
 	{
 		try
 		{
-			ID3::Tag tag(Filename());
-			auto title=tag.Title();
-			auto album=tag.AlbumTitle();
-			auto artist=tag.Artist();
-			auto cover=tag.AlbumCoverFront();
-			return {
-				.title=title ? *title : QString{},
-				.album=album ? *album : QString{},
-				.artist=artist ? *artist : QString{},
-				.cover=cover ? *cover : QImage{},
-				.valid=true
-			};
+			return MetadataCache::Shared().Read(Filename());
 		}
 
 		catch (const std::runtime_error &exception)
@@ -241,12 +300,16 @@ namespace Music
 
 	QString Player::Filename() const
 	{
-		return player.source().toLocalFile();
+		return current->source().toLocalFile();
 	}
 
 	void Player::Sources(const File::List &sources)
 	{
-		player.stop();
+		crossfade.stop();
+		fade=1;
+		current->stop();
+		Release(upcoming);
+		bumped.clear();
 		this->sources=sources;
 		Next();
 	}
@@ -256,20 +319,61 @@ namespace Music
 		return sources;
 	}
 
+	void Player::Request(const QString &path,const QString &requester)
+	{
+		requests.emplace_back(path,requester);
+
+		// a song from the rotation that's only been queued makes way, so the request is next
+		if (crossfade.state() == QAbstractAnimation::Running) return;
+		if (!upcoming->source().isEmpty())
+		{
+			const QString queued=upcoming->source().toLocalFile();
+			if (std::any_of(requests.begin(),requests.end(),[&queued](const std::pair<QString,QString> &request) { return request.first == queued; })) return;
+			bumped=queued; // already taken from the rotation, so it would be skipped if it were just dropped
+			Release(upcoming);
+		}
+		if (Playing()) Queue();
+	}
+
+	bool Player::Requested(const QString &path) const
+	{
+		if (path == Filename()) return true;
+		return std::any_of(requests.begin(),requests.end(),[&path](const std::pair<QString,QString> &request) { return request.first == path; });
+	}
+
+	int Player::Requests(const QString &requester) const
+	{
+		return static_cast<int>(std::count_if(requests.begin(),requests.end(),[&requester](const std::pair<QString,QString> &request) { return request.second == requester; }));
+	}
+
+	QString Player::Upcoming()
+	{
+		if (!requests.empty()) return requests.front().first;
+		if (!bumped.isEmpty()) return std::exchange(bumped,QString());
+		return sources.Unique();
+	}
+
+	void Player::Dismiss(const QString &path)
+	{
+		if (auto request=std::find_if(requests.begin(),requests.end(),[&path](const std::pair<QString,QString> &request) { return request.first == path; }); request != requests.end()) requests.erase(request);
+	}
+
 	void Player::StateChanged(QMediaPlayer::PlaybackState state)
 	{
+		if (sender() != current) return;
+
 		switch (state)
 		{
 		case QMediaPlayer::PlayingState:
+			Dismiss(Filename());
+			Queue();
 			try
 			{
-				ID3::Tag tag(Filename());
-				auto title=tag.Title();
-				if (!title) break;
-				auto album=tag.AlbumTitle();
+				const struct Metadata metadata=MetadataCache::Shared().Read(Filename()); // also warms the cache for when someone asks what song this is
+				if (metadata.title.isEmpty()) break;
 				QString song{"Now playing "};
-				song.append(*title);
-				if (album) song.append(" by ").append(*album);
+				song.append(metadata.title);
+				if (!metadata.album.isEmpty()) song.append(" by ").append(metadata.album);
 				emit Print(song);
 			}
 
@@ -289,35 +393,126 @@ namespace Music
 
 	void Player::MediaStatusChanged(QMediaPlayer::MediaStatus status)
 	{
-		if (status == QMediaPlayer::EndOfMedia)
+		if (status != QMediaPlayer::EndOfMedia) return;
+
+		if (sender() == upcoming) // the outgoing song ran out before the crossfade finished
 		{
-			if (Next() && loop)
-			{
-				autoPlay=connect(&player,&QMediaPlayer::mediaStatusChanged,this,[this](QMediaPlayer::MediaStatus status) {
-					if (status == QMediaPlayer::LoadedMedia) Start();
-				});
-			}
+			if (crossfade.state() == QAbstractAnimation::Running) crossfade.setCurrentTime(crossfade.duration());
+			return;
+		}
+
+		if (loop && Loaded(upcoming))
+		{
+			Handover();
+			return;
+		}
+
+		// nothing was ready in time, so fall back to loading the next song on this deck
+		if (Next() && loop)
+		{
+			autoPlay=connect(current,&QMediaPlayer::mediaStatusChanged,this,[this](QMediaPlayer::MediaStatus status) {
+				if (status == QMediaPlayer::LoadedMedia)
+				{
+					disconnect(autoPlay);
+					Start();
+				}
+			});
 		}
 	}
 
 	void Player::MediaError(QMediaPlayer::Error error,const QString &errorString)
 	{
 		Q_UNUSED(error)
+		// a request that can't be played would otherwise stay at the front and be picked again every time
+		if (QMediaPlayer *deck=qobject_cast<QMediaPlayer*>(sender()); deck) Dismiss(deck->source().toLocalFile());
+		if (sender() == upcoming)
+		{
+			emit Print(QString{"Failed to load next song: %1"}.arg(errorString));
+			if (crossfade.state() != QAbstractAnimation::Running) Release(upcoming);
+			return;
+		}
 		disconnect(autoPlay);
 		emit Print(QString{"Failed to start: %1"}.arg(errorString));
 	}
 
+	void Player::PositionChanged(qint64 position)
+	{
+		if (sender() != current || !loop || crossfade.state() == QAbstractAnimation::Running) return;
+		const qint64 overlap=static_cast<qint64>(settingCrossfade);
+		if (overlap < 1 || !Loaded(upcoming) || current->duration() < overlap*2) return;
+		if (current->duration()-position <= overlap) Handover();
+	}
+
+	void Player::Queue()
+	{
+		// decks only swap at a handover, so the idle one is free until then
+		if (!loop || crossfade.state() == QAbstractAnimation::Running || !upcoming->source().isEmpty() || sources().isEmpty()) return;
+		try
+		{
+			upcoming->setSource(QUrl::fromLocalFile(Upcoming())); // opens and buffers it without blocking, well before it's needed
+		}
+
+		catch (const std::runtime_error &exception)
+		{
+			emit Print(QString{"Could not queue next song: %1"}.arg(exception.what()));
+		}
+	}
+
+	void Player::Handover()
+	{
+		disconnect(autoPlay);
+		std::swap(current,upcoming);
+		const qint64 overlap=static_cast<qint64>(settingCrossfade);
+		if (overlap > 0 && upcoming->playbackState() == QMediaPlayer::PlayingState)
+		{
+			fade=0;
+			Mix();
+			current->play();
+			crossfade.setDuration(static_cast<int>(overlap));
+			crossfade.setStartValue(0.0);
+			crossfade.setEndValue(1.0);
+			crossfade.start();
+			return;
+		}
+
+		fade=1;
+		Mix();
+		Release(upcoming); // before playing, so the next song gets queued as soon as this one starts
+		current->play();
+	}
+
+	void Player::Crossfaded()
+	{
+		fade=1;
+		Mix();
+		Release(upcoming);
+		if (current->playbackState() == QMediaPlayer::PlayingState) Queue();
+	}
+
+	void Player::Release(QMediaPlayer *deck)
+	{
+		deck->stop();
+		deck->setSource(QUrl());
+	}
+
+	bool Player::Loaded(const QMediaPlayer *deck) const
+	{
+		if (deck->source().isEmpty()) return false;
+		const QMediaPlayer::MediaStatus status=deck->mediaStatus();
+		return status == QMediaPlayer::LoadedMedia || status == QMediaPlayer::BufferedMedia;
+	}
+
 	bool Player::Next(QUrl source)
 	{
 		try
 		{
-			player.setSource(source.isEmpty() ? QUrl::fromLocalFile(sources.Unique()) : source);
+			current->setSource(source.isEmpty() ? QUrl::fromLocalFile(Upcoming()) : source);
 		}
 
 		catch (const std::runtime_error &exception)
 		{
 			emit Print(QString{"Could not queue next song: %1"}.arg(exception.what()));
-			player.stop();
+			current->stop();
 			return false;
 		}
 
@@ -345,65 +540,57 @@ namespace Music
 		return settingSuppressedVolume;
 	}
 
+	ApplicationSetting& Player::Crossfade()
+	{
+		return settingCrossfade;
+	}
+
+	ApplicationSetting& Player::Normalize()
+	{
+		return settingNormalize;
+	}
+
+	ApplicationSetting& Player::LoudnessTarget()
+	{
+		return settingLoudnessTarget;
+	}
+
 	namespace ID3
 	{
 		quint32 SyncSafe(const char *value)
 		{
-			quint32 result;
-			std::memcpy(&result,value,sizeof(quint32));
-			quint32 mask=0x7F000000;
-			quint8 out=0;
-			static_cast<void>(out); // silence spurious "unused variable" warnings
-			while (mask)
-			{
-				out >>= 1;
-				out |= result & mask;
-				mask >>= 8;
-			}
-			return result;
+			// 7 bits per byte, the high bit is always clear so the value can't be mistaken for an mpeg sync
+			return (static_cast<quint32>(value[0] & 0x7F) << 21)|(static_cast<quint32>(value[1] & 0x7F) << 14)|(static_cast<quint32>(value[2] & 0x7F) << 7)|static_cast<quint32>(value[3] & 0x7F);
 		}
 
-		Tag::Tag(const QString &filename) : APIC(nullptr)
+		quint32 BigEndian(const char *value)
 		{
-			static const std::unordered_map<QString,Frame::Frame> FRAMES={
-				{"APIC",Frame::Frame::APIC},
-				{"TIT2",Frame::Frame::TIT2},
-				{"TALB",Frame::Frame::TALB},
-				{"TPE1",Frame::Frame::TPE1}
-			};
+			return qFromBigEndian<quint32>(value);
+		}
 
+		Tag::Tag(const QString &filename)
+		{
 			try
 			{
 				file.setFileName(filename);
 				if (!file.open(QIODevice::ReadOnly)) throw std::runtime_error("Failed to open mp3 file");
-				Header header(file);
-				while (file.pos() < header.Size())
-				{
-					Frame::Header frameHeader(file);
-
-					auto headerID=FRAMES.find(frameHeader.ID());
-					if (headerID == FRAMES.end())
-					{
-						file.skip(frameHeader.Size());
-						continue;
-					}
+				const QByteArray prefix=file.read(Header::LENGTH);
+				const quint32 size=Header(prefix).Size();
+				if (size > file.size()) throw std::runtime_error("Tag is larger than the mp3 file");
 
-					switch (headerID->second)
-					{
-					case Frame::Frame::APIC:
-						APIC=std::make_unique<Frame::APIC>(file,frameHeader.Size());
-						break;
-					case Frame::Frame::TIT2:
-						TIT2=std::make_unique<Frame::TIT2>(file,frameHeader.Size());
-						break;
-					case Frame::Frame::TALB:
-						TALB=std::make_unique<Frame::TALB>(file,frameHeader.Size());
-						break;
-					case Frame::Frame::TPE1:
-						TPE1=std::make_unique<Frame::TPE1>(file,frameHeader.Size());
-						break;
-					}
+				// only the tag is mapped, the audio after it is never read
+				if (const uchar *mapped=file.map(0,size); mapped)
+				{
+					tag=QByteArrayView(reinterpret_cast<const char*>(mapped),size);
 				}
+				else
+				{
+					file.seek(0);
+					buffer=file.read(size);
+					if (buffer.size() < size) throw std::runtime_error("Failed to read tag from mp3 file");
+					tag=buffer;
+				}
+				Index();
 			}
 
 			catch (const std::runtime_error &exception)
@@ -419,126 +606,220 @@ namespace Music
 			Destroy();
 		}
 
+		void Tag::Index()
+		{
+			const Header header(tag);
+			qsizetype position=header.FramesStart();
+			while (position+Frame::Header::LENGTH <= tag.size())
+			{
+				const Frame::Header frameHeader(tag.sliced(position),header.Version());
+				if (frameHeader.Padding()) break;
+				const qsizetype start=position+Frame::Header::LENGTH;
+				if (frameHeader.Size() > tag.size()-start) throw std::runtime_error("Frame extends past the end of the tag in mp3 file");
+				frames[frameHeader.ID()].push_back(tag.sliced(start,frameHeader.Size()));
+				position=start+frameHeader.Size();
+			}
+		}
+
 		void Tag::Destroy()
 		{
+			// frames that were asked for have already been copied out, so nothing refers to the mapping after this
+			frames.clear();
+			tag={};
 			file.close();
 		}
 
-		Tag::Candidate<const QImage> Tag::AlbumCoverFront() const
+		quint32 Tag::Key(Frame::Frame frame)
+		{
+			switch (frame)
+			{
+			case Frame::Frame::APIC:
+				return BigEndian("APIC");
+			case Frame::Frame::TIT2:
+				return BigEndian("TIT2");
+			case Frame::Frame::TALB:
+				return BigEndian("TALB");
+			case Frame::Frame::TPE1:
+				return BigEndian("TPE1");
+			}
+			return 0;
+		}
+
+		bool Tag::Contains(Frame::Frame frame) const
+		{
+			return frames.contains(Key(frame));
+		}
+
+		Tag::Candidate<const QByteArray> Tag::AlbumCoverFront() const
+		{
+			if (!APIC)
+			{
+				auto candidate=frames.find(Key(Frame::Frame::APIC));
+				if (candidate == frames.end()) return std::nullopt;
+
+				// songs can carry several pictures, prefer the front cover but settle for whatever is first
+				for (const QByteArrayView &frame : candidate->second)
+				{
+					try
+					{
+						std::unique_ptr<Frame::APIC> picture=std::make_unique<Frame::APIC>(frame);
+						if (picture->Type() == Frame::PictureType::COVER_FRONT)
+						{
+							APIC=std::move(picture);
+							break;
+						}
+						if (!APIC) APIC=std::move(picture);
+					}
+
+					catch (const std::out_of_range &exception)
+					{
+						Q_UNUSED(exception)
+					}
+				}
+				if (!APIC) return std::nullopt;
+			}
+			return APIC->Picture();
+		}
+
+		Tag::Candidate<const QString> Tag::Text(Frame::Frame frame,std::unique_ptr<Frame::TIT2> &decoded) const
 		{
-			if (APIC)
-				return APIC->Picture();
-			else
-				return std::nullopt;
+			if (!decoded)
+			{
+				auto candidate=frames.find(Key(frame));
+				if (candidate == frames.end()) return std::nullopt;
+				decoded=std::make_unique<Frame::TIT2>(candidate->second.front());
+			}
+			return decoded->Title();
 		}
 
 		Tag::Candidate<const QString> Tag::Title() const
 		{
-			if (TIT2)
-				return TIT2->Title();
-			else
-				return std::nullopt;
+			return Text(Frame::Frame::TIT2,TIT2);
 		}
 
 		Tag::Candidate<const QString> Tag::AlbumTitle() const
 		{
-			if (TALB)
-				return TALB->Title();
-			else
-				return std::nullopt;
+			return Text(Frame::Frame::TALB,TALB);
 		}
 
 		Tag::Candidate<const QString> Tag::Artist() const
 		{
-			if (TPE1)
-				return TPE1->Title();
-			else
-				return std::nullopt;
+			return Text(Frame::Frame::TPE1,TPE1);
 		}
-		
-		Header::Header(QFile &file) : file(file)
+
+		Header::Header(QByteArrayView data) : data(data), extendedHeaderSize(0)
 		{
+			if (data.size() < LENGTH) throw std::runtime_error("Failed to read header from mp3 file");
 			ParseIdentifier();
 			ParseVersion();
 			ParseFlags();
 			ParseSize();
+			ParseExtendedHeader();
 		}
 
 		void Header::ParseIdentifier()
 		{
-			QByteArray header=file.read(3);
-			if (header.size() < 3) throw std::runtime_error("Failed to read header from mp3 file");
-			if (header != "ID3") throw std::runtime_error("File is not a valid mp3 file");
+			if (data.first(3) != "ID3") throw std::runtime_error("File is not a valid mp3 file");
 		}
 
 		void Header::ParseVersion()
 		{
-			char major;
-			char minor;
-			if (!file.getChar(&major) || !file.getChar(&minor)) throw std::runtime_error("Failed to read version information from mp3 file");
-			versionMajor=major;
-			versionMinor=minor;
+			versionMajor=static_cast<quint8>(data[3]);
+			versionMinor=static_cast<quint8>(data[4]);
+			if (versionMajor < 3 || versionMajor > 4) throw std::runtime_error("Unsupported ID3 version in mp3 file");
 		}
 
 		void Header::ParseFlags()
 		{
-			char flags;
-			if (!file.getChar(&flags)) throw std::runtime_error("Failed to read flags from mp3 file");
-			extendedHeader=flags & 0x1000000;
-			unsynchronization=flags & 0x10000000;
+			const quint8 flags=static_cast<quint8>(data[5]);
+			unsynchronization=flags & 0x80;
+			extendedHeader=flags & 0x40;
 		}
 
 		void Header::ParseSize()
 		{
-			char data[4];
-			for (int index=3; index >= 0; index--)
-			{
-				if (!file.getChar(&data[index])) throw std::runtime_error("Failed to read size of frame from mp3 file");
-			}
-			std::memcpy(&size,data,sizeof(quint32));
+			size=SyncSafe(data.data()+6);
+		}
+
+		void Header::ParseExtendedHeader()
+		{
+			if (!extendedHeader || data.size() < LENGTH+4) return; // when only the header itself has been read, the caller just wants the size
+			// 2.4 counts the size field itself and makes it sync-safe, 2.3 does neither
+			extendedHeaderSize=versionMajor == 4 ? SyncSafe(data.data()+LENGTH) : BigEndian(data.data()+LENGTH)+4;
 		}
 
 		quint32 Header::Size() const
 		{
-			return size+10; // entire size of tag is size + 10 byte header
+			return size+LENGTH; // entire size of tag is size + 10 byte header
+		}
+
+		quint32 Header::FramesStart() const
+		{
+			return LENGTH+extendedHeaderSize;
+		}
+
+		unsigned short Header::Version() const
+		{
+			return versionMajor;
 		}
 
 		namespace Frame
 		{
-			Header::Header(QFile &file) : file(file)
+			QString DecodeText(Encoding encoding,QByteArrayView data)
 			{
-				ParseID();
-				ParseSize();
-				file.skip(2); // skip frame flags
+				QString text;
+				switch (encoding)
+				{
+				case Encoding::ISO_8859_1:
+					text=QString::fromLatin1(data);
+					break;
+				case Encoding::UTF_16:
+					text=QStringDecoder(QStringDecoder::Utf16).decode(data); // picks the byte order from the BOM
+					break;
+				case Encoding::UTF_16BE:
+					text=QStringDecoder(QStringDecoder::Utf16BE).decode(data);
+					break;
+				case Encoding::UTF_8:
+					text=QString::fromUtf8(data);
+					break;
+				}
+
+				// 2.4 separates multiple values with nulls, only the first one is used
+				if (qsizetype terminator=text.indexOf(QChar::Null); terminator >= 0) text.truncate(terminator);
+				return text;
 			}
 
-			void Header::ParseID()
+			Encoding ReadEncoding(QByteArrayView data)
 			{
-				id=file.read(4);
-				if (id.size() < 4) throw std::runtime_error("Invalid frame ID in mp3 file");
+				if (data.isEmpty()) throw std::runtime_error("Invalid encoding in frame of mp3 file");
+				const quint8 numeric=static_cast<quint8>(data[0]);
+				if (numeric > 3) throw std::out_of_range("Unrecognized encoding in frame of mp3 file");
+				return static_cast<Encoding>(numeric);
 			}
 
-			QByteArray Header::ID() const
+			Header::Header(QByteArrayView data,unsigned short version) : data(data)
 			{
-				return id;
+				if (data.size() < LENGTH) throw std::runtime_error("Invalid frame header in mp3 file");
+				id=BigEndian(data.data());
+				size=version == 4 ? SyncSafe(data.data()+4) : BigEndian(data.data()+4); // flags in the last 2 bytes aren't used
 			}
 
-			void Header::ParseSize()
+			quint32 Header::ID() const
 			{
-				char data[4];
-				for (int index=3; index >= 0; index--)
-				{
-					if (!file.getChar(&data[index])) throw std::runtime_error("Failed to read size of frame from mp3 file");
-				}
-				size=SyncSafe(data);
+				return id;
 			}
-			
+
 			quint32 Header::Size() const
 			{
 				return size;
 			}
 
-			APIC::APIC(QFile &file,quint32 size) : file(file), size(size)
+			bool Header::Padding() const
+			{
+				return data[0] == '\0';
+			}
+
+			APIC::APIC(QByteArrayView data) : data(data), position(0)
 			{
 				ParseEncoding();
 				ParseMIMEType();
@@ -549,67 +830,56 @@ namespace Music
 
 			void APIC::ParseEncoding()
 			{
-				char data;
-				if (!file.getChar(&data)) throw std::runtime_error("Invalid encoding in frame of mp3 file");
-				unsigned short numeric=data;
-				if (numeric > 3) throw std::out_of_range("Unrecognized encoding in frame of mp3 file");
-				encoding=static_cast<Encoding>(numeric);
+				encoding=ReadEncoding(data);
+				position++;
 			}
 
 			void APIC::ParseMIMEType()
 			{
-				char byte;
-				do
-				{
-					if (!file.getChar(&byte)) throw std::runtime_error("Invalie MIME type in frame of mp3 file");
-					MIMEType.append(byte);
-				}
-				while (byte != '\0');
+				const qsizetype terminator=data.indexOf('\0',position);
+				if (terminator < 0) throw std::runtime_error("Invalid MIME type in frame of mp3 file");
+				MIMEType=data.sliced(position,terminator-position).toByteArray();
+				position=terminator+1;
 			}
 
 			void APIC::ParsePictureType()
 			{
-				char data;
-				if (!file.getChar(&data)) throw std::runtime_error("Invalid picture type in frame of mp3 file");
-				unsigned short numeric=data;
-				if (numeric > 14) throw std::out_of_range("Unrecognized picture type in frame of mp3 file");
+				if (position >= data.size()) throw std::runtime_error("Invalid picture type in frame of mp3 file");
+				const quint8 numeric=static_cast<quint8>(data[position++]);
+				if (numeric > static_cast<quint8>(PictureType::STUDIO_LOGO)) throw std::out_of_range("Unrecognized picture type in frame of mp3 file");
 				pictureType=static_cast<PictureType>(numeric);
 			}
 
 			void APIC::ParseDescription()
 			{
-				int chunkSize=encoding == Encoding::UTF_16 || encoding == Encoding::UTF_16BE ? 2 : 1;
-				QByteArray terminator(chunkSize,'\0');
-				QByteArray data;
-				do
+				// the description isn't used, it only has to be stepped over
+				const qsizetype chunkSize=encoding == Encoding::UTF_16 || encoding == Encoding::UTF_16BE ? 2 : 1;
+				while (position+chunkSize <= data.size())
 				{
-					data=file.read(chunkSize);
-					if (data.size() < chunkSize) throw std::runtime_error("Invalid description in frame of mp3 file");
-					description.append(data);
+					const bool terminator=chunkSize == 1 ? data[position] == '\0' : data[position] == '\0' && data[position+1] == '\0';
+					position+=chunkSize;
+					if (terminator) return;
 				}
-				while (data != terminator);
+				throw std::runtime_error("Invalid description in frame of mp3 file");
 			}
 
 			void APIC::ParsePictureData()
 			{
-				quint32 length=DataSize();
-				QByteArray data=file.read(length);
-				if (data.size() < length) throw std::runtime_error("Invalid image data in frame of mp3 file");
-				picture=QImage::fromData(data);
+				if (position >= data.size()) throw std::runtime_error("Invalid image data in frame of mp3 file");
+				picture=data.sliced(position).toByteArray(); // the one copy, made only because the picture was asked for
 			}
 
-			const QImage& APIC::Picture() const
+			PictureType APIC::Type() const
 			{
-				return picture;
+				return pictureType;
 			}
 
-			quint32 APIC::DataSize()
+			const QByteArray& APIC::Picture() const
 			{
-				int value=size-2-MIMEType.size()-description.size(); // 2 = 1 byte for encoding, 1 byte for picture type
-				return value;
+				return picture;
 			}
 
-			TIT2::TIT2(QFile &file,quint32 size) : file(file), size(size)
+			TIT2::TIT2(QByteArrayView data) : data(data)
 			{
 				ParseEncoding();
 				ParseTitle();
@@ -617,28 +887,12 @@ namespace Music
 
 			void TIT2::ParseEncoding()
 			{
-				char data;
-				if (!file.getChar(&data)) throw std::runtime_error("Invalid encoding in frame of mp3 file");
-				unsigned short numeric=data;
-				if (numeric > 3) throw std::out_of_range("Unrecognized encoding in frame of mp3 file");
-				encoding=static_cast<Encoding>(numeric);
+				encoding=ReadEncoding(data);
 			}
 
 			void TIT2::ParseTitle()
 			{
-				int chunkSize=encoding == Encoding::UTF_16 || encoding == Encoding::UTF_16BE ? 2 : 1;
-				QByteArray terminator(chunkSize,'\0');
-				QByteArray chunk;
-				QByteArray data;
-				do
-				{
-					chunk=file.read(chunkSize);
-					if (chunk.size() < chunkSize) throw std::runtime_error("Invalid description in frame of mp3 file");
-					if (chunk == QByteArray::fromHex("FFFE") || chunk == QByteArray::fromHex("FEFF")) continue;
-					data.append(chunk);
-				}
-				while (chunk != terminator);
-				title=data;
+				title=DecodeText(encoding,data.sliced(1));
 			}
 
 			const QString& TIT2::Title() const
@@ -647,6 +901,124 @@ namespace Music
 			}
 		}
 	}
+
+	MetadataCache::MetadataCache() : entries(32768) // in kilobytes of downscaled cover, every entry costs at least one
+	{
+	}
+
+	MetadataCache::Entry* MetadataCache::Find(const QString &path,const QFileInfo &file)
+	{
+		Entry *entry=entries.object(path);
+		if (!entry) return nullptr;
+		if (entry->size != file.size() || entry->modified != file.lastModified())
+		{
+			entries.remove(path);
+			return nullptr;
+		}
+		return entry;
+	}
+
+	Metadata MetadataCache::Read(const QString &path)
+	{
+		if (std::optional<struct Metadata> metadata=Cached(path); metadata) return *metadata;
+		const struct Metadata metadata=Parse(path);
+		Store(path,metadata);
+		return metadata;
+	}
+
+	std::optional<Metadata> MetadataCache::Cached(const QString &path)
+	{
+		const QFileInfo file(path);
+		if (Entry *entry=Find(path,file); entry) return entry->metadata;
+
+		// untagged songs are in the library too, but those are left to Parse so they fail the way they always have
+		if (const Track *track=Library::Shared().Find(path,file); track && (!track->title.isEmpty() || !track->album.isEmpty() || !track->artist.isEmpty()))
+		{
+			const struct Metadata metadata=track->Metadata();
+			entries.insert(path,new Entry{.modified=file.lastModified(),.size=file.size(),.metadata=metadata},1);
+			return metadata;
+		}
+		return std::nullopt;
+	}
+
+	void MetadataCache::Store(const QString &path,const struct Metadata &metadata)
+	{
+		const QFileInfo file(path);
+		entries.insert(path,new Entry{.modified=file.lastModified(),.size=file.size(),.metadata=metadata},1);
+	}
+
+	Metadata MetadataCache::Parse(const QString &path)
+	{
+		// touches nothing but the file, so it's safe to call from any thread
+		ID3::Tag tag(path);
+		auto title=tag.Title();
+		auto album=tag.AlbumTitle();
+		auto artist=tag.Artist();
+		return {
+			.title=title ? *title : QString{},
+			.album=album ? *album : QString{},
+			.artist=artist ? *artist : QString{},
+			.path=path,
+			.cover=tag.Contains(ID3::Frame::Frame::APIC),
+			.valid=true
+		};
+	}
+
+	Async::Task<QImage> MetadataCache::Cover(QString path,QSize bound)
+	{
+		if (Entry *entry=Find(path,QFileInfo(path)); entry && !entry->cover.isNull() && entry->coverBound == bound) co_return entry->cover;
+		if (const QSize thumbnail=Library::ThumbnailSize(); bound.isValid() && bound.width() <= thumbnail.width() && bound.height() <= thumbnail.height())
+		{
+			// small enough that the thumbnail kept with the library will do, without reading the tag at all
+			if (const QImage cover=Library::Shared().Thumbnail(path); !cover.isNull()) co_return cover.scaled(bound,Qt::KeepAspectRatio,Qt::SmoothTransformation);
+		}
+
+		// the tag is read again on the worker so the encoded picture never has to exist on the GUI thread
+		const QImage cover=co_await Decode::Pool::Shared().Run([path,bound]() -> QImage {
+			try
+			{
+				ID3::Tag tag(path);
+				auto picture=tag.AlbumCoverFront();
+				if (!picture) return {};
+				QBuffer buffer;
+				buffer.setData(*picture);
+				QImageReader reader(&buffer);
+				return Decode::Pool::Read(reader,bound);
+			}
+
+			catch (const std::exception &exception)
+			{
+				Q_UNUSED(exception)
+				return {};
+			}
+		});
+		if (cover.isNull()) co_return cover;
+
+		try
+		{
+			Read(path); // makes sure there's a current entry to hang the cover on
+		}
+
+		catch (const std::runtime_error &exception)
+		{
+			Q_UNUSED(exception)
+			co_return cover;
+		}
+
+		if (Entry *entry=entries.take(path); entry)
+		{
+			entry->cover=cover;
+			entry->coverBound=bound;
+			entries.insert(path,entry,1+static_cast<int>(cover.sizeInBytes()/1024));
+		}
+		co_return cover;
+	}
+
+	MetadataCache& MetadataCache::Shared()
+	{
+		static MetadataCache cache;
+		return cache;
+	}
 }
 
 namespace Viewer
@@ -655,13 +1027,40 @@ namespace Viewer
 	{
 		Remote::Remote(const QUrl &profileImageURL)
 		{
-			Network::Request::Send(profileImageURL,Network::Method::GET,[this](QNetworkReply *reply) {
-				if (reply->error())
-					emit Print(QString("Failed: %1").arg(reply->errorString()),"profile image retrieval");
-				else
-					emit Retrieved(std::make_shared<QImage>(QImage::fromData(reply->readAll())));
-				this->deleteLater();
-			});
+			Retrieve(profileImageURL).Start(this);
+		}
+
+		Async::Task<std::shared_ptr<QImage>> Remote::Download(QUrl profileImageURL)
+		{
+			const QString key=QString(Cache::KEY_PROFILE_IMAGE).arg(profileImageURL.toString());
+			std::optional<QString> path=Cache::Assets::Shared().Path(key);
+			if (!path)
+			{
+				// an arrival and a shoutout for the same viewer share one download
+				path=co_await Async::Operation<std::optional<QString>>([&](std::function<void(std::optional<QString>)> resume) {
+					Cache::Assets::Shared().Fetch(key,profileImageURL,Network::Priority::NORMAL,resume);
+				});
+				if (!path) throw std::runtime_error(QString("Failed to download %1").arg(profileImageURL.toString()).toStdString());
+			}
+
+			QImage image=co_await Decode::Pool::Shared().File(*path,Decode::Pool::ScreenBound());
+			if (image.isNull()) throw std::runtime_error(QString("Failed to decode %1").arg(profileImageURL.toString()).toStdString());
+			co_return std::make_shared<QImage>(std::move(image));
+		}
+
+		Async::Task<void> Remote::Retrieve(QUrl profileImageURL)
+		{
+			try
+			{
+				emit Retrieved(co_await Download(profileImageURL));
+			}
+
+			catch (const std::runtime_error &exception)
+			{
+				emit Print(exception.what(),"profile image retrieval");
+			}
+
+			deleteLater();
 		}
 
 		Remote::operator QImage() const
@@ -690,6 +1089,11 @@ namespace Viewer
 		return new ProfileImage::Remote(profileImageURL);
 	}
 
+	const QUrl& Local::ProfileImageURL() const
+	{
+		return profileImageURL;
+	}
+
 	const QString& Local::Description() const
 	{
 		return description;
@@ -697,43 +1101,51 @@ namespace Viewer
 
 	Remote::Remote(Security &security,const QString &username) : name(username)
 	{
-		Network::Request::Send({Twitch::Endpoint(Twitch::ENDPOINT_USERS)},Network::Method::GET,[this](QNetworkReply* reply) {
-			const char *OPERATION="request viewer information";
-
-			try
-			{
-				switch (reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt())
-				{
-				case 400:
-					throw std::runtime_error("Invalid or missing ID or login parameter");
-				case 401:
-					throw std::runtime_error("Authentication failed");
-				}
-
-				if (reply->error()) throw std::runtime_error("Unknown error obtaining viewer information");
-
-				const JSON::ParseResult parsedJSON=JSON::Parse(reply->readAll());
-				if (!parsedJSON) throw std::runtime_error(std::string("Failed: "+parsedJSON.error.toStdString()));
-				QJsonArray data=parsedJSON().object().value("data").toArray();
-				if (data.size() < 1) throw std::runtime_error("Invalid user");
-				QJsonObject details=data.at(0).toObject();
-				emit Recognized({details.value("login").toString(),details.value("id").toString(),details.value("display_name").toString(),details.value("profile_image_url").toString(),details.value("description").toString()});
-			}
-
-			catch (const std::runtime_error &exception)
-			{
-				emit Print(exception.what(),OPERATION);
-				emit Unrecognized();
-			}
+		Identify(security).Start(this);
+	}
 
-			this->deleteLater();
-		},{
+	Async::Task<Local> Remote::Lookup(Security &security,QString username)
+	{
+		Network::Reply reply=co_await Network::Request::Await({Twitch::Endpoint(Twitch::ENDPOINT_USERS)},Network::Method::GET,{
 			{"login",username}
 		},{
 			{"Authorization",StringConvert::ByteArray(QString("Bearer %1").arg(static_cast<QString>(security.OAuthToken())))},
 			{"Client-ID",security.ClientID()}
 		});
-	};
+
+		switch (reply.status)
+		{
+		case 400:
+			throw std::runtime_error("Invalid or missing ID or login parameter");
+		case 401:
+			throw std::runtime_error("Authentication failed");
+		}
+
+		if (reply.error) throw std::runtime_error("Unknown error obtaining viewer information");
+
+		Twitch::Helix::Response<Twitch::Helix::User> response=JSON::Decode<Twitch::Helix::Response<Twitch::Helix::User>>(reply.body);
+		if (response.data.empty()) throw std::runtime_error("Invalid user");
+		const Twitch::Helix::User &user=response.data.front();
+		co_return Local{user.login,user.id,user.displayName,user.profileImageURL,user.description};
+	}
+
+	Async::Task<void> Remote::Identify(Security &security)
+	{
+		const char *OPERATION="request viewer information";
+
+		try
+		{
+			emit Recognized(co_await Lookup(security,name));
+		}
+
+		catch (const std::runtime_error &exception)
+		{
+			emit Print(exception.what(),OPERATION);
+			emit Unrecognized();
+		}
+
+		deleteLater();
+	}
 }
 
 namespace JSON
@@ -8,10 +8,16 @@
 #include <QAudioOutput>
 #include <QPropertyAnimation>
 #include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QCache>
 #include <QJsonObject>
 #include <memory>
+#include <unordered_map>
+#include <deque>
 #include "settings.h"
 #include "security.h"
+#include "async.h"
 
 enum class CommandType
 {
@@ -89,13 +95,27 @@ namespace Music
 		QString title;
 		QString album;
 		QString artist;
-		QImage cover;
+		QString path;
+		bool cover=false; // the picture itself is decoded and downscaled separately through MetadataCache::Cover
 		bool valid=false;
 	};
 
+	/*!
+	 * \brief Plays through a list of songs on two alternating decks
+	 *
+	 * While one deck is playing, the song after it is opened on the other so
+	 * that it's already buffered when the first one ends. Handing over is
+	 * then just starting the second deck, either the moment the first ends or,
+	 * when a crossfade is set, that long before the end with the volumes of
+	 * the two ramped against each other. Each deck is also turned down by
+	 * however much its song is louder than the loudness target, once the
+	 * library has measured it. Songs viewers request are played ahead of
+	 * the rotation, in the order they were asked for.
+	 */
 	class Player : public QObject
 	{
 		Q_OBJECT
+		Q_PROPERTY(qreal level READ Level WRITE Level)
 	public:
 		Player(bool loop,int initialVolume,QObject *parent=nullptr);
 		void DuckVolume(bool duck);
@@ -105,18 +125,47 @@ namespace Music
 		QString Filename() const;
 		void Sources(const File::List &sources);
 		const File::List& Sources();
+		void Request(const QString &path,const QString &requester);
+		bool Requested(const QString &path) const;
+		int Requests(const QString &requester) const;
 		ApplicationSetting& SuppressedVolume();
+		ApplicationSetting& Crossfade();
+		ApplicationSetting& Normalize();
+		ApplicationSetting& LoudnessTarget();
+		qreal Level() const;
+		void Level(qreal level);
 	protected:
 		QMediaPlayer player;
 		QAudioOutput output;
+		QMediaPlayer upcomingPlayer;
+		QAudioOutput upcomingOutput;
+		QMediaPlayer *current;
+		QMediaPlayer *upcoming; // the next song while the current one plays, the outgoing one during a crossfade
 		File::List sources;
+		std::deque<std::pair<QString,QString>> requests; // path and who asked for it, removed once the song starts or fails to load
+		QString bumped; // song from the rotation a request took the place of, played once the requests run out
 		QMetaObject::Connection autoPlay;
 		bool loop;
+		qreal level;
+		qreal fade; // how far the current deck is through fading in, 1 when there's no crossfade happening
+		std::unordered_map<const QMediaPlayer*,qreal> gains;
 		ApplicationSetting settingSuppressedVolume;
+		ApplicationSetting settingCrossfade;
+		ApplicationSetting settingNormalize;
+		ApplicationSetting settingLoudnessTarget;
 		QPropertyAnimation volumeAdjustment;
+		QVariantAnimation crossfade;
 		static const char *ERROR_LOADING;
 		static const char *OPERATION_LOADING;
 		bool Next(QUrl source={});
+		QString Upcoming();
+		void Dismiss(const QString &path);
+		void Queue();
+		void Handover();
+		void Mix();
+		void Release(QMediaPlayer *deck);
+		bool Loaded(const QMediaPlayer *deck) const;
+		qreal Gain(const QUrl &source);
 		int TranslateVolume(qreal volume);
 		qreal TranslateVolume(int volume);
 		bool Empty();
@@ -132,29 +181,37 @@ namespace Music
 		void StateChanged(QMediaPlayer::PlaybackState state);
 		void MediaStatusChanged(QMediaPlayer::MediaStatus status);
 		void MediaError(QMediaPlayer::Error error,const QString &errorString);
+		void PositionChanged(qint64 position);
+		void Crossfaded();
 		void VolumeMuted();
 	};
 
 	namespace ID3
 	{
 		quint32 SyncSafe(const char *value);
+		quint32 BigEndian(const char *value);
 
 		class Header
 		{
 		public:
-			Header(QFile &file);
+			Header(QByteArrayView data);
 			quint32 Size() const;
+			quint32 FramesStart() const;
+			unsigned short Version() const;
+			static constexpr int LENGTH=10;
 		protected:
-			QFile &file;
+			QByteArrayView data;
 			unsigned short versionMajor;
 			unsigned short versionMinor;
 			bool unsynchronization;
 			bool extendedHeader;
 			quint32 size;
+			quint32 extendedHeaderSize;
 			void ParseIdentifier();
 			void ParseVersion();
 			void ParseFlags();
 			void ParseSize();
+			void ParseExtendedHeader();
 		};
 
 		namespace Frame
@@ -203,46 +260,44 @@ namespace Music
 			class Header
 			{
 			public:
-				Header(QFile &file);
-				QByteArray ID() const;
+				Header(QByteArrayView data,unsigned short version);
+				quint32 ID() const;
 				quint32 Size() const;
+				bool Padding() const;
+				static constexpr int LENGTH=10;
 			protected:
-				QFile &file;
-				QByteArray id;
+				QByteArrayView data;
+				quint32 id;
 				quint32 size;
-				void ParseID();
-				void ParseSize();
 			};
 
 			class APIC
 			{
 			public:
-				APIC(QFile &file,quint32 size);
-				const QImage& Picture() const;
+				APIC(QByteArrayView data);
+				PictureType Type() const;
+				const QByteArray& Picture() const;
 			protected:
-				QFile &file;
-				quint32 size;
+				QByteArrayView data;
+				qsizetype position;
 				Encoding encoding;
 				QByteArray MIMEType;
 				PictureType pictureType;
-				QByteArray description;
-				QImage picture;
+				QByteArray picture;
 				void ParseEncoding();
 				void ParseMIMEType();
 				void ParsePictureType();
 				void ParseDescription();
 				void ParsePictureData();
-				quint32 DataSize();
 			};
 
 			class TIT2
 			{
 			public:
-				TIT2(QFile &file,quint32 size);
+				TIT2(QByteArrayView data);
 				const QString& Title() const;
 			protected:
-				QFile &file;
-				quint32 size;
+				QByteArrayView data;
 				Encoding encoding;
 				QString title;
 				void ParseEncoding();
@@ -252,25 +307,70 @@ namespace Music
 			using TPE1=TIT2;
 		}
 
+		/*!
+		 * \brief Reads the ID3v2 tag of an mp3 file, decoding frames only when they're asked for
+		 *
+		 * The tag is memory-mapped and its frame headers are walked once to
+		 * record where each frame is. Nothing is copied out of the file until a
+		 * frame is asked for, so looking up a title never touches the
+		 * (sometimes multi-megabyte) cover art sitting next to it.
+		 */
 		class Tag
 		{
 			template<typename T> using Candidate=std::optional<std::reference_wrapper<T>>;
 		public:
 			Tag(const QString &filename);
 			~Tag();
-			Candidate<const QImage> AlbumCoverFront() const;
+			Candidate<const QByteArray> AlbumCoverFront() const;
 			Candidate<const QString> Title() const;
 			Candidate<const QString> AlbumTitle() const;
 			Candidate<const QString> Artist() const;
+			bool Contains(Frame::Frame frame) const;
 		protected:
 			QFile file;
-			std::unique_ptr<Frame::APIC> APIC;
-			std::unique_ptr<Frame::TIT2> TIT2;
-			std::unique_ptr<Frame::TALB> TALB;
-			std::unique_ptr<Frame::TPE1> TPE1;
+			QByteArrayView tag;
+			QByteArray buffer; // only used when the file can't be mapped
+			std::unordered_map<quint32,std::vector<QByteArrayView>> frames;
+			mutable std::unique_ptr<Frame::APIC> APIC;
+			mutable std::unique_ptr<Frame::TIT2> TIT2;
+			mutable std::unique_ptr<Frame::TALB> TALB;
+			mutable std::unique_ptr<Frame::TPE1> TPE1;
+			void Index();
 			void Destroy();
+			Candidate<const QString> Text(Frame::Frame frame,std::unique_ptr<Frame::TIT2> &decoded) const;
+			static quint32 Key(Frame::Frame frame);
 		};
 	}
+
+	/*!
+	 * \brief Song metadata and downscaled covers that have already been read
+	 *
+	 * Entries are keyed by path and only trusted while the file's size and
+	 * modification time haven't changed, so editing a song's tags is picked
+	 * up the next time it's asked for.
+	 */
+	class MetadataCache
+	{
+	public:
+		MetadataCache();
+		struct Metadata Read(const QString &path);
+		std::optional<struct Metadata> Cached(const QString &path);
+		void Store(const QString &path,const struct Metadata &metadata);
+		Async::Task<QImage> Cover(QString path,QSize bound);
+		static struct Metadata Parse(const QString &path);
+		static MetadataCache& Shared();
+	protected:
+		struct Entry
+		{
+			QDateTime modified;
+			qint64 size=0;
+			struct Metadata metadata;
+			QImage cover;
+			QSize coverBound;
+		};
+		QCache<QString,Entry> entries;
+		Entry* Find(const QString &path,const QFileInfo &file);
+	};
 }
 
 namespace Viewer
@@ -283,8 +383,10 @@ namespace Viewer
 		public:
 			Remote(const QUrl &profileImageURL);
 			operator QImage() const;
+			static Async::Task<std::shared_ptr<QImage>> Download(QUrl profileImageURL);
 		protected:
 			QImage image;
+			Async::Task<void> Retrieve(QUrl profileImageURL);
 		signals:
 			void Print(const QString &message,const QString operation=QString(),const QString subsystem=QString("profile image retrieval"));
 			void Retrieved(std::shared_ptr<QImage> image);
@@ -299,6 +401,7 @@ namespace Viewer
 		const QString& ID() const;
 		const QString& DisplayName() const;
 		ProfileImage::Remote* ProfileImage() const;
+		const QUrl& ProfileImageURL() const;
 		const QString& Description() const;
 	protected:
 		QString name;
@@ -313,9 +416,11 @@ namespace Viewer
 		Q_OBJECT
 	public:
 		Remote(Security &security,const QString &username);
+		static Async::Task<Local> Lookup(Security &security,QString username);
 	protected:
 		QString name;
 		void DownloadProfileImage(const QString &url);
+		Async::Task<void> Identify(Security &security);
 	signals:
 		void Print(const QString &message,const QString operation=QString(),const QString subsystem=QString("viewer retrieval"));
 		void Recognized(const Viewer::Local &viewer);
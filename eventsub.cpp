@@ -7,17 +7,9 @@
 #include "network.h"
 #include "twitch.h"
 #include "eventsub.h"
+#include "binding.h"
 
-const char *JSON_KEY_METADATA="metadata";
-const char *JSON_KEY_METADATA_TYPE="message_type";
-const char *JSON_KEY_PAYLOAD="payload";
-const char *JSON_KEY_PAYLOAD_SESSION="session";
-const char *JSON_KEY_PAYLOAD_SESSION_ID="id";
-const char *JSON_KEY_PAYLOAD_SESSION_KEEPALIVE_TIMEOUT="keepalive_timeout_seconds";
-const char *JSON_KEY_PAYLOAD_SUBSCRIPTION="subscription";
-const char *JSON_KEY_PAYLOAD_SUBSCRIPTION_TYPE="type";
 const char *JSON_KEY_CHALLENGE="challenge";
-const char *JSON_KEY_EVENT="event";
 const char *JSON_KEY_EVENT_REWARD="reward";
 const char *JSON_KEY_EVENT_REWARD_TITLE="title";
 const char *JSON_KEY_EVENT_FOLLOW="followed at";
@@ -35,6 +27,48 @@ const char *MESSAGE_TYPE_WELCOME="session_welcome";
 const char *MESSAGE_TYPE_KEEPALIVE="session_keepalive";
 const char *MESSAGE_TYPE_NOTIFICATION="notification";
 
+namespace Message
+{
+	struct Metadata
+	{
+		QString type;
+		static constexpr auto Fields() { return std::make_tuple(JSON::Required("message_type",&Metadata::type)); }
+	};
+
+	struct Envelope
+	{
+		Metadata metadata;
+		QJsonObject payload;
+		static constexpr auto Fields() { return std::make_tuple(JSON::Required("metadata",&Envelope::metadata),JSON::Required("payload",&Envelope::payload)); }
+	};
+
+	struct Session
+	{
+		QString id;
+		std::optional<int> keepalive;
+		static constexpr auto Fields() { return std::make_tuple(JSON::Required("id",&Session::id),JSON::Optional("keepalive_timeout_seconds",&Session::keepalive)); }
+	};
+
+	struct Welcome
+	{
+		Session session;
+		static constexpr auto Fields() { return std::make_tuple(JSON::Required("session",&Welcome::session)); }
+	};
+
+	struct Subscription
+	{
+		QString type;
+		static constexpr auto Fields() { return std::make_tuple(JSON::Required("type",&Subscription::type)); }
+	};
+
+	struct Notification
+	{
+		Subscription subscription;
+		QJsonObject event;
+		static constexpr auto Fields() { return std::make_tuple(JSON::Required("subscription",&Notification::subscription),JSON::Required("event",&Notification::event)); }
+	};
+}
+
 const char *EventSub::SETTINGS_CATEGORY_EVENTS="Events";
 
 enum class TwitchCloseCode
@@ -63,6 +97,7 @@ EventSub::EventSub(Security &security,QObject *parent) : QObject(parent),
 	subscriptionTypes.insert({SUBSCRIPTION_TYPE_RAID,SubscriptionType::CHANNEL_RAID});
 	subscriptionTypes.insert({SUBSCRIPTION_TYPE_SUBSCRIPTION,SubscriptionType::CHANNEL_SUBSCRIPTION});
 	subscriptionTypes.insert({SUBSCRIPTION_TYPE_RESUBSCRIPTION,SubscriptionType::CHANNEL_SUBSCRIPTION});
+	subscriptionTypes.insert({SUBSCRIPTION_TYPE_GIFT_SUBSCRIPTION,SubscriptionType::CHANNEL_GIFT_SUBSCRIPTION});
 	subscriptionTypes.insert({SUBSCRIPTION_TYPE_HYPE_TRAIN_START,SubscriptionType::CHANNEL_HYPE_TRAIN});
 	subscriptionTypes.insert({SUBSCRIPTION_TYPE_HYPE_TRAIN_PROGRESS,SubscriptionType::CHANNEL_HYPE_TRAIN});
 	subscriptionTypes.insert({SUBSCRIPTION_TYPE_HYPE_TRAIN_END,SubscriptionType::CHANNEL_HYPE_TRAIN});
@@ -128,6 +163,7 @@ void EventSub::Subscribe()
 	defaultTypes.push(SUBSCRIPTION_TYPE_RAID);
 	defaultTypes.push(SUBSCRIPTION_TYPE_SUBSCRIPTION);
 	defaultTypes.push(SUBSCRIPTION_TYPE_RESUBSCRIPTION);
+	defaultTypes.push(SUBSCRIPTION_TYPE_GIFT_SUBSCRIPTION);
 	defaultTypes.push(SUBSCRIPTION_TYPE_CHEER);
 	defaultTypes.push(SUBSCRIPTION_TYPE_HYPE_TRAIN_START);
 	defaultTypes.push(SUBSCRIPTION_TYPE_HYPE_TRAIN_PROGRESS);
@@ -202,47 +238,34 @@ void EventSub::ParseMessage(QString message)
 {
 	static const char *OPERATION_PARSE_MESSAGE="parse message";
 
-	const JSON::ParseResult parsedJSON=JSON::Parse(StringConvert::ByteArray(message.trimmed()));
-
-	if (!parsedJSON)
+	Message::Envelope envelope;
+	try
 	{
-		emit Print(u"Invalid JSON: %1"_s.arg(parsedJSON.error),OPERATION_PARSE_MESSAGE);
-		return;
+		envelope=JSON::Decode<Message::Envelope>(StringConvert::ByteArray(message.trimmed()));
 	}
 
-	QJsonObject messageObject=parsedJSON().object();
-	auto metadata=messageObject.find(JSON_KEY_METADATA);
-	auto payload=messageObject.find(JSON_KEY_PAYLOAD);
-	if (metadata == messageObject.end() || payload == messageObject.end())
+	catch (const JSON::Error &exception)
 	{
-		emit Print(u"Malformatted message"_s,OPERATION_PARSE_MESSAGE);
+		emit Print(u"Malformatted message: %1"_s.arg(exception.what()),OPERATION_PARSE_MESSAGE);
 		return;
 	}
 
-	QJsonObject metadataObject=metadata->toObject();
-	auto type=metadataObject.find(JSON_KEY_METADATA_TYPE);
-	if (type == metadataObject.end())
-	{
-		emit Print(u"Missing message type"_s,OPERATION_PARSE_MESSAGE);
-		return;
-	}
-
-	auto messageType=messageTypes.find(type->toString());
+	auto messageType=messageTypes.find(envelope.metadata.type);
 	if (messageType == messageTypes.end())
 	{
-		emit Print(u"Unknown message type (%1)"_s.arg(type->toString()),OPERATION_PARSE_MESSAGE);
+		emit Print(u"Unknown message type (%1)"_s.arg(envelope.metadata.type),OPERATION_PARSE_MESSAGE);
 		return;
 	}
 	switch (messageType->second)
 	{
 	case MessageType::WELCOME:
-		ParseWelcome(payload->toObject());
+		ParseWelcome(envelope.payload);
 		break;
 	case MessageType::KEEPALIVE:
 		keepalive.start();
 		break;
 	case MessageType::NOTIFICATION:
-		ParseNotification(payload->toObject());
+		ParseNotification(envelope.payload);
 		break;
 	default:
 		throw std::logic_error("Websocket message type recognized but unimplemented");
@@ -253,28 +276,24 @@ void EventSub::ParseWelcome(QJsonObject payload)
 {
 	static const char *OPERATION_PARSE_WELCOME="parse welcome";
 
-	auto session=payload.find(JSON_KEY_PAYLOAD_SESSION);
-	if (session == payload.end())
+	Message::Welcome welcome;
+	try
 	{
-		emit Print("Ignoring welcome message with no session data",OPERATION_PARSE_WELCOME);
-		return;
+		welcome=JSON::Decode<Message::Welcome>(QJsonValue(payload));
 	}
 
-	QJsonObject sessionObject=session->toObject();
-	auto candidateID=sessionObject.find(JSON_KEY_PAYLOAD_SESSION_ID);
-	if (candidateID == sessionObject.end())
+	catch (const JSON::Error &exception)
 	{
-		emit Print("Unable to create EventSub connection because Twitch did not provide a session ID",OPERATION_PARSE_WELCOME);
+		emit Print(u"Unable to create EventSub connection because Twitch sent an incomplete welcome (%1)"_s.arg(exception.what()),OPERATION_PARSE_WELCOME);
 		return;
 	}
 
-	sessionID=candidateID->toString();
+	sessionID=welcome.session.id;
 	emit Connected();
 
-	auto keepaliveCandidate=sessionObject.find(JSON_KEY_PAYLOAD_SESSION_KEEPALIVE_TIMEOUT);
-	if (keepaliveCandidate != sessionObject.end())
+	if (welcome.session.keepalive)
 	{
-		keepalive.setInterval(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::seconds(keepaliveCandidate->toInt()*2)));
+		keepalive.setInterval(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::seconds(*welcome.session.keepalive*2)));
 		keepalive.start();
 	}
 }
@@ -283,34 +302,24 @@ void EventSub::ParseNotification(QJsonObject notification)
 {
 	static const char *OPERATION_PARSE_NOTIFICATION="parse notification";
 
-	auto subscription=notification.find(JSON_KEY_PAYLOAD_SUBSCRIPTION);
-	if (subscription == notification.end())
+	Message::Notification parsedNotification;
+	try
 	{
-		emit Print("Ignoring notification payload with no subscription data",OPERATION_PARSE_NOTIFICATION);
-		return;
+		parsedNotification=JSON::Decode<Message::Notification>(QJsonValue(notification));
 	}
 
-	QJsonObject subscriptionObject=subscription->toObject();
-	SubscriptionType subscriptionType=SubscriptionType::UNKNOWN;
-	if (auto subscriptionTypeCandidate=subscriptionObject.find(JSON_KEY_PAYLOAD_SUBSCRIPTION_TYPE); subscriptionTypeCandidate != subscriptionObject.end())
+	catch (const JSON::Error &exception)
 	{
-		QString key=subscriptionTypeCandidate->toString();
-		if (auto subscriptionTypeCandidate=subscriptionTypes.find(key); subscriptionTypeCandidate != subscriptionTypes.end())
-		{
-			subscriptionType=subscriptionTypeCandidate->second;
-		}
-	}
-	if (subscriptionType == SubscriptionType::UNKNOWN) return;
-
-	auto event=notification.find(JSON_KEY_EVENT);
-	if (event == notification.end())
-	{
-		emit Print("Event field missing from notification");
+		emit Print(u"Ignoring malformatted notification payload (%1)"_s.arg(exception.what()),OPERATION_PARSE_NOTIFICATION);
 		return;
 	}
 
-	QJsonObject eventObject=event->toObject();
-	JSON::SignalPayload *payload=new JSON::SignalPayload(event->toObject());
+	auto subscriptionTypeCandidate=subscriptionTypes.find(parsedNotification.subscription.type);
+	if (subscriptionTypeCandidate == subscriptionTypes.end()) return;
+	SubscriptionType subscriptionType=subscriptionTypeCandidate->second;
+
+	const QJsonObject &eventObject=parsedNotification.event;
+	JSON::SignalPayload *payload=new JSON::SignalPayload(eventObject);
 	if (std::optional<QString> prompt=ExtractPrompt(subscriptionType,eventObject); prompt) payload->context=*prompt;
 	const QString name=eventObject.value(JSON_KEY_EVENT_USER_NAME).toString();
 	const QString login=eventObject.value(JSON_KEY_EVENT_USER_LOGIN).toString();
@@ -330,8 +339,12 @@ void EventSub::ParseNotification(QJsonObject notification)
 			emit Raid(eventObject.value("from_broadcaster_user_name").toString(),eventObject.value(JSON_KEY_EVENT_VIEWERS).toVariant().toUInt());
 			break;
 		case SubscriptionType::CHANNEL_SUBSCRIPTION:
+			if (eventObject.value("is_gift").toBool()) break; // already announced as part of the gift
 			emit ChannelSubscription(eventObject.value(JSON_KEY_EVENT_USER_LOGIN).toString(),eventObject.value(JSON_KEY_EVENT_USER_NAME).toString());
 			break;
+		case SubscriptionType::CHANNEL_GIFT_SUBSCRIPTION:
+			emit GiftSubscription(eventObject.value("is_anonymous").toBool() ? u"Anonymous"_s : name,eventObject.value("total").toVariant().toUInt());
+			break;
 		case SubscriptionType::CHANNEL_HYPE_TRAIN:
 			if (double goal=eventObject.value(JSON_KEY_EVENT_HYPE_TRAIN_TOTAL).toDouble(); goal > 0) emit HypeTrain(eventObject.value(JSON_KEY_EVENT_HYPE_TRAIN_LEVEL).toInt(),eventObject.value(JSON_KEY_EVENT_HYPE_TRAIN_PROGRESS).toDouble()/goal);
 			break;
@@ -360,36 +373,27 @@ void EventSub::RequestEventSubscriptionList()
 		const QByteArray data=reply->readAll();
 		emit Print(StringConvert::SafeDump(data),TWITCH_API_OPERATION_SUBSCRIPTION_LIST);
 
-		const JSON::ParseResult parsedJSON=JSON::Parse(StringConvert::ByteArray(data.trimmed()));
-		if (!parsedJSON)
-		{
-			emit Print(QString("Invalid JSON: %1").arg(parsedJSON.error),TWITCH_API_OPERATION_SUBSCRIPTION_LIST);
-			return;
-		}
-
-		QJsonObject jsonObject=parsedJSON().object();
-		if (auto subscriptionList=jsonObject.find(JSON::Keys::DATA); subscriptionList != jsonObject.end())
+		try
 		{
-			const QJsonArray subscriptionListArray=subscriptionList->toArray();
-			for (const QJsonValue &eventSubscription : subscriptionListArray)
+			const Twitch::Helix::Listing<Twitch::Helix::EventSubscription> response=JSON::Decode<Twitch::Helix::Listing<Twitch::Helix::EventSubscription>>(data.trimmed());
+			for (const QString &skipped : response.data.skipped) emit Print(QString("Skipping malformed subscription: %1").arg(skipped),TWITCH_API_OPERATION_SUBSCRIPTION_LIST);
+			for (const Twitch::Helix::EventSubscription &eventSubscription : response.data.entries)
 			{
-				const QJsonObject entry=eventSubscription.toObject();
-				const QString id=entry.value("id").toString();
-				const QString type=entry.value("type").toString();
-				const QDateTime date=entry.value("created_at").toVariant().toDateTime();
-
-				if (auto transport=entry.find("transport"); transport != entry.end())
+				if (eventSubscription.transport)
 				{
-					QJsonObject transportObject=transport->toObject();
-					auto disconnectTime=transportObject.find("disconnected_at");
-					if (disconnectTime == transportObject.end()) continue;
-					if (disconnectTime->toVariant().toDateTime().toLocalTime() < QDateTime::currentDateTime()) continue; // FIXME: Not sure what's happening here, but the expiration date on EVERY subscription is older than the current date
+					if (eventSubscription.transport->disconnectedAt.isEmpty()) continue;
+					if (QDateTime::fromString(eventSubscription.transport->disconnectedAt,Qt::ISODate).toLocalTime() < QDateTime::currentDateTime()) continue; // FIXME: Not sure what's happening here, but the expiration date on EVERY subscription is older than the current date
 				}
-				if (id.isEmpty() || type.isEmpty() || !date.isValid()) continue;
+				if (eventSubscription.id.isEmpty() || eventSubscription.type.isEmpty()) continue;
 
-				emit EventSubscription(id,type,date,QString());
+				emit EventSubscription(eventSubscription.id,eventSubscription.type,eventSubscription.createdAt,QString());
 			}
 		}
+
+		catch (const JSON::Error &exception)
+		{
+			emit Print(QString("Invalid JSON: %1").arg(exception.what()),TWITCH_API_OPERATION_SUBSCRIPTION_LIST);
+		}
 	},{},{
 		{NETWORK_HEADER_AUTHORIZATION,security.Bearer(security.OAuthToken())},
 		{NETWORK_HEADER_CLIENT_ID,security.ClientID()}
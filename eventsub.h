@@ -14,6 +14,7 @@ inline const char *SUBSCRIPTION_TYPE_CHEER="channel.cheer";
 inline const char *SUBSCRIPTION_TYPE_RAID="channel.raid";
 inline const char *SUBSCRIPTION_TYPE_SUBSCRIPTION="channel.subscribe";
 inline const char *SUBSCRIPTION_TYPE_RESUBSCRIPTION="channel.subscription.message";
+inline const char *SUBSCRIPTION_TYPE_GIFT_SUBSCRIPTION="channel.subscription.gift";
 inline const char *SUBSCRIPTION_TYPE_HYPE_TRAIN_START="channel.hype_train.begin";
 inline const char *SUBSCRIPTION_TYPE_HYPE_TRAIN_PROGRESS="channel.hype_train.progress";
 inline const char *SUBSCRIPTION_TYPE_HYPE_TRAIN_END="channel.hype_train.end";
@@ -33,6 +34,7 @@ enum class SubscriptionType
 	CHANNEL_CHEER,
 	CHANNEL_RAID,
 	CHANNEL_SUBSCRIPTION,
+	CHANNEL_GIFT_SUBSCRIPTION,
 	CHANNEL_HYPE_TRAIN
 };
 
@@ -72,6 +74,7 @@ signals:
 	void Raid(const QString &raider,const unsigned int viewers);
 	void HypeTrain(int level,double progress);
 	void ChannelSubscription(const QString &login,const QString &displayName);
+	void GiftSubscription(const QString &gifter,const unsigned int count);
 	void EventSubscription(const QString &id,const QString &type,const QDateTime &creationDate,const QString &callbackURL);
 	void EventSubscriptionRemoved(const QString &id);
 	void ParseCommand(JSON::SignalPayload *payload,const QString &name,const QString &login);
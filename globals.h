@@ -95,22 +95,6 @@ namespace StringConvert
 		return QString("> (data)");
 #endif
 	}
-
-	inline int RestrictFontWidth(QFont font,const QString &text,int maxPixels)
-	{
-		int originalPointSize=font.pointSize();
-		QFontMetrics metrics{font};
-		QRect bounds=metrics.boundingRect(text);
-		while (bounds.width() > maxPixels)
-		{
-			int reducedPointSize=font.pointSize()-1;
-			if (reducedPointSize < 1) return originalPointSize;
-			font.setPointSize(reducedPointSize);
-			metrics=QFontMetrics{font};
-			bounds=metrics.boundingRect(text);
-		}
-		return font.pointSize();
-	}
 }
 
 namespace TimeConvert
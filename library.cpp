@@ -0,0 +1,726 @@
+#include <QSaveFile>
+#include <QDataStream>
+#include <QBuffer>
+#include <QImageReader>
+#include <QCoreApplication>
+#include <unordered_set>
+#include <array>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <numbers>
+#include "library.h"
+#include "globals.h"
+#include "cache.h"
+#include "decode.h"
+
+const char *SETTINGS_CATEGORY_LIBRARY="Library";
+const char *OPERATION_ANALYZE_LOUDNESS="analyze loudness";
+const char *LIBRARY_INDEX_FILENAME="library";
+const quint32 LIBRARY_INDEX_MAGIC=0x43454c4c; // "CELL"
+const quint32 LIBRARY_INDEX_VERSION=2;
+const qsizetype LIBRARY_SCAN_CHUNK=256;
+const int LIBRARY_THUMBNAIL_SIZE=128;
+const double LIBRARY_SEARCH_THRESHOLD=0.4; // share of the query's pieces a song has to have to count as a match at all
+const int LIBRARY_SAVE_INTERVAL=64; // songs analyzed between saves, so a long first analysis isn't lost to a crash
+const quint32 LIBRARY_RESERVE_LIMIT=65536; // a damaged count shouldn't turn into a huge allocation before the read fails
+
+namespace Music
+{
+	QString SearchIndex::Fold(const QString &text)
+	{
+		// decomposing first leaves accents as separate marks, which are dropped
+		const QString decomposed=text.normalized(QString::NormalizationForm_KD);
+		QString folded;
+		folded.reserve(decomposed.size()+2);
+		folded.append(' ');
+		for (const QChar character : decomposed)
+		{
+			if (character.isLetterOrNumber())
+				folded.append(character.toCaseFolded());
+			else if (!character.isMark() && !folded.endsWith(' '))
+				folded.append(' ');
+		}
+		if (!folded.endsWith(' ')) folded.append(' ');
+		return folded;
+	}
+
+	std::vector<quint64> SearchIndex::Trigrams(const QString &text)
+	{
+		std::vector<quint64> trigrams;
+		trigrams.reserve(text.size());
+		for (qsizetype position=0; position+3 <= text.size(); position++)
+			trigrams.push_back((static_cast<quint64>(text.at(position).unicode()) << 32)|(static_cast<quint64>(text.at(position+1).unicode()) << 16)|static_cast<quint64>(text.at(position+2).unicode()));
+		std::sort(trigrams.begin(),trigrams.end());
+		trigrams.erase(std::unique(trigrams.begin(),trigrams.end()),trigrams.end());
+		return trigrams;
+	}
+
+	void SearchIndex::Rebuild(const std::vector<Track> &tracks)
+	{
+		entries.clear();
+		postings.clear();
+		for (const Track &track : tracks)
+		{
+			if (track.title.isEmpty()) continue;
+			const std::vector<quint64> trigrams=Trigrams(Fold(track.title+' '+track.artist));
+			const quint32 entry=static_cast<quint32>(entries.size());
+			entries.push_back({.path=track.path,.title=track.title,.artist=track.artist,.trigrams=static_cast<quint32>(trigrams.size())});
+			for (quint64 trigram : trigrams) postings[trigram].push_back(entry);
+		}
+		shared.assign(entries.size(),0);
+		touched.clear();
+	}
+
+	std::vector<SearchIndex::Match> SearchIndex::Search(const QString &query,size_t limit)
+	{
+		const std::vector<quint64> trigrams=Trigrams(Fold(query));
+		if (trigrams.empty() || limit < 1) return {};
+
+		touched.clear();
+		for (quint64 trigram : trigrams)
+		{
+			auto candidate=postings.find(trigram);
+			if (candidate == postings.end()) continue;
+			for (quint32 entry : candidate->second)
+			{
+				if (shared[entry]++ == 0) touched.push_back(entry);
+			}
+		}
+
+		// mostly how much of the query was found, which lets a couple of words from a long title rank well, with how closely the whole thing matches breaking ties
+		std::vector<Match> matches;
+		for (quint32 entry : touched)
+		{
+			const Entry &candidate=entries[entry];
+			const double coverage=static_cast<double>(shared[entry])/trigrams.size();
+			const double similarity=2.0*shared[entry]/(trigrams.size()+candidate.trigrams);
+			shared[entry]=0;
+			if (coverage < LIBRARY_SEARCH_THRESHOLD) continue;
+			matches.push_back({.path=candidate.path,.title=candidate.title,.artist=candidate.artist,.score=coverage*0.75+similarity*0.25});
+		}
+
+		const size_t kept=std::min(limit,matches.size());
+		std::partial_sort(matches.begin(),matches.begin()+kept,matches.end(),[](const Match &first,const Match &second) {
+			return first.score > second.score;
+		});
+		matches.resize(kept);
+		return matches;
+	}
+
+	size_t SearchIndex::Size() const
+	{
+		return entries.size();
+	}
+
+	LoudnessMeter::LoudnessMeter(int sampleRate,int channels) : sampleRate(sampleRate),
+		channels(channels),
+		states(channels),
+		segmentFrames(std::max(sampleRate/10,1)),
+		segmentFrame(0),
+		segmentEnergy(0)
+	{
+		// the standard only lists coefficients for 48 kHz, these are worked out from the filters' analog prototypes for any rate
+		double frequency=1681.974450955533;
+		double q=0.7071752369554196;
+		double k=std::tan(std::numbers::pi*frequency/sampleRate);
+		const double highGain=std::pow(10.0,3.999843853973347/20);
+		const double bandGain=std::pow(highGain,0.4996667741545416);
+		double a0=1+k/q+k*k;
+		shelf={
+			.b0=(highGain+bandGain*k/q+k*k)/a0,
+			.b1=2*(k*k-highGain)/a0,
+			.b2=(highGain-bandGain*k/q+k*k)/a0,
+			.a1=2*(k*k-1)/a0,
+			.a2=(1-k/q+k*k)/a0
+		};
+
+		frequency=38.13547087602444;
+		q=0.5003270373238773;
+		k=std::tan(std::numbers::pi*frequency/sampleRate);
+		a0=1+k/q+k*k;
+		highPass={
+			.b0=1,
+			.b1=-2,
+			.b2=1,
+			.a1=2*(k*k-1)/a0,
+			.a2=(1-k/q+k*k)/a0
+		};
+	}
+
+	int LoudnessMeter::SampleRate() const
+	{
+		return sampleRate;
+	}
+
+	int LoudnessMeter::Channels() const
+	{
+		return channels;
+	}
+
+	double LoudnessMeter::Filter(const Biquad &filter,double (&state)[2],double sample)
+	{
+		const double output=filter.b0*sample+state[0];
+		state[0]=filter.b1*sample-filter.a1*output+state[1];
+		state[1]=filter.b2*sample-filter.a2*output;
+		return output;
+	}
+
+	void LoudnessMeter::Add(const QAudioBuffer &buffer)
+	{
+		// songs are stereo, so every channel is weighted equally rather than boosting surrounds and skipping LFE
+		const QAudioFormat format=buffer.format();
+		const char *data=buffer.constData<char>();
+		const int bytesPerSample=format.bytesPerSample();
+		const int bytesPerFrame=format.bytesPerFrame();
+		for (qsizetype frame=0; frame < buffer.frameCount(); frame++)
+		{
+			const char *samples=data+frame*bytesPerFrame;
+			double energy=0;
+			for (int channel=0; channel < channels; channel++)
+			{
+				const double filtered=Filter(highPass,states[channel].highPass,Filter(shelf,states[channel].shelf,format.normalizedSampleValue(samples+channel*bytesPerSample)));
+				energy+=filtered*filtered;
+			}
+			segmentEnergy+=energy;
+			if (++segmentFrame == segmentFrames)
+			{
+				segments.push_back(segmentEnergy/segmentFrames);
+				segmentEnergy=0;
+				segmentFrame=0;
+			}
+		}
+	}
+
+	double LoudnessMeter::Integrated() const
+	{
+		static constexpr double ABSOLUTE_GATE=-70; // LUFS
+		static constexpr double RELATIVE_GATE=-10; // LU below the loudness of the blocks that pass the absolute gate
+
+		// 400 ms blocks overlapping by 75%, which is four of the 100 ms segments stepping one at a time
+		std::vector<double> blocks;
+		for (size_t end=3; end < segments.size(); end++) blocks.push_back((segments[end-3]+segments[end-2]+segments[end-1]+segments[end])/4);
+
+		const auto gate=[&blocks](double threshold) -> std::optional<double> {
+			double sum=0;
+			size_t count=0;
+			for (double block : blocks)
+			{
+				if (block <= threshold) continue;
+				sum+=block;
+				count++;
+			}
+			if (count < 1) return std::nullopt;
+			return sum/count;
+		};
+		const double absolute=std::pow(10.0,(ABSOLUTE_GATE+0.691)/10);
+		std::optional<double> mean=gate(absolute);
+		if (mean) mean=gate(std::max(absolute,*mean*std::pow(10.0,RELATIVE_GATE/10)));
+		if (!mean) return -std::numeric_limits<double>::infinity();
+		return -0.691+10*std::log10(*mean);
+	}
+
+	LoudnessAnalyzer::LoudnessAnalyzer(int load,QObject *parent) : QObject(parent),
+		decoder(nullptr),
+		rest(this), // parented so it follows the analyzer onto the analysis thread, where it's started
+		load(std::clamp(load,1,100))
+	{
+		rest.setSingleShot(true);
+		connect(&rest,&QTimer::timeout,this,&LoudnessAnalyzer::Next);
+	}
+
+	void LoudnessAnalyzer::Queue(const QStringList &paths)
+	{
+		pending.assign(paths.begin(),paths.end());
+		std::erase(pending,path); // already being measured
+		if (path.isEmpty() && !rest.isActive()) Next();
+	}
+
+	void LoudnessAnalyzer::Next()
+	{
+		if (pending.empty())
+		{
+			emit Idle();
+			return;
+		}
+
+		// created here rather than in the constructor so it belongs to the analysis thread
+		if (!decoder)
+		{
+			decoder=new QAudioDecoder(this);
+			connect(decoder,&QAudioDecoder::bufferReady,this,&LoudnessAnalyzer::Decoded);
+			connect(decoder,&QAudioDecoder::finished,this,&LoudnessAnalyzer::Finish);
+			connect(decoder,QOverload<QAudioDecoder::Error>::of(&QAudioDecoder::error),this,&LoudnessAnalyzer::Fail);
+		}
+
+		path=pending.front();
+		pending.pop_front();
+		meter.reset();
+		clock.start();
+		decoder->setSource(QUrl::fromLocalFile(path));
+		decoder->start();
+	}
+
+	void LoudnessAnalyzer::Decoded()
+	{
+		const QAudioBuffer buffer=decoder->read();
+		const QAudioFormat format=buffer.format();
+		if (!buffer.isValid() || format.channelCount() < 1 || format.sampleRate() < 1) return;
+		if (!meter) meter=std::make_unique<LoudnessMeter>(format.sampleRate(),format.channelCount());
+		if (format.sampleRate() != meter->SampleRate() || format.channelCount() != meter->Channels()) return;
+		meter->Add(buffer);
+	}
+
+	void LoudnessAnalyzer::Finish()
+	{
+		if (path.isEmpty()) return;
+		emit Analyzed(path,meter ? meter->Integrated() : -std::numeric_limits<double>::infinity());
+		path.clear();
+		meter.reset();
+
+		// rest in proportion to how long that took, which keeps the average below the configured share of one core
+		rest.start(static_cast<int>(clock.elapsed()*(100-load)/load));
+	}
+
+	void LoudnessAnalyzer::Fail(QAudioDecoder::Error error)
+	{
+		Q_UNUSED(error)
+		if (path.isEmpty()) return;
+		emit Failed(path,decoder->errorString());
+		decoder->stop();
+		path.clear();
+		meter.reset();
+		rest.start(static_cast<int>(clock.elapsed()*(100-load)/load));
+	}
+
+	bool Track::Current(const QFileInfo &file) const
+	{
+		return size == file.size() && modified == file.lastModified().toMSecsSinceEpoch();
+	}
+
+	Metadata Track::Metadata() const
+	{
+		return {
+			.title=title,
+			.album=album,
+			.artist=artist,
+			.path=path,
+			.cover=cover,
+			.valid=true
+		};
+	}
+
+	Library::Library(QObject *parent) : QObject(parent),
+		index(Filesystem::DataPath().filePath(LIBRARY_INDEX_FILENAME)),
+		generation(0),
+		pendingChunks(0),
+		changed(0),
+		analyzer(nullptr),
+		unsaved(0),
+		settingStartupBudget(SETTINGS_CATEGORY_LIBRARY,"StartupBudget",250), // milliseconds
+		settingAnalysisLoad(SETTINGS_CATEGORY_LIBRARY,"AnalysisLoad",25) // percent of one core
+	{
+		analyzer=new LoudnessAnalyzer(settingAnalysisLoad);
+		analyzer->moveToThread(&analysis);
+		connect(&analysis,&QThread::finished,analyzer,&QObject::deleteLater);
+		connect(analyzer,&LoudnessAnalyzer::Analyzed,this,&Library::Analyzed);
+		connect(analyzer,&LoudnessAnalyzer::Failed,this,[this](const QString &path,const QString &error) {
+			emit Print(QString("Failed to measure loudness of %1: %2").arg(path,error),OPERATION_ANALYZE_LOUDNESS);
+			Analyzed(path,std::numeric_limits<double>::quiet_NaN()); // not tried again until the file changes
+		});
+		connect(analyzer,&LoudnessAnalyzer::Idle,this,[this]() {
+			if (unsaved > 0) Save();
+		});
+		analysis.start(QThread::LowestPriority);
+
+		// a rescan or analysis still running at exit has nowhere to deliver its results
+		connect(QCoreApplication::instance(),&QCoreApplication::aboutToQuit,this,&Library::Stop);
+	}
+
+	Library::~Library()
+	{
+		Stop();
+	}
+
+	void Library::Stop()
+	{
+		generation++;
+		scanners.clear();
+		scanners.waitForDone();
+		if (analysis.isRunning())
+		{
+			analysis.quit();
+			analysis.wait();
+		}
+		if (unsaved > 0) Save();
+	}
+
+	Library& Library::Shared()
+	{
+		static Library library;
+		return library;
+	}
+
+	ApplicationSetting& Library::StartupBudget()
+	{
+		return settingStartupBudget;
+	}
+
+	ApplicationSetting& Library::AnalysisLoad()
+	{
+		return settingAnalysisLoad;
+	}
+
+	int Library::Count() const
+	{
+		return static_cast<int>(tracks.size());
+	}
+
+	bool Library::Load()
+	{
+		static const char *OPERATION="load";
+
+		QElapsedTimer clock;
+		clock.start();
+
+		if (!index.exists())
+		{
+			emit Print("No library index yet, every song will be scanned",OPERATION);
+			return true;
+		}
+
+		if (!index.open(QIODevice::ReadOnly))
+		{
+			emit Print(QString("Failed to open library index %1: %2").arg(index.fileName(),index.errorString()),OPERATION);
+			return false;
+		}
+
+		QDataStream stream(&index);
+		stream.setVersion(QDataStream::Qt_6_0);
+		quint32 magic=0;
+		quint32 version=0;
+		quint32 count=0;
+		stream >> magic >> version >> count;
+		if (stream.status() != QDataStream::Ok || magic != LIBRARY_INDEX_MAGIC || version != LIBRARY_INDEX_VERSION)
+		{
+			index.close();
+			emit Print("Library index is damaged or from a different version, every song will be scanned again",OPERATION);
+			return false;
+		}
+
+		tracks.clear();
+		lookup.clear();
+		tracks.reserve(std::min(count,LIBRARY_RESERVE_LIMIT));
+		lookup.reserve(std::min(count,LIBRARY_RESERVE_LIMIT));
+		for (quint32 entry=0; entry < count; entry++)
+		{
+			Track track;
+			stream >> track.path >> track.size >> track.modified >> track.title >> track.album >> track.artist >> track.duration >> track.cover >> track.analyzed >> track.loudness;
+			if (stream.status() != QDataStream::Ok) break;
+			lookup[track.path]=tracks.size();
+			tracks.push_back(std::move(track));
+		}
+		index.close();
+
+		if (stream.status() != QDataStream::Ok)
+		{
+			tracks.clear();
+			lookup.clear();
+			emit Print("Library index is truncated, every song will be scanned again",OPERATION);
+			return false;
+		}
+
+		search.Rebuild(tracks);
+		const qint64 elapsed=clock.elapsed();
+		emit Print(QString("%1 songs in %2 ms").arg(StringConvert::Integer(Count()),QString::number(elapsed)),OPERATION);
+		if (elapsed > static_cast<int>(settingStartupBudget)) emit Print(QString("Loading the library took longer than the startup budget of %1 ms").arg(static_cast<int>(settingStartupBudget)),OPERATION);
+		return true;
+	}
+
+	bool Library::Save()
+	{
+		static const char *OPERATION="save";
+
+		const QDir directory=Filesystem::DataPath();
+		if (!directory.mkpath(directory.absolutePath()))
+		{
+			emit Print(QString("Failed to create directory %1").arg(directory.absolutePath()),OPERATION);
+			return false;
+		}
+
+		QSaveFile file(index.fileName());
+		if (!file.open(QIODevice::WriteOnly))
+		{
+			emit Print(QString("Failed to open library index %1: %2").arg(file.fileName(),file.errorString()),OPERATION);
+			return false;
+		}
+
+		QDataStream stream(&file);
+		stream.setVersion(QDataStream::Qt_6_0);
+		stream << LIBRARY_INDEX_MAGIC << LIBRARY_INDEX_VERSION << static_cast<quint32>(tracks.size());
+		for (const Track &track : tracks) stream << track.path << track.size << track.modified << track.title << track.album << track.artist << track.duration << track.cover << track.analyzed << track.loudness;
+		if (stream.status() != QDataStream::Ok || !file.commit())
+		{
+			emit Print(QString("Failed to write library index %1: %2").arg(file.fileName(),file.errorString()),OPERATION);
+			return false;
+		}
+		unsaved=0;
+		return true;
+	}
+
+	const Track* Library::Find(const QString &path,const QFileInfo &file) const
+	{
+		auto candidate=lookup.find(path);
+		if (candidate == lookup.end()) return nullptr;
+		const Track &track=tracks[candidate->second];
+		if (!track.Current(file)) return nullptr;
+		return &track;
+	}
+
+	QImage Library::Thumbnail(const QString &path)
+	{
+		auto candidate=lookup.find(path);
+		if (candidate == lookup.end() || !tracks[candidate->second].cover) return {};
+		return Cache::Assets::Shared().Image(ThumbnailKey(path));
+	}
+
+	std::optional<double> Library::Loudness(const QString &path) const
+	{
+		auto candidate=lookup.find(path);
+		if (candidate == lookup.end()) return std::nullopt;
+		const Track &track=tracks[candidate->second];
+		if (!track.analyzed || !std::isfinite(track.loudness)) return std::nullopt;
+		return track.loudness;
+	}
+
+	std::vector<SearchIndex::Match> Library::Search(const QString &query,size_t limit)
+	{
+		return search.Search(query,limit);
+	}
+
+	QSize Library::ThumbnailSize()
+	{
+		return {LIBRARY_THUMBNAIL_SIZE,LIBRARY_THUMBNAIL_SIZE};
+	}
+
+	QString Library::ThumbnailKey(const QString &path)
+	{
+		return QString(Cache::KEY_COVER).arg(path);
+	}
+
+	void Library::Rescan(const QStringList &paths)
+	{
+		// results from a rescan that's been superseded are thrown away when they arrive
+		generation++;
+		pendingChunks=0;
+		changed=0;
+		scanned=paths;
+		scanClock.start();
+
+		for (qsizetype start=0; start < paths.size(); start+=LIBRARY_SCAN_CHUNK)
+		{
+			const QStringList chunk=paths.mid(start,LIBRARY_SCAN_CHUNK);
+			std::unordered_map<QString,Stat> known;
+			for (const QString &path : chunk)
+			{
+				if (auto candidate=lookup.find(path); candidate != lookup.end()) known.emplace(path,Stat{.size=tracks[candidate->second].size,.modified=tracks[candidate->second].modified});
+			}
+
+			pendingChunks++;
+			scanners.start([this,chunk,known=std::move(known),generation=generation]() {
+				std::vector<Result> results;
+				QStringList missing;
+				for (const QString &path : chunk)
+				{
+					const QFileInfo file(path);
+					if (!file.exists())
+					{
+						missing.append(path);
+						continue;
+					}
+					if (auto candidate=known.find(path); candidate != known.end() && candidate->second.size == file.size() && candidate->second.modified == file.lastModified().toMSecsSinceEpoch()) continue;
+					Result result;
+					result.track=Scan(path,file,&result.thumbnail);
+					results.push_back(std::move(result));
+				}
+				QMetaObject::invokeMethod(this,[this,generation,results=std::move(results),missing]() mutable {
+					Scanned(generation,std::move(results),missing);
+				},Qt::QueuedConnection);
+			});
+		}
+
+		if (pendingChunks == 0) Prune();
+	}
+
+	void Library::Scanned(int scan,std::vector<Result> results,const QStringList &missing)
+	{
+		if (scan != generation) return;
+
+		for (Result &result : results) Update(std::move(result.track),result.thumbnail);
+		changed+=static_cast<int>(results.size());
+		for (const QString &path : missing) scanned.removeOne(path);
+		if (--pendingChunks == 0) Prune();
+	}
+
+	void Library::Update(Track track,const QByteArray &thumbnail)
+	{
+		if (!thumbnail.isEmpty()) track.cover=Cache::Assets::Shared().Store(ThumbnailKey(track.path),thumbnail).has_value();
+		if (auto candidate=lookup.find(track.path); candidate != lookup.end())
+		{
+			tracks[candidate->second]=std::move(track);
+			return;
+		}
+		lookup[track.path]=tracks.size();
+		tracks.push_back(std::move(track));
+	}
+
+	void Library::Prune()
+	{
+		static const char *OPERATION="rescan";
+
+		// anything that wasn't in the list, or whose file is gone, is dropped
+		const std::unordered_set<QString> keep(scanned.begin(),scanned.end());
+		const size_t before=tracks.size();
+		std::erase_if(tracks,[&keep](const Track &track) {
+			return !keep.contains(track.path);
+		});
+		const int removed=static_cast<int>(before-tracks.size());
+		lookup.clear();
+		for (size_t position=0; position < tracks.size(); position++) lookup[tracks[position].path]=position;
+		scanned.clear();
+
+		const qint64 elapsed=scanClock.elapsed();
+		emit Print(QString("%1 songs, %2 changed, %3 removed, in %4 ms").arg(StringConvert::Integer(Count()),StringConvert::Integer(changed),StringConvert::Integer(removed),QString::number(elapsed)),OPERATION);
+		if (changed > 0 || removed > 0)
+		{
+			search.Rebuild(tracks);
+			Save();
+		}
+		emit Rescanned(changed,removed,elapsed);
+		Analyze();
+	}
+
+	void Library::Analyze()
+	{
+		QStringList paths;
+		for (const Track &track : tracks)
+		{
+			if (!track.analyzed) paths.append(track.path);
+		}
+		if (paths.isEmpty()) return;
+
+		emit Print(QString("Measuring the loudness of %1 songs in the background").arg(StringConvert::Integer(static_cast<int>(paths.size()))),OPERATION_ANALYZE_LOUDNESS);
+		QMetaObject::invokeMethod(analyzer,[analyzer=analyzer,paths]() {
+			analyzer->Queue(paths);
+		},Qt::QueuedConnection);
+	}
+
+	void Library::Analyzed(const QString &path,double loudness)
+	{
+		auto candidate=lookup.find(path);
+		if (candidate == lookup.end()) return; // dropped by a rescan while it was being measured
+		Track &track=tracks[candidate->second];
+		track.analyzed=true;
+		track.loudness=loudness;
+		if (++unsaved >= LIBRARY_SAVE_INTERVAL) Save();
+	}
+
+	Track Library::Scan(const QString &path,const QFileInfo &file,QByteArray *thumbnail)
+	{
+		// touches nothing but the file, so it's safe to call from any thread
+		Track track{
+			.path=path,
+			.size=file.size(),
+			.modified=file.lastModified().toMSecsSinceEpoch(),
+			.duration=Duration(path)
+		};
+
+		try
+		{
+			ID3::Tag tag(path);
+			if (auto title=tag.Title(); title) track.title=*title;
+			if (auto album=tag.AlbumTitle(); album) track.album=*album;
+			if (auto artist=tag.Artist(); artist) track.artist=*artist;
+			if (!thumbnail) return track;
+			if (auto picture=tag.AlbumCoverFront(); picture)
+			{
+				QBuffer source;
+				source.setData(*picture);
+				QImageReader reader(&source);
+				const QImage image=Decode::Pool::Read(reader,ThumbnailSize());
+				if (!image.isNull())
+				{
+					QBuffer encoded(thumbnail);
+					encoded.open(QIODevice::WriteOnly);
+					image.save(&encoded,"JPG",85);
+				}
+			}
+		}
+
+		catch (const std::exception &exception)
+		{
+			// untagged songs are still indexed so they aren't opened again on every rescan
+			Q_UNUSED(exception)
+		}
+
+		return track;
+	}
+
+	qint64 Library::Duration(const QString &path)
+	{
+		// bitrates in kilobits per second, for layer III
+		static constexpr std::array<int,16> MPEG1_BITRATES{0,32,40,48,56,64,80,96,112,128,160,192,224,256,320,0};
+		static constexpr std::array<int,16> MPEG2_BITRATES{0,8,16,24,32,40,48,56,64,80,96,112,128,144,160,0};
+		static constexpr std::array<int,3> MPEG1_SAMPLE_RATES{44100,48000,32000};
+		static constexpr qint64 SEARCH_LIMIT=8192;
+
+		QFile file(path);
+		if (!file.open(QIODevice::ReadOnly)) return 0;
+
+		// skip past the ID3 tag, the first frame is right after it
+		qint64 audioStart=0;
+		const QByteArray prefix=file.read(ID3::Header::LENGTH);
+		if (prefix.size() == ID3::Header::LENGTH && prefix.startsWith("ID3"))
+		{
+			audioStart=ID3::Header::LENGTH+ID3::SyncSafe(prefix.constData()+6);
+			if (prefix.at(5) & 0x10) audioStart+=ID3::Header::LENGTH; // footer
+		}
+		if (!file.seek(audioStart)) return 0;
+		const QByteArray data=file.read(SEARCH_LIMIT);
+
+		for (qsizetype position=0; position+4 <= data.size(); position++)
+		{
+			const auto byte=[&data,position](qsizetype offset) { return static_cast<quint8>(data.at(position+offset)); };
+			if (byte(0) != 0xff || (byte(1) & 0xe0) != 0xe0) continue;
+
+			const int version=(byte(1) >> 3) & 0x03; // 3 is MPEG 1, 2 is MPEG 2, 0 is MPEG 2.5
+			const int layer=(byte(1) >> 1) & 0x03; // 1 is layer III
+			const int bitrateIndex=byte(2) >> 4;
+			const int sampleRateIndex=(byte(2) >> 2) & 0x03;
+			if (version == 1 || layer != 1 || bitrateIndex == 0 || bitrateIndex == 15 || sampleRateIndex == 3) continue;
+
+			const bool mpeg1=version == 3;
+			const bool mono=(byte(3) >> 6) == 3;
+			const int bitrate=(mpeg1 ? MPEG1_BITRATES : MPEG2_BITRATES)[bitrateIndex];
+			const int sampleRate=MPEG1_SAMPLE_RATES[sampleRateIndex]/(mpeg1 ? 1 : version == 2 ? 2 : 4);
+			const int samplesPerFrame=mpeg1 ? 1152 : 576;
+
+			// variable bitrate files say how many frames they have, either in a Xing/Info header or a VBRI header
+			const qsizetype xing=position+4+(mpeg1 ? (mono ? 17 : 32) : (mono ? 9 : 17));
+			if (xing+12 <= data.size())
+			{
+				const QByteArray identifier=data.sliced(xing,4);
+				if ((identifier == "Xing" || identifier == "Info") && (ID3::BigEndian(data.constData()+xing+4) & 0x01))
+					return static_cast<qint64>(ID3::BigEndian(data.constData()+xing+8))*samplesPerFrame*1000/sampleRate;
+			}
+			const qsizetype vbri=position+36;
+			if (vbri+18 <= data.size() && data.sliced(vbri,4) == "VBRI")
+				return static_cast<qint64>(ID3::BigEndian(data.constData()+vbri+14))*samplesPerFrame*1000/sampleRate;
+
+			// otherwise it's constant bitrate and the length follows from the size of the audio
+			return (file.size()-audioStart-position)*8/bitrate;
+		}
+
+		return 0;
+	}
+}
@@ -0,0 +1,223 @@
+#pragma once
+
+#include <QObject>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QImage>
+#include <QThreadPool>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QTimer>
+#include <QAudioDecoder>
+#include <QAudioBuffer>
+#include <unordered_map>
+#include <optional>
+#include <vector>
+#include <deque>
+#include <memory>
+#include "settings.h"
+#include "entities.h"
+
+namespace Music
+{
+	struct Track
+	{
+		QString path;
+		qint64 size=0;
+		qint64 modified=0; // milliseconds since the epoch, so it round trips through the index exactly
+		QString title;
+		QString album;
+		QString artist;
+		qint64 duration=0; // milliseconds, 0 when it couldn't be worked out from the file
+		bool cover=false; // whether a thumbnail was stored with the asset cache
+		bool analyzed=false;
+		double loudness=0; // integrated, in LUFS, not finite when the song couldn't be decoded or is silent
+		bool Current(const QFileInfo &file) const;
+		struct Metadata Metadata() const;
+	};
+
+	/*!
+	 * \brief Finds songs by title and artist even when they're misspelled or only partly given
+	 *
+	 * Every song's title and artist are folded to lowercase without accents
+	 * or punctuation and broken into overlapping three character pieces.
+	 * Each piece maps to the list of songs it appears in, so a search only
+	 * visits the songs that share at least one piece with the query, and
+	 * ranks them by how much of both they share.
+	 */
+	class SearchIndex
+	{
+	public:
+		struct Match
+		{
+			QString path;
+			QString title;
+			QString artist;
+			double score; // between 0 and 1, 1 being every piece in common
+		};
+		void Rebuild(const std::vector<Track> &tracks);
+		std::vector<Match> Search(const QString &query,size_t limit);
+		size_t Size() const;
+		static QString Fold(const QString &text);
+		static std::vector<quint64> Trigrams(const QString &text);
+	protected:
+		struct Entry
+		{
+			QString path;
+			QString title;
+			QString artist;
+			quint32 trigrams;
+		};
+		std::vector<Entry> entries;
+		std::unordered_map<quint64,std::vector<quint32>> postings;
+		std::vector<quint16> shared; // scratch for counting, sized to the entries so a search doesn't allocate
+		std::vector<quint32> touched;
+	};
+
+	/*!
+	 * \brief Measures the integrated loudness of a song the way EBU R128 (ITU-R BS.1770) does
+	 *
+	 * Samples go through the K-weighting filters and their mean square is
+	 * kept for every 100 ms. Those are combined into overlapping 400 ms
+	 * blocks at the end, which are gated first at -70 LUFS and then at 10 LU
+	 * below the loudness of what's left, so quiet passages and silence don't
+	 * drag the result down.
+	 */
+	class LoudnessMeter
+	{
+	public:
+		LoudnessMeter(int sampleRate,int channels);
+		void Add(const QAudioBuffer &buffer);
+		double Integrated() const;
+		int SampleRate() const;
+		int Channels() const;
+	protected:
+		struct Biquad
+		{
+			double b0;
+			double b1;
+			double b2;
+			double a1;
+			double a2;
+		};
+		struct State
+		{
+			double shelf[2]={0,0};
+			double highPass[2]={0,0};
+		};
+		int sampleRate;
+		int channels;
+		Biquad shelf;
+		Biquad highPass;
+		std::vector<State> states;
+		std::vector<double> segments;
+		qsizetype segmentFrames;
+		qsizetype segmentFrame;
+		double segmentEnergy;
+		static double Filter(const Biquad &filter,double (&state)[2],double sample);
+	};
+
+	/*!
+	 * \brief Works through songs one at a time on a low priority thread, measuring their loudness
+	 *
+	 * After each song it rests long enough that the time spent decoding
+	 * stays under the configured share of the time that's passed, so a
+	 * library being analyzed for the first time doesn't compete with the
+	 * stream for CPU.
+	 */
+	class LoudnessAnalyzer : public QObject
+	{
+		Q_OBJECT
+	public:
+		LoudnessAnalyzer(int load,QObject *parent=nullptr);
+		void Queue(const QStringList &paths);
+	protected:
+		QAudioDecoder *decoder;
+		std::deque<QString> pending;
+		QString path;
+		std::unique_ptr<LoudnessMeter> meter;
+		QElapsedTimer clock;
+		QTimer rest;
+		int load;
+		void Next();
+		void Decoded();
+		void Finish();
+		void Fail(QAudioDecoder::Error error);
+	signals:
+		void Analyzed(const QString &path,double loudness);
+		void Failed(const QString &path,const QString &error);
+		void Idle();
+	};
+
+	/*!
+	 * \brief Remembers the tags, length, and cover of every song that's been scanned
+	 *
+	 * The index is a single file under the data path that's read in one pass
+	 * at startup, so nothing has to open a song to answer what it is. A
+	 * rescan only stats the songs it's given on worker threads and reads the
+	 * tags of the ones whose size or modification time changed since they
+	 * were indexed. Songs that are no longer in the list are dropped. Cover
+	 * thumbnails live in the asset cache rather than the index, which keeps
+	 * the index small enough to load within the startup budget. Songs that
+	 * haven't had their loudness measured are handed to the analyzer once a
+	 * rescan is done.
+	 */
+	class Library : public QObject
+	{
+		Q_OBJECT
+	public:
+		Library(QObject *parent=nullptr);
+		~Library();
+		bool Load();
+		bool Save();
+		void Rescan(const QStringList &paths);
+		const Track* Find(const QString &path,const QFileInfo &file) const;
+		QImage Thumbnail(const QString &path);
+		std::optional<double> Loudness(const QString &path) const;
+		std::vector<SearchIndex::Match> Search(const QString &query,size_t limit=1);
+		int Count() const;
+		ApplicationSetting& StartupBudget();
+		ApplicationSetting& AnalysisLoad();
+		static Track Scan(const QString &path,const QFileInfo &file,QByteArray *thumbnail=nullptr);
+		static qint64 Duration(const QString &path);
+		static QSize ThumbnailSize();
+		static Library& Shared();
+	protected:
+		struct Stat
+		{
+			qint64 size;
+			qint64 modified;
+		};
+		struct Result
+		{
+			Track track;
+			QByteArray thumbnail;
+		};
+		QFile index;
+		std::vector<Track> tracks;
+		std::unordered_map<QString,size_t> lookup;
+		SearchIndex search;
+		QThreadPool scanners;
+		int generation;
+		int pendingChunks;
+		int changed;
+		QStringList scanned;
+		QElapsedTimer scanClock;
+		QThread analysis;
+		LoudnessAnalyzer *analyzer;
+		int unsaved;
+		ApplicationSetting settingStartupBudget;
+		ApplicationSetting settingAnalysisLoad;
+		void Update(Track track,const QByteArray &thumbnail);
+		void Scanned(int scan,std::vector<Result> results,const QStringList &missing);
+		void Prune();
+		void Analyze();
+		void Analyzed(const QString &path,double loudness);
+		void Stop();
+		static QString ThumbnailKey(const QString &path);
+	signals:
+		void Print(const QString &message,const QString operation=QString(),const QString subsystem=QString("music library"));
+		void Rescanned(int changed,int removed,qint64 milliseconds);
+	};
+}
@@ -18,6 +18,14 @@
 #include "globals.h"
 #include "security.h"
 #include "pulsar.h"
+#include "cache.h"
+#include "decode.h"
+#include "media.h"
+#include "library.h"
+#ifdef WITH_MOCK
+#include "mock.h"
+#include "twitch.h"
+#endif
 
 const char *ORGANIZATION_NAME="EngineeringDeck";
 const char *APPLICATION_NAME="Celeste";
@@ -70,7 +78,8 @@ void ShowOptions(ApplicationWindow &window,Channel *channel,Bot &bot,Pulsar &pul
 		.fontSize=chatPane.FontSize(),
 		.foregroundColor=chatPane.ForegroundColor(),
 		.backgroundColor=chatPane.BackgroundColor(),
-		.statusInterval=chatPane.StatusInterval()
+		.statusInterval=chatPane.StatusInterval(),
+		.scrollback=chatPane.Scrollback()
 	},errorReport,configureOptions));
 	AnnouncePane announcePane(QString{},&window);
 	configureOptions->AddCategory(new UI::Options::Categories::Pane({
@@ -82,7 +91,10 @@ void ShowOptions(ApplicationWindow &window,Channel *channel,Bot &bot,Pulsar &pul
 		.duration=announcePane.Duration()
 	},errorReport,configureOptions));
 	configureOptions->AddCategory(new UI::Options::Categories::Music({
-		.suppressedVolume=musicPlayer.SuppressedVolume()
+		.suppressedVolume=musicPlayer.SuppressedVolume(),
+		.crossfade=musicPlayer.Crossfade(),
+		.normalize=musicPlayer.Normalize(),
+		.loudnessTarget=musicPlayer.LoudnessTarget()
 	},configureOptions));
 	UI::Options::Categories::Bot *optionsCategoryBot=new UI::Options::Categories::Bot({
 		.arrivalSound=bot.ArrivalSound(),
@@ -158,6 +170,7 @@ void ShowPlaylist(const File::List &files,ApplicationWindow &window,Bot &bot,Mus
 			return;
 		}
 		bot.SetVibePlaylist(files);
+		Music::Library::Shared().Rescan(files());
 	});
 	configurePlaylist->connect(configurePlaylist,&UI::VibePlaylist::Dialog::finished,[configurePlaylist](int result) {
 		Q_UNUSED(result)
@@ -212,6 +225,11 @@ int main(int argc,char *argv[])
 	try
 	{
 		Log log;
+#ifdef WITH_MOCK
+		MockHelix helix;
+		helix.connect(&helix,&MockHelix::Print,&log,&Log::Receive);
+		if (helix.Start()) Twitch::Host()={helix.APIHost(),helix.ContentHost(),helix.OAuthHost()};
+#endif
 		IRCSocket socket;
 		Channel *channel=new Channel(security,&socket);
 		Music::Player musicPlayer(true,0);
@@ -232,15 +250,17 @@ int main(int argc,char *argv[])
 		log.connect(&log,&Log::Print,&status.Pane(),&StatusPane::Print);
 		celeste.connect(&celeste,&Bot::ChatMessage,&window,&Window::ChatMessage);
 		celeste.connect(&celeste,&Bot::DeleteChatMessage,&window,&Window::DeleteChatMessage);
-		celeste.connect(&celeste,&Bot::RefreshChat,&window,&Window::RefreshChat);
 		celeste.connect(&celeste,&Bot::Print,&log,&Log::Receive);
+		log.connect(&Media::Mixer::Shared(),&Media::Mixer::Print,&log,&Log::Receive);
 		celeste.connect(&celeste,&Bot::AnnounceArrival,&window,&Window::AnnounceArrival);
 		celeste.connect(&celeste,&Bot::AnnounceRedemption,&window,&Window::AnnounceRedemption);
 		celeste.connect(&celeste,&Bot::AnnounceSubscription,&window,&Window::AnnounceSubscription);
+		celeste.connect(&celeste,&Bot::AnnounceGiftSubscription,&window,&Window::AnnounceGiftSubscription);
 		celeste.connect(&celeste,&Bot::AnnounceRaid,&window,&Window::AnnounceRaid);
 		celeste.connect(&celeste,&Bot::AnnounceCheer,&window,&Window::AnnounceCheer);
 		celeste.connect(&celeste,&Bot::AnnounceTextWall,&window,&Window::AnnounceTextWall);
 		celeste.connect(&celeste,&Bot::AnnounceDeniedCommand,&window,&Window::AnnounceDeniedCommand);
+		celeste.connect(&celeste,&Bot::AnnounceSongRequest,&window,&Window::AnnounceSongRequest);
 		celeste.connect(&celeste,&Bot::SetAgenda,&window,&Window::SetAgenda);
 		celeste.connect(&celeste,&Bot::ShowPortraitVideo,&window,&Window::ShowPortraitVideo);
 		celeste.connect(&celeste,QOverload<const QString&,const QString&,const QString&,const QImage>::of(&Bot::ShowCurrentSong),&window,QOverload<const QString&,const QString&,const QString&,const QImage>::of(&Window::ShowCurrentSong));
@@ -256,6 +276,9 @@ int main(int argc,char *argv[])
 		celeste.connect(&celeste,&Bot::PlayAudio,&window,&Window::PlayAudio);
 		celeste.connect(&celeste,&Bot::Pulse,&pulsar,QOverload<const QString&,const QString&>::of(&Pulsar::Pulse));
 		celeste.connect(&celeste,&Bot::Welcomed,&metrics,&UI::Metrics::Dialog::Acknowledged);
+		metrics.connect(&Decode::Pool::Shared(),&Decode::Pool::Decoded,&metrics,&UI::Metrics::Dialog::Decoded);
+		metrics.connect(&window,&Window::ScheduleChanged,&metrics,&UI::Metrics::Dialog::Scheduled);
+		metrics.connect(&Media::Mixer::Shared(),&Media::Mixer::Latency,&metrics,&UI::Metrics::Dialog::Mixed);
 		celeste.connect(&celeste,&Bot::Panic,&window,&Window::ShowPanicText);
 		celeste.connect(&celeste,&Bot::Panic,&celeste,[&celeste]() {
 			celeste.disconnect();
@@ -289,6 +312,7 @@ int main(int argc,char *argv[])
 			eventSub->connect(eventSub,&EventSub::Print,&log,&Log::Receive);
 			eventSub->connect(eventSub,&EventSub::Redemption,&celeste,&Bot::Redemption);
 			eventSub->connect(eventSub,&EventSub::ChannelSubscription,&celeste,&Bot::Subscription);
+			eventSub->connect(eventSub,&EventSub::GiftSubscription,&celeste,&Bot::GiftSubscription);
 			eventSub->connect(eventSub,&EventSub::Raid,&celeste,&Bot::Raid);
 			eventSub->connect(eventSub,&EventSub::Cheer,&celeste,&Bot::Cheer);
 			eventSub->connect(eventSub,&EventSub::HypeTrain,&window,&Window::AnnounceHypeTrainProgress);
@@ -308,8 +332,30 @@ int main(int argc,char *argv[])
 			application.connect(&application,&QApplication::aboutToQuit,eventSub,&EventSub::deleteLater,Qt::DirectConnection);
 		});
 		channel->connect(channel,&Channel::Denied,&security,&Security::AuthorizeUser);
+#ifdef WITH_MOCK
+		// stands in for the IRC connection, so chat lines only come from the benchmark
+		MockBenchmark benchmark(security,celeste.NativeCommandFlags());
+		if (application.arguments().contains(u"--benchmark"_s))
+		{
+			benchmark.connect(&benchmark,&Channel::Print,&log,&Log::Receive);
+			benchmark.connect(&benchmark,&Channel::Dispatch,&celeste,&Bot::ParseChatMessage);
+			benchmark.connect(&window,&Window::Staged,&benchmark,&MockBenchmark::Presented);
+			benchmark.connect(&window,&Window::SetAgenda,&benchmark,&MockBenchmark::Presented);
+			benchmark.connect(&window,&Window::ChatMessage,&benchmark,&MockBenchmark::Presented);
+			benchmark.connect(&benchmark,&MockBenchmark::Finished,&application,&QApplication::quit,Qt::QueuedConnection);
+			security.connect(&security,&Security::Initialized,&benchmark,&MockBenchmark::Start);
+		}
+		else
+#endif
 		security.connect(&security,&Security::Initialized,channel,&Channel::Connect);
 		security.connect(&security,&Security::Print,&log,&Log::Receive);
+		Cache::Assets &assets=Cache::Assets::Shared();
+		assets.connect(&assets,&Cache::Assets::Print,&log,&Log::Receive);
+		assets.Open();
+		Music::Library &library=Music::Library::Shared();
+		library.connect(&library,&Music::Library::Print,&log,&Log::Receive);
+		library.Load();
+		library.Rescan(musicPlaylist());
 		application.connect(&application,&QApplication::aboutToQuit,&application,[&log,&socket,channel]() {
 			socket.connect(&socket,&IRCSocket::disconnected,&log,&Log::Archive);
 			channel->disconnect(); // stops attempting to reconnect by removing all connections to signals
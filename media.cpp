@@ -0,0 +1,353 @@
+#include <QAudioOutput>
+#include <QAudioDecoder>
+#include <QAudioBuffer>
+#include <QMediaDevices>
+#include <QAudioDevice>
+#include <QCoreApplication>
+#include <algorithm>
+#include <cstring>
+#include "media.h"
+
+namespace Media
+{
+	constexpr size_t IDLE_LIMIT=4;
+	constexpr size_t PREROLL_LIMIT=2;
+	constexpr int MIX_CHANNELS=2;
+	constexpr qint64 CLIP_LIMIT=15; // in seconds, anything longer is left to a media player
+	constexpr qint64 SINK_BUFFER=20; // in milliseconds, which bounds how late a voice can start
+	constexpr int SINK_IDLE=1000; // in milliseconds, how long the sink keeps pulling silence after the last voice ends
+
+	Pool::Pool(QObject *parent) : QObject(parent)
+	{
+		// players have to be gone before the multimedia backend is torn down
+		connect(QCoreApplication::instance(),&QCoreApplication::aboutToQuit,this,&Pool::Clear);
+	}
+
+	QMediaPlayer* Pool::Acquire(const QUrl &source)
+	{
+		auto candidate=std::find_if(prerolled.begin(),prerolled.end(),[&source](const std::pair<QUrl,QMediaPlayer*> &entry) {
+			return entry.first == source;
+		});
+		if (candidate != prerolled.end())
+		{
+			QMediaPlayer *player=candidate->second;
+			prerolled.erase(candidate);
+			return player;
+		}
+
+		QMediaPlayer *player=Idle();
+		player->setSource(source);
+		return player;
+	}
+
+	void Pool::Release(QMediaPlayer *player,QObject *owner)
+	{
+		if (!player) return;
+		disconnect(player,nullptr,owner,nullptr); // stopping below would otherwise signal an owner that's on its way out
+		Recycle(player);
+	}
+
+	void Pool::Preroll(const QUrl &source)
+	{
+		if (source.isEmpty()) return;
+		if (std::any_of(prerolled.begin(),prerolled.end(),[&source](const std::pair<QUrl,QMediaPlayer*> &entry) { return entry.first == source; })) return;
+		if (prerolled.size() >= PREROLL_LIMIT)
+		{
+			Recycle(prerolled.front().second);
+			prerolled.pop_front();
+		}
+
+		QMediaPlayer *player=Idle();
+		player->setSource(source);
+		player->pause(); // opens the pipeline and buffers up to the first frame without making a sound
+		prerolled.push_back({source,player});
+	}
+
+	bool Pool::Ready(const QMediaPlayer *player)
+	{
+		switch (player->mediaStatus())
+		{
+		case QMediaPlayer::LoadedMedia:
+		case QMediaPlayer::BufferedMedia:
+		case QMediaPlayer::BufferingMedia:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	QMediaPlayer* Pool::Idle()
+	{
+		if (idle.empty())
+		{
+			QMediaPlayer *player=new QMediaPlayer(this);
+			player->setAudioOutput(new QAudioOutput(player));
+			return player;
+		}
+
+		QMediaPlayer *player=idle.back();
+		idle.pop_back();
+		return player;
+	}
+
+	void Pool::Recycle(QMediaPlayer *player)
+	{
+		player->stop();
+		player->setVideoOutput(nullptr);
+		player->setSource(QUrl());
+		player->audioOutput()->setVolume(1);
+		if (idle.size() >= IDLE_LIMIT)
+		{
+			player->deleteLater();
+			return;
+		}
+		idle.push_back(player);
+	}
+
+	void Pool::Clear()
+	{
+		for (QMediaPlayer *player : idle) delete player;
+		idle.clear();
+		for (const std::pair<QUrl,QMediaPlayer*> &entry : prerolled) delete entry.second;
+		prerolled.clear();
+	}
+
+	Pool& Pool::Shared()
+	{
+		static Pool pool;
+		return pool;
+	}
+
+	qint64 Clip::Duration() const
+	{
+		if (sampleRate < 1) return 0;
+		return static_cast<qint64>(samples.size()/MIX_CHANNELS)*1000/sampleRate;
+	}
+
+	Mixer::Mixer(QObject *parent) : QIODevice(parent), sink(nullptr), nextVoice(1)
+	{
+		const QAudioDevice device=QMediaDevices::defaultAudioOutput();
+		format.setSampleRate(device.preferredFormat().sampleRate() > 0 ? device.preferredFormat().sampleRate() : 48000);
+		format.setChannelCount(MIX_CHANNELS);
+		format.setSampleFormat(QAudioFormat::Float);
+		if (!device.isFormatSupported(format)) format.setSampleFormat(QAudioFormat::Int16);
+		clock.start();
+		idle.setSingleShot(true);
+		idle.setInterval(SINK_IDLE);
+		connect(&idle,&QTimer::timeout,this,&Mixer::Suspend);
+
+		// the mixer outlives the application, but the sink can't outlive the audio backend
+		connect(QCoreApplication::instance(),&QCoreApplication::aboutToQuit,this,&Mixer::Close);
+	}
+
+	std::shared_ptr<const Clip> Mixer::Find(const QString &path) const
+	{
+		auto candidate=clips.find(path);
+		if (candidate == clips.end()) return nullptr;
+		return candidate->second;
+	}
+
+	void Mixer::Cache(const QString &path)
+	{
+		if (clips.contains(path) || rejected.contains(path) || loading.contains(path)) return;
+		loading.insert(path);
+		Load(path).Start(this);
+	}
+
+	Async::Task<void> Mixer::Load(QString path)
+	{
+		const int sampleRate=format.sampleRate();
+		std::shared_ptr<Clip> clip=co_await Async::Operation<std::shared_ptr<Clip>>([this,path,sampleRate](std::function<void(std::shared_ptr<Clip>)> resume) {
+			QAudioDecoder *decoder=new QAudioDecoder(this);
+			QAudioFormat request;
+			request.setSampleRate(sampleRate);
+			request.setChannelCount(MIX_CHANNELS);
+			request.setSampleFormat(QAudioFormat::Float);
+			decoder->setAudioFormat(request); // backends that can't convert hand back their own format, which is handled below
+			std::shared_ptr<Clip> clip=std::make_shared<Clip>();
+			std::shared_ptr<int> sourceRate=std::make_shared<int>(0);
+			connect(decoder,&QAudioDecoder::bufferReady,decoder,[decoder,clip,sourceRate,resume]() {
+				const QAudioBuffer buffer=decoder->read();
+				const QAudioFormat bufferFormat=buffer.format();
+				if (!buffer.isValid() || bufferFormat.channelCount() < 1) return;
+				*sourceRate=bufferFormat.sampleRate();
+				const char *data=buffer.constData<char>();
+				const int bytesPerSample=bufferFormat.bytesPerSample();
+				for (qsizetype frame=0; frame < buffer.frameCount(); frame++)
+				{
+					const char *samples=data+frame*bufferFormat.bytesPerFrame();
+					const float left=bufferFormat.normalizedSampleValue(samples);
+					clip->samples.push_back(left);
+					clip->samples.push_back(bufferFormat.channelCount() > 1 ? bufferFormat.normalizedSampleValue(samples+bytesPerSample) : left);
+				}
+				if (static_cast<qint64>(clip->samples.size()/MIX_CHANNELS) > CLIP_LIMIT*std::max(*sourceRate,1))
+				{
+					decoder->stop();
+					decoder->deleteLater();
+					resume(nullptr);
+				}
+			});
+			connect(decoder,&QAudioDecoder::finished,decoder,[decoder,clip,sourceRate,resume]() {
+				clip->sampleRate=*sourceRate;
+				decoder->deleteLater();
+				resume(clip);
+			});
+			connect(decoder,QOverload<QAudioDecoder::Error>::of(&QAudioDecoder::error),decoder,[this,decoder,resume,path](QAudioDecoder::Error error) {
+				Q_UNUSED(error)
+				emit Print(QString("Failed to decode %1: %2").arg(path,decoder->errorString()),"load sound effect");
+				decoder->deleteLater();
+				resume(nullptr);
+			});
+			decoder->setSource(QUrl::fromLocalFile(path));
+			decoder->start();
+		});
+		loading.erase(path);
+
+		if (!clip || clip->samples.empty())
+		{
+			rejected.insert(path);
+			co_return;
+		}
+
+		// resample anything the backend didn't, linear interpolation is plenty for alert sounds
+		if (clip->sampleRate != sampleRate && clip->sampleRate > 0)
+		{
+			const size_t sourceFrames=clip->samples.size()/MIX_CHANNELS;
+			const size_t frames=sourceFrames*sampleRate/clip->sampleRate;
+			const double step=static_cast<double>(clip->sampleRate)/sampleRate;
+			std::vector<float> resampled(frames*MIX_CHANNELS);
+			for (size_t frame=0; frame < frames; frame++)
+			{
+				const double position=frame*step;
+				const size_t index=std::min(static_cast<size_t>(position),sourceFrames-1);
+				const size_t next=std::min(index+1,sourceFrames-1);
+				const float fraction=static_cast<float>(position-index);
+				for (int channel=0; channel < MIX_CHANNELS; channel++)
+					resampled[frame*MIX_CHANNELS+channel]=clip->samples[index*MIX_CHANNELS+channel]*(1-fraction)+clip->samples[next*MIX_CHANNELS+channel]*fraction;
+			}
+			clip->samples=std::move(resampled);
+		}
+		clip->sampleRate=sampleRate;
+		clips.insert({path,clip});
+	}
+
+	int Mixer::Play(std::shared_ptr<const Clip> clip,float gain)
+	{
+		Open();
+		idle.stop();
+		if (sink->state() == QAudio::SuspendedState) sink->resume();
+		const int voice=nextVoice++;
+		voices.insert({voice,{.clip=clip,.gain=gain,.triggered=clock.nsecsElapsed()/1000}});
+		return voice;
+	}
+
+	void Mixer::Pause(int voice)
+	{
+		if (auto candidate=voices.find(voice); candidate != voices.end()) candidate->second.paused=true;
+	}
+
+	void Mixer::Resume(int voice)
+	{
+		if (auto candidate=voices.find(voice); candidate != voices.end())
+		{
+			candidate->second.paused=false;
+			candidate->second.triggered=clock.nsecsElapsed()/1000;
+		}
+	}
+
+	void Mixer::Stop(int voice)
+	{
+		voices.erase(voice);
+	}
+
+	void Mixer::Open()
+	{
+		if (sink) return;
+		QIODevice::open(QIODevice::ReadOnly);
+		sink=new QAudioSink(QMediaDevices::defaultAudioOutput(),format,this);
+		sink->setBufferSize(format.bytesForDuration(SINK_BUFFER*1000));
+		sink->start(this);
+	}
+
+	void Mixer::Close()
+	{
+		idle.stop();
+		if (!sink) return;
+		sink->stop();
+		delete sink;
+		sink=nullptr;
+		QIODevice::close();
+	}
+
+	void Mixer::Suspend()
+	{
+		// waits out a grace period rather than suspending right away, so what's still in the device's buffer gets to play
+		if (sink && voices.empty() && sink->state() != QAudio::SuspendedState) sink->suspend();
+	}
+
+	qint64 Mixer::readData(char *data,qint64 maxSize)
+	{
+		const qint64 frames=maxSize/format.bytesPerFrame();
+		if (frames < 1) return 0;
+		scratch.assign(frames*MIX_CHANNELS,0);
+
+		// whatever is already queued in the device has to play out before this does
+		const qint64 now=clock.nsecsElapsed()/1000;
+		const qint64 queued=format.durationForBytes(sink->bufferSize()-sink->bytesFree());
+		std::vector<int> finished;
+		for (auto &[id,voice] : voices)
+		{
+			if (voice.paused) continue;
+			if (voice.triggered >= 0)
+			{
+				emit Latency(now-voice.triggered+queued);
+				voice.triggered=-1;
+			}
+			const std::vector<float> &samples=voice.clip->samples;
+			const size_t count=std::min(scratch.size(),samples.size()-voice.position);
+			for (size_t index=0; index < count; index++) scratch[index]+=samples[voice.position+index]*voice.gain;
+			voice.position+=count;
+			if (voice.position >= samples.size()) finished.push_back(id);
+		}
+		for (int id : finished) voices.erase(id);
+
+		if (format.sampleFormat() == QAudioFormat::Float)
+		{
+			for (float &sample : scratch) sample=std::clamp(sample,-1.0f,1.0f);
+			std::memcpy(data,scratch.data(),scratch.size()*sizeof(float));
+		}
+		else
+		{
+			qint16 *output=reinterpret_cast<qint16*>(data);
+			for (size_t index=0; index < scratch.size(); index++) output[index]=static_cast<qint16>(std::clamp(scratch[index],-1.0f,1.0f)*32767);
+		}
+
+		for (int id : finished) emit Finished(id);
+		if (voices.empty())
+		{
+			// readData may be called from the backend's thread, and the timer belongs to this one
+			QMetaObject::invokeMethod(this,[this]() {
+				if (voices.empty() && !idle.isActive()) idle.start();
+			},Qt::QueuedConnection);
+		}
+		return frames*format.bytesPerFrame();
+	}
+
+	qint64 Mixer::writeData(const char *data,qint64 maxSize)
+	{
+		Q_UNUSED(data)
+		Q_UNUSED(maxSize)
+		return -1;
+	}
+
+	bool Mixer::isSequential() const
+	{
+		return true;
+	}
+
+	Mixer& Mixer::Shared()
+	{
+		static Mixer mixer;
+		return mixer;
+	}
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <QObject>
+#include <QIODevice>
+#include <QMediaPlayer>
+#include <QAudioSink>
+#include <QAudioFormat>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QUrl>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include "async.h"
+
+namespace Media
+{
+	/*!
+	 * \brief Hands out media players that are already initialized, and optionally already loaded
+	 *
+	 * Spinning up a QMediaPlayer and its audio output, then opening the
+	 * file, is most of the delay between an alert being shown and it being
+	 * heard. Players are kept around after a pane is done with them, and the
+	 * next pane's media can be opened and buffered ahead of time so that
+	 * starting it is just a matter of pressing play.
+	 */
+	class Pool : public QObject
+	{
+		Q_OBJECT
+	public:
+		Pool(QObject *parent=nullptr);
+		QMediaPlayer* Acquire(const QUrl &source);
+		void Release(QMediaPlayer *player,QObject *owner);
+		void Preroll(const QUrl &source);
+		static bool Ready(const QMediaPlayer *player);
+		static Pool& Shared();
+	protected:
+		std::vector<QMediaPlayer*> idle;
+		std::deque<std::pair<QUrl,QMediaPlayer*>> prerolled;
+		QMediaPlayer* Idle();
+		void Recycle(QMediaPlayer *player);
+	protected slots:
+		void Clear();
+	};
+
+	//! A short sound decoded once, kept as interleaved stereo samples at the mixer's rate
+	struct Clip
+	{
+		std::vector<float> samples;
+		int sampleRate=0;
+		qint64 Duration() const; // in milliseconds
+	};
+
+	/*!
+	 * \brief Plays short sounds from memory through a single audio output
+	 *
+	 * Clips are decoded once into PCM and any number of them can play at the
+	 * same time, each with its own gain, by summing them in the audio
+	 * device's pull callback. The sink's buffer is kept small so the time
+	 * between asking for a sound and hearing it stays in the tens of
+	 * milliseconds, and that time is measured for every voice.
+	 */
+	class Mixer : public QIODevice
+	{
+		Q_OBJECT
+	public:
+		Mixer(QObject *parent=nullptr);
+		std::shared_ptr<const Clip> Find(const QString &path) const;
+		void Cache(const QString &path);
+		int Play(std::shared_ptr<const Clip> clip,float gain=1);
+		void Pause(int voice);
+		void Resume(int voice);
+		void Stop(int voice);
+		bool isSequential() const override;
+		static Mixer& Shared();
+	protected:
+		struct Voice
+		{
+			std::shared_ptr<const Clip> clip;
+			size_t position=0;
+			float gain=1;
+			bool paused=false;
+			qint64 triggered=-1; // microseconds on the mixer's clock, until the voice is first mixed
+		};
+		QAudioFormat format;
+		QAudioSink *sink;
+		QElapsedTimer clock;
+		QTimer idle;
+		std::unordered_map<QString,std::shared_ptr<const Clip>> clips;
+		std::unordered_set<QString> rejected;
+		std::unordered_set<QString> loading;
+		std::unordered_map<int,Voice> voices;
+		std::vector<float> scratch;
+		int nextVoice;
+		Async::Task<void> Load(QString path);
+		void Open();
+		void Close();
+		void Suspend();
+		qint64 readData(char *data,qint64 maxSize) override;
+		qint64 writeData(const char *data,qint64 maxSize) override;
+	signals:
+		void Finished(int voice);
+		void Latency(qint64 microseconds);
+		void Print(const QString &message,const QString &operation=QString(),const QString &subsystem=QString("mixer"));
+	};
+}
@@ -0,0 +1,451 @@
+#include <QTimer>
+#include <QImage>
+#include <QBuffer>
+#include <QDateTime>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QCryptographicHash>
+#include <QtEndian>
+#include <cstring>
+#include <algorithm>
+#include "mock.h"
+#include "globals.h"
+#include "network.h"
+#include "security.h"
+#include "twitch.h"
+
+const char *SETTINGS_CATEGORY_MOCK="Mock";
+const char *MOCK_PREFIX_API="/helix/";
+const char *MOCK_PREFIX_CONTENT="/cdn/";
+const char *MOCK_PREFIX_OAUTH="/oauth2/";
+const char *MOCK_HOST="http://127.0.0.1:%1%2";
+const char *MOCK_ENDPOINT_CONTENT="cdn";
+const char *HTTP_HEADER_END="\r\n\r\n";
+const char *HTTP_HEADER_CONTENT_LENGTH="content-length";
+const char *SUBSYSTEM_BENCHMARK="benchmark";
+const char *BENCHMARK_LINE="@badges=broadcaster/1;display-name=%1 :%1!%1@%1.tmi.twitch.tv PRIVMSG #%1 :!%2 %1\n";
+constexpr int BENCHMARK_TIMEOUT=5000; // in milliseconds, how long a command gets to reach the overlay before it's counted as not doing so
+
+MockHelix::MockHelix(QObject *parent) : QTcpServer(parent),
+	random(std::random_device{}()),
+	settingPort(SETTINGS_CATEGORY_MOCK,"Port",0),
+	settingLatency(SETTINGS_CATEGORY_MOCK,"Latency",0),
+	settingErrorStatus(SETTINGS_CATEGORY_MOCK,"ErrorStatus",0),
+	settingErrorRate(SETTINGS_CATEGORY_MOCK,"ErrorRate",0.0)
+{
+	// every emote, badge, and profile picture is the same small square
+	QImage square(28,28,QImage::Format_ARGB32);
+	square.fill(Qt::magenta);
+	QBuffer buffer(&image);
+	buffer.open(QIODevice::WriteOnly);
+	square.save(&buffer,"PNG");
+}
+
+bool MockHelix::Start()
+{
+	static const char *OPERATION="start";
+
+	if (!listen(QHostAddress::LocalHost,static_cast<quint16>(settingPort)))
+	{
+		emit Print(QString("Failed to listen: %1").arg(errorString()),OPERATION);
+		return false;
+	}
+
+	emit Print(QString("Listening on port %1").arg(serverPort()),OPERATION);
+	return true;
+}
+
+QString MockHelix::APIHost() const
+{
+	return QString(MOCK_HOST).arg(QString::number(serverPort()),MOCK_PREFIX_API);
+}
+
+QString MockHelix::ContentHost() const
+{
+	return QString(MOCK_HOST).arg(QString::number(serverPort()),MOCK_PREFIX_CONTENT);
+}
+
+QString MockHelix::OAuthHost() const
+{
+	return QString(MOCK_HOST).arg(QString::number(serverPort()),MOCK_PREFIX_OAUTH);
+}
+
+void MockHelix::incomingConnection(qintptr descriptor)
+{
+	QTcpSocket *socket=new QTcpSocket(this);
+	if (!socket->setSocketDescriptor(descriptor))
+	{
+		socket->deleteLater();
+		return;
+	}
+	buffers.try_emplace(socket);
+	connect(socket,&QTcpSocket::readyRead,this,&MockHelix::Read);
+	connect(socket,&QTcpSocket::disconnected,this,&MockHelix::Disconnected);
+}
+
+void MockHelix::Read()
+{
+	QTcpSocket *socket=qobject_cast<QTcpSocket*>(sender());
+	if (!socket) return;
+	QByteArray &buffer=buffers[socket];
+	buffer.append(socket->readAll());
+
+	// the network access manager keeps connections alive, so there may be several requests waiting
+	while (std::optional<Request> request=Extract(buffer)) Respond(socket,Route(*request));
+}
+
+void MockHelix::Disconnected()
+{
+	QTcpSocket *socket=qobject_cast<QTcpSocket*>(sender());
+	if (!socket) return;
+	buffers.erase(socket);
+	socket->deleteLater();
+}
+
+std::optional<MockHelix::Request> MockHelix::Extract(QByteArray &buffer)
+{
+	qsizetype headerEnd=buffer.indexOf(HTTP_HEADER_END);
+	if (headerEnd < 0) return std::nullopt;
+
+	const QList<QByteArray> lines=buffer.left(headerEnd).split('\n');
+	const QList<QByteArray> requestLine=lines.front().trimmed().split(' ');
+	if (requestLine.size() < 2)
+	{
+		buffer.clear();
+		return std::nullopt;
+	}
+
+	qsizetype contentLength=0;
+	for (qsizetype index=1; index < lines.size(); index++)
+	{
+		const QByteArray &line=lines.at(index);
+		qsizetype separator=line.indexOf(':');
+		if (separator < 0) continue;
+		if (line.left(separator).trimmed().toLower() == HTTP_HEADER_CONTENT_LENGTH) contentLength=line.mid(separator+1).trimmed().toLongLong();
+	}
+
+	qsizetype bodyStart=headerEnd+static_cast<qsizetype>(std::strlen(HTTP_HEADER_END));
+	if (buffer.size() < bodyStart+contentLength) return std::nullopt; // body hasn't fully arrived yet
+
+	Request request{
+		.method=requestLine.at(0),
+		.url=QUrl::fromEncoded(requestLine.at(1)),
+		.body=buffer.mid(bodyStart,contentLength)
+	};
+	buffer.remove(0,bodyStart+contentLength);
+	return request;
+}
+
+QString MockHelix::Endpoint(const QUrl &url)
+{
+	const QString path=url.path();
+	if (path.startsWith(MOCK_PREFIX_API)) return path.mid(std::strlen(MOCK_PREFIX_API));
+	if (path.startsWith(MOCK_PREFIX_CONTENT)) return MOCK_ENDPOINT_CONTENT;
+	return path.mid(1);
+}
+
+MockHelix::Fault MockHelix::Behavior() const
+{
+	return {
+		.latency=static_cast<std::chrono::milliseconds>(settingLatency),
+		.status=static_cast<int>(settingErrorStatus),
+		.rate=static_cast<qreal>(settingErrorRate)
+	};
+}
+
+MockHelix::Response MockHelix::Route(const Request &request)
+{
+	const QString path=request.url.path();
+
+	if (path.startsWith(MOCK_PREFIX_CONTENT)) return {200,"image/png",image};
+
+	if (path.startsWith(MOCK_PREFIX_OAUTH))
+	{
+		if (path.endsWith(Twitch::ENDPOINT_VALIDATE))
+		{
+			return {200,Network::CONTENT_TYPE_JSON,QJsonDocument(QJsonObject({
+				{"client_id","mock"},
+				{"login","celeste"},
+				{"user_id",ID("celeste")},
+				{"scopes",QJsonArray::fromStringList(Security::SCOPES)},
+				{"expires_in",86400}
+			})).toJson(QJsonDocument::Compact)};
+		}
+		return {200,Network::CONTENT_TYPE_HTML,"<html><body>Authorized</body></html>"};
+	}
+
+	if (path.startsWith(MOCK_PREFIX_API)) return Helix(request.method,Endpoint(request.url),QUrlQuery(request.url));
+
+	return {404,Network::CONTENT_TYPE_PLAIN,"Not Found"};
+}
+
+MockHelix::Response MockHelix::Helix(const QByteArray &method,const QString &endpoint,const QUrlQuery &query)
+{
+	const QString now=QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+
+	if (endpoint == Twitch::ENDPOINT_USERS)
+	{
+		QStringList logins=query.allQueryItemValues("login");
+		if (logins.isEmpty()) logins.append("celeste");
+		QJsonArray users;
+		for (const QString &login : logins)
+		{
+			users.append(QJsonObject({
+				{"id",ID(login)},
+				{"login",login},
+				{"display_name",login},
+				{"type",""},
+				{"broadcaster_type","affiliate"},
+				{"description",QString("%1 is a mock user").arg(login)},
+				{"profile_image_url",ContentHost()+QString("profile/%1.png").arg(login)},
+				{"created_at",now}
+			}));
+		}
+		return Data(users);
+	}
+
+	if (endpoint == Twitch::ENDPOINT_STREAM_INFORMATION)
+	{
+		const QString login=query.queryItemValue("user_login");
+		return Data({QJsonObject({
+			{"id",ID(login+"stream")},
+			{"user_id",ID(login)},
+			{"user_login",login},
+			{"user_name",login},
+			{"game_name","Software and Game Development"},
+			{"type","live"},
+			{"title","Mock stream"},
+			{"viewer_count",42},
+			{"started_at",QDateTime::currentDateTimeUtc().addSecs(-3600).toString(Qt::ISODate)}
+		})});
+	}
+
+	if (endpoint == Twitch::ENDPOINT_USER_FOLLOWS)
+	{
+		const QString id=query.queryItemValue("user_id");
+		return Data({QJsonObject({
+			{"user_id",id},
+			{"user_login",id},
+			{"user_name",id},
+			{"followed_at",QDateTime::currentDateTimeUtc().addDays(-400).toString(Qt::ISODate)}
+		})});
+	}
+
+	if (endpoint == Twitch::ENDPOINT_GAME_INFORMATION)
+	{
+		const QString name=query.queryItemValue("name");
+		return Data({QJsonObject({
+			{"id",ID(name)},
+			{"name",name},
+			{"box_art_url",ContentHost()+"boxart/{width}x{height}.png"}
+		})});
+	}
+
+	if (endpoint == Twitch::ENDPOINT_BADGES || endpoint == Twitch::ENDPOINT_CHANNEL_BADGES)
+	{
+		QJsonArray sets;
+		for (const char *set : {"broadcaster","moderator","subscriber","vip"})
+		{
+			sets.append(QJsonObject({
+				{"set_id",set},
+				{"versions",QJsonArray({QJsonObject({
+					{"id","1"},
+					{"image_url_1x",ContentHost()+QString("badges/%1/1.png").arg(set)}
+				})})}
+			}));
+		}
+		return Data(sets);
+	}
+
+	if (endpoint == Twitch::ENDPOINT_CHANNEL_EMOTES)
+	{
+		return Data({QJsonObject({
+			{"id",ID("emote")},
+			{"name","celesteWave"},
+			{"emote_type","subscriptions"}
+		})});
+	}
+
+	if (endpoint == Twitch::ENDPOINT_CHAT_SETTINGS)
+	{
+		return Data({QJsonObject({
+			{"broadcaster_id",query.queryItemValue("broadcaster_id")},
+			{"emote_mode",method == "PATCH"}
+		})});
+	}
+
+	if (endpoint == Twitch::ENDPOINT_CHANNEL_INFORMATION || endpoint == Twitch::ENDPOINT_SHOUTOUTS) return {204,Network::CONTENT_TYPE_JSON,{}};
+
+	if (endpoint == Twitch::ENDPOINT_EVENTSUB_SUBSCRIPTIONS)
+	{
+		if (method == "DELETE") return {204,Network::CONTENT_TYPE_JSON,{}};
+		if (method == "POST") return {202,Network::CONTENT_TYPE_JSON,QJsonDocument(QJsonObject({{"data",QJsonArray({QJsonObject({{"id",ID(now)},{"status","enabled"}})})}})).toJson(QJsonDocument::Compact)};
+		return Data({});
+	}
+
+	return {404,Network::CONTENT_TYPE_JSON,R"({"error":"Not Found","status":404,"message":""})"};
+}
+
+MockHelix::Response MockHelix::Data(const QJsonArray &data)
+{
+	return {200,Network::CONTENT_TYPE_JSON,QJsonDocument(QJsonObject({{"data",data},{"total",data.size()}})).toJson(QJsonDocument::Compact)};
+}
+
+void MockHelix::Respond(QTcpSocket *socket,const Response &response)
+{
+	Fault fault=Behavior();
+	Response actual=response;
+	if (fault.status > 0 && std::uniform_real_distribution<double>(0.0,1.0)(random) < fault.rate) actual={fault.status,Network::CONTENT_TYPE_JSON,QString(R"({"error":"Injected","status":%1,"message":"Injected by mock"})").arg(fault.status).toUtf8()};
+
+	QByteArray payload=QString("HTTP/1.1 %1 %2\r\nContent-Type: %3\r\nContent-Length: %4\r\n\r\n").arg(
+		QString::number(actual.status),
+		actual.status < 400 ? QString("OK") : QString("Error"),
+		QString::fromUtf8(actual.contentType),
+		QString::number(actual.body.size())
+	).toUtf8()+actual.body;
+
+	QTimer::singleShot(fault.latency,socket,[socket,payload]() {
+		socket->write(payload);
+	});
+}
+
+QString MockHelix::ID(const QString &name)
+{
+	// derived from a digest rather than qHash so the same login gets the same ID on every run and platform
+	const QByteArray digest=QCryptographicHash::hash(name.toUtf8(),QCryptographicHash::Sha1);
+	return QString::number(qFromBigEndian<quint64>(digest.constData())%100000000);
+}
+
+ApplicationSetting& MockHelix::Port()
+{
+	return settingPort;
+}
+
+ApplicationSetting& MockHelix::Latency()
+{
+	return settingLatency;
+}
+
+ApplicationSetting& MockHelix::ErrorStatus()
+{
+	return settingErrorStatus;
+}
+
+ApplicationSetting& MockHelix::ErrorRate()
+{
+	return settingErrorRate;
+}
+
+MockBenchmark::MockBenchmark(Security &security,const Bot::NativeCommandFlagLookup &commands,QObject *parent) : Channel(security,parent),
+	sent(-1),
+	current(0),
+	round(0),
+	settingRounds(SETTINGS_CATEGORY_MOCK,"BenchmarkRounds",100)
+{
+	for (const auto &[name,flag] : commands)
+	{
+		if (flag != NativeCommandFlag::PANIC) names.append(name); // panic disconnects the bot from everything, so nothing after it would run
+	}
+	names.sort();
+
+	timeout.setSingleShot(true);
+	timeout.setInterval(BENCHMARK_TIMEOUT);
+	connect(&timeout,&QTimer::timeout,this,&MockBenchmark::TimedOut);
+}
+
+void MockBenchmark::Start()
+{
+	static const char *OPERATION="start";
+
+	if (clock.isValid()) return; // the token can be refreshed while the benchmark is running
+	emit Print(QString("Timing %1 native commands over %2 rounds").arg(StringConvert::Integer(static_cast<int>(names.size())),StringConvert::Integer(static_cast<int>(settingRounds))),OPERATION,SUBSYSTEM_BENCHMARK);
+	clock.start();
+	Send();
+}
+
+void MockBenchmark::Send()
+{
+	if (round >= static_cast<int>(settingRounds) || names.isEmpty())
+	{
+		Report();
+		emit Finished();
+		return;
+	}
+
+	const QString administrator=static_cast<QString>(security.Administrator()).toLower();
+	timeout.start();
+	sent=clock.nsecsElapsed();
+	ParseMessage(QString(BENCHMARK_LINE).arg(administrator,names.at(current)));
+}
+
+void MockBenchmark::Presented()
+{
+	if (sent < 0) return; // something else put a pane up, like an arrival
+	samples[names.at(current)].push_back((clock.nsecsElapsed()-sent)/1000);
+	Advance();
+}
+
+void MockBenchmark::TimedOut()
+{
+	if (sent < 0) return;
+	const QString &name=names.at(current);
+	misses[name]++;
+	if (!samples.contains(name))
+	{
+		silent.append(name);
+		names.removeAt(current--);
+	}
+	Advance();
+}
+
+void MockBenchmark::Advance()
+{
+	sent=-1;
+	timeout.stop();
+	if (++current >= names.size())
+	{
+		current=0;
+		round++;
+	}
+
+	// queued so the window finishes staging the pane before the next line goes through the parser
+	QMetaObject::invokeMethod(this,&MockBenchmark::Send,Qt::QueuedConnection);
+}
+
+void MockBenchmark::Report()
+{
+	static const char *OPERATION="report";
+
+	std::vector<qint64> all;
+	for (const QString &name : names)
+	{
+		std::vector<qint64> &durations=samples[name];
+		std::sort(durations.begin(),durations.end());
+		all.insert(all.end(),durations.begin(),durations.end());
+		emit Print(QString("!%1: p50 %2 ms, p99 %3 ms over %4 runs, %5 timed out").arg(
+			name,
+			QString::number(Percentile(durations,50)/1000.0,'f',2),
+			QString::number(Percentile(durations,99)/1000.0,'f',2),
+			StringConvert::Integer(static_cast<int>(durations.size())),
+			StringConvert::Integer(misses[name])
+		),OPERATION,SUBSYSTEM_BENCHMARK);
+	}
+	std::sort(all.begin(),all.end());
+	emit Print(QString("All commands: p50 %1 ms, p99 %2 ms over %3 runs").arg(
+		QString::number(Percentile(all,50)/1000.0,'f',2),
+		QString::number(Percentile(all,99)/1000.0,'f',2),
+		StringConvert::Integer(static_cast<int>(all.size()))
+	),OPERATION,SUBSYSTEM_BENCHMARK);
+	if (!silent.isEmpty()) emit Print(QString("No overlay action from: !%1").arg(silent.join(", !")),OPERATION,SUBSYSTEM_BENCHMARK);
+}
+
+qint64 MockBenchmark::Percentile(const std::vector<qint64> &sorted,int percentile)
+{
+	if (sorted.empty()) return 0;
+	return sorted.at((sorted.size()-1)*percentile/100);
+}
+
+ApplicationSetting& MockBenchmark::Rounds()
+{
+	return settingRounds;
+}
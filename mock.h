@@ -0,0 +1,117 @@
+#pragma once
+
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QUrlQuery>
+#include <QJsonArray>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <unordered_map>
+#include <chrono>
+#include <random>
+#include <optional>
+#include "settings.h"
+#include "channel.h"
+#include "bot.h"
+
+/*!
+ * \brief Local stand-in for the Helix API, CDN, and OAuth hosts
+ *
+ * Serves canned responses for the endpoints the bot uses so commands can be
+ * exercised without credentials or a network connection. Latency and error
+ * responses can be injected through the Mock settings.
+ */
+class MockHelix : public QTcpServer
+{
+	Q_OBJECT
+public:
+	struct Fault
+	{
+		std::chrono::milliseconds latency=std::chrono::milliseconds(0);
+		int status=0; // 0 means answer normally
+		double rate=1.0; // fraction of requests the status applies to
+	};
+	MockHelix(QObject *parent=nullptr);
+	bool Start();
+	QString APIHost() const;
+	QString ContentHost() const;
+	QString OAuthHost() const;
+	ApplicationSetting& Port();
+	ApplicationSetting& Latency();
+	ApplicationSetting& ErrorStatus();
+	ApplicationSetting& ErrorRate();
+protected:
+	struct Request
+	{
+		QByteArray method;
+		QUrl url;
+		QByteArray body;
+	};
+	struct Response
+	{
+		int status;
+		QByteArray contentType;
+		QByteArray body;
+	};
+	std::unordered_map<QTcpSocket*,QByteArray> buffers;
+	std::minstd_rand random;
+	QByteArray image;
+	ApplicationSetting settingPort;
+	ApplicationSetting settingLatency;
+	ApplicationSetting settingErrorStatus;
+	ApplicationSetting settingErrorRate;
+	void incomingConnection(qintptr descriptor) override;
+	std::optional<Request> Extract(QByteArray &buffer);
+	Fault Behavior() const;
+	Response Route(const Request &request);
+	Response Helix(const QByteArray &method,const QString &endpoint,const QUrlQuery &query);
+	Response Data(const QJsonArray &data);
+	void Respond(QTcpSocket *socket,const Response &response);
+	static QString Endpoint(const QUrl &url);
+	static QString ID(const QString &name);
+signals:
+	void Print(const QString &message,const QString operation=QString(),const QString subsystem=QString("mock Helix"));
+protected slots:
+	void Read();
+	void Disconnected();
+};
+
+/*!
+ * \brief Times native commands from their PRIVMSG to the overlay acting on them
+ *
+ * Feeds one chat line at a time through the same parser the IRC connection
+ * uses, as the broadcaster, and waits for the window to stage a pane (or set
+ * the agenda, or show a chat message) before sending the next. Commands that
+ * never reach the overlay are dropped after their first timeout. Meant to be
+ * run against MockHelix, so the numbers include the Helix round trips with
+ * whatever latency the Mock settings inject.
+ */
+class MockBenchmark : public Channel
+{
+	Q_OBJECT
+public:
+	MockBenchmark(Security &security,const Bot::NativeCommandFlagLookup &commands,QObject *parent=nullptr);
+	ApplicationSetting& Rounds();
+protected:
+	QStringList names;
+	std::unordered_map<QString,std::vector<qint64>> samples; // in microseconds
+	std::unordered_map<QString,int> misses;
+	QStringList silent; // never reached the overlay, reported but not sent again
+	QElapsedTimer clock;
+	QTimer timeout;
+	qint64 sent;
+	qsizetype current;
+	int round;
+	ApplicationSetting settingRounds;
+	void Send();
+	void Advance();
+	void Report();
+	static qint64 Percentile(const std::vector<qint64> &sorted,int percentile);
+signals:
+	void Finished();
+public slots:
+	void Start();
+	void Presented();
+protected slots:
+	void TimedOut();
+};
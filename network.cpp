@@ -1,25 +1,48 @@
 #include "network.h"
 #include "globals.h"
+#include <QPointer>
 
 namespace Network
 {
 	std::queue<Request*> Request::queue;
+	std::queue<Request*> Request::backlog;
 	std::unique_ptr<QNetworkAccessManager> Request::networkManager;
 
-	Request* Request::Send(const QUrl &url,Method method,Callback callback,const QUrlQuery &queryParameters,const Headers &headers,const QByteArray &payload)
+	Reply::Reply(QNetworkReply *reply) : status(reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt()),
+		error(reply->error()),
+		errorString(reply->errorString()),
+		body(reply->readAll())
 	{
-		Request *request=new Request(url,method,callback,queryParameters,headers,payload);
+	}
+
+	Request* Request::Send(const QUrl &url,Method method,Callback callback,const QUrlQuery &queryParameters,const Headers &headers,const QByteArray &payload,Priority priority)
+	{
+		Request *request=new Request(url,method,callback,queryParameters,headers,payload,priority);
 		request->Send();
 		return request;
 	}
 
-	Request::Request(const QUrl &url,Method method,Callback callback,const QUrlQuery &queryParameters,const Headers &headers,const QByteArray &payload) : url(url),
+	Async::Task<Reply> Request::Await(QUrl url,Method method,QUrlQuery queryParameters,Headers headers,QByteArray payload)
+	{
+		std::shared_ptr<QPointer<Request>> request=std::make_shared<QPointer<Request>>();
+		co_return co_await Async::Operation<Reply>([&](std::function<void(Reply)> resume) {
+			*request=Send(url,method,[resume](QNetworkReply *reply) {
+				resume(Reply(reply));
+			},queryParameters,headers,payload);
+		},[request]() {
+			if (*request) (*request)->Abort();
+		});
+	}
+
+	Request::Request(const QUrl &url,Method method,Callback callback,const QUrlQuery &queryParameters,const Headers &headers,const QByteArray &payload,Priority priority) : url(url),
 		method(method),
 		callback(callback),
 		queryParameters(queryParameters),
 		headers(headers),
 		payload(payload),
-		reply(nullptr)
+		priority(priority),
+		reply(nullptr),
+		aborted(false)
 	{
 		if (!networkManager) networkManager=std::make_unique<QNetworkAccessManager>();
 	}
@@ -33,8 +56,14 @@ namespace Network
 		{
 			url.setQuery(queryParameters);
 			request.setUrl(url);
-			if (queue.size() == 0) DeferredSend(); // if it's the first one going in the queue, trigger it
+			if (priority == Priority::LOW)
+			{
+				backlog.push(this);
+				if (queue.empty()) Next();
+				return;
+			}
 			queue.push(this);
+			if (queue.size() == 1) DeferredSend(); // if it's the first one going in the queue, trigger it
 			return;
 		}
 		case Method::POST:
@@ -55,12 +84,37 @@ namespace Network
 		connect(reply,&QNetworkReply::finished,this,&Request::Finished);
 	}
 
+	void Request::Abort()
+	{
+		aborted=true;
+		if (reply) reply->abort();
+	}
+
 	void Request::DeferredSend()
 	{
+		if (aborted)
+		{
+			// nobody is waiting on this one anymore, so don't bother sending it
+			queue.pop();
+			deleteLater();
+			Next();
+			return;
+		}
 		reply=networkManager->get(request);
 		reply->connect(reply,&QNetworkReply::finished,this,&Request::DeferredFinished);
 	}
 
+	void Request::Next()
+	{
+		if (queue.empty())
+		{
+			if (backlog.empty()) return;
+			queue.push(backlog.front());
+			backlog.pop();
+		}
+		queue.front()->DeferredSend();
+	}
+
 	void Request::Finished()
 	{
 		callback(reply);
@@ -72,7 +126,7 @@ namespace Network
 	{
 		// remove this network call and make the next network call if there is one waiting in the queue
 		queue.pop();
-		if (queue.size() > 0) queue.front()->DeferredSend();
+		Next();
 		Finished();
 	}
 }
\ No newline at end of file
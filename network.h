@@ -4,6 +4,7 @@
 #include <QNetworkReply>
 #include <QUrlQuery>
 #include <queue>
+#include "async.h"
 
 namespace Network
 {
@@ -21,6 +22,13 @@ namespace Network
 		DELETE
 	};
 
+	//! Low priority GETs only go out while no normal GET is waiting, so background work can't hold up chat
+	enum class Priority
+	{
+		NORMAL,
+		LOW
+	};
+
 	struct Header
 	{
 		QByteArray key;
@@ -29,23 +37,38 @@ namespace Network
 	using Headers=std::vector<Header>;
 	using Callback=std::function<void(QNetworkReply*)>;
 
+	struct Reply
+	{
+		Reply(QNetworkReply *reply);
+		int status;
+		QNetworkReply::NetworkError error;
+		QString errorString;
+		QByteArray body;
+	};
+
 	class Request final : public QObject
 	{
 		Q_OBJECT
 	public:
-		static Request* Send(const QUrl &url,Method method,Callback callback,const QUrlQuery &queryParameters=QUrlQuery{},const Headers &headers=Headers{},const QByteArray &payload=QByteArray{});
+		static Request* Send(const QUrl &url,Method method,Callback callback,const QUrlQuery &queryParameters=QUrlQuery{},const Headers &headers=Headers{},const QByteArray &payload=QByteArray{},Priority priority=Priority::NORMAL);
+		static Async::Task<Reply> Await(QUrl url,Method method,QUrlQuery queryParameters=QUrlQuery{},Headers headers=Headers{},QByteArray payload=QByteArray{});
+		void Abort();
 	private:
-		Request(const QUrl &url,Method method,Callback callback,const QUrlQuery &queryParameters,const Headers &headers,const QByteArray &payload);
+		Request(const QUrl &url,Method method,Callback callback,const QUrlQuery &queryParameters,const Headers &headers,const QByteArray &payload,Priority priority);
 		QUrl url;
 		Method method;
 		Callback callback;
 		QUrlQuery queryParameters;
 		Headers headers;
 		QByteArray payload;
+		Priority priority;
 		QNetworkRequest request;
 		QNetworkReply *reply;
+		bool aborted;
 		static std::unique_ptr<QNetworkAccessManager> networkManager;
 		static std::queue<Request*> queue;
+		static std::queue<Request*> backlog;
+		static void Next();
 		void Send();
 		void DeferredSend();
 	private slots:
@@ -1,21 +1,23 @@
 #include "panes.h"
 
 #include <QVBoxLayout>
-#include <QStackedLayout>
+#include <QPainter>
+#include <QTextDocument>
+#include <QAbstractTextDocumentLayout>
+#include <QGraphicsScene>
+#include <QGraphicsPixmapItem>
+#include <QGraphicsDropShadowEffect>
 #include <QLabel>
 #include <QResizeEvent>
 #include <QTextBlock>
+#include <QScreen>
+#include <QFontMetrics>
+#include "cache.h"
+#include "decode.h"
+#include "textfit.h"
 
 const QString StatusPane::SETTINGS_CATEGORY="StatusPane";
 
-QMediaPlayer* BuildPlayer(QObject *parent,qreal initialVolume)
-{
-	QMediaPlayer *player=new QMediaPlayer(parent);
-	player->setAudioOutput(new QAudioOutput(parent));
-	player->audioOutput()->setVolume(initialVolume);
-	return player;
-}
-
 StatusPane::StatusPane(QWidget *parent) : PersistentPane(parent),
 	output(this),
 	settingFont(SETTINGS_CATEGORY,"Font","Droid Sans Mono"),
@@ -75,12 +77,17 @@ const QString ChatPane::SETTINGS_CATEGORY="ChatPane";
 ChatPane::ChatPane(QWidget *parent) : PersistentPane(parent),
 	agenda(nullptr),
 	chat(nullptr),
+	view(nullptr),
 	status(nullptr),
 	settingFont(SETTINGS_CATEGORY,"Font","Copperplate Gothic Bold"),
 	settingFontSize(SETTINGS_CATEGORY,"FontSize",12),
 	settingForegroundColor(SETTINGS_CATEGORY,"ForegroundColor","#ffffffff"),
 	settingBackgroundColor(SETTINGS_CATEGORY,"BackgroundColor","#ff000000"),
-	settingStatusInterval(SETTINGS_CATEGORY,"StatusInterval",5000)
+	settingStatusInterval(SETTINGS_CATEGORY,"StatusInterval",5000),
+	settingScrollback(SETTINGS_CATEGORY,"Scrollback",500),
+	settingVirtualized(SETTINGS_CATEGORY,"Virtualized",false),
+	settingAppendInterval(SETTINGS_CATEGORY,"AppendInterval",0), // in milliseconds, 0 follows the display's refresh rate
+	settingScaleImages(SETTINGS_CATEGORY,"ScaleImages",false)
 {
 	setLayout(new QVBoxLayout(this));
 	layout()->setContentsMargins(0,0,0,0);
@@ -95,13 +102,25 @@ ChatPane::ChatPane(QWidget *parent) : PersistentPane(parent),
 	agenda->hide();
 	layout()->addWidget(agenda);
 
-	chat=new PinnedTextEdit(this);
-	chat->setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
-	chat->setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
-	chat->setFrameStyle(QFrame::NoFrame);
-	chat->setCursorWidth(0);
-	layout()->addWidget(chat);
-	connect(chat,&PinnedTextEdit::ContextMenu,this,&ChatPane::ContextMenu);
+	if (settingVirtualized)
+	{
+		view=new ChatView(this);
+		view->setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+		view->setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+		view->setFrameStyle(QFrame::NoFrame);
+		layout()->addWidget(view);
+		connect(view,&ChatView::ContextMenu,this,&ChatPane::ContextMenu);
+	}
+	else
+	{
+		chat=new PinnedTextEdit(this);
+		chat->setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+		chat->setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+		chat->setFrameStyle(QFrame::NoFrame);
+		chat->setCursorWidth(0);
+		layout()->addWidget(chat);
+		connect(chat,&PinnedTextEdit::ContextMenu,this,&ChatPane::ContextMenu);
+	}
 
 	status=new QLabel(this);
 	status->setMargin(16);
@@ -114,6 +133,13 @@ ChatPane::ChatPane(QWidget *parent) : PersistentPane(parent),
 	statusClock.setInterval(TimeConvert::Interval(static_cast<std::chrono::milliseconds>(settingStatusInterval)));
 	connect(&statusClock,&QTimer::timeout,this,&ChatPane::DismissStatus);
 
+	appendClock.setSingleShot(true);
+	appendClock.setTimerType(Qt::PreciseTimer);
+	connect(&appendClock,&QTimer::timeout,this,&ChatPane::Flush);
+
+	connect(&Cache::Assets::Shared(),&Cache::Assets::Fetched,this,&ChatPane::Reload);
+	connect(&Cache::Assets::Shared(),&Cache::Assets::Failed,this,&ChatPane::Abandon);
+
 	Format();
 }
 
@@ -133,66 +159,178 @@ void ChatPane::SetAgenda(const QString &text)
 
 void ChatPane::Format()
 {
-	chat->setStyleSheet(StyleSheet::Colors<PinnedTextEdit>(settingForegroundColor,settingBackgroundColor));
-	chat->setFontFamily(settingFont);
-	chat->setFontPointSize(settingFontSize);
-	chat->document()->setDefaultStyleSheet(QString("div.user { font-family: '%1'; font-size: %2pt; } div.message, span.message { font-family: '%1'; font-size: %3pt; }").arg(static_cast<QString>(settingFont),StringConvert::Integer(static_cast<int>(settingFontSize)*1.333),StringConvert::Integer(static_cast<int>(settingFontSize))));
-	chat->document()->setDocumentMargin(static_cast<qreal>(settingFontSize)*1.333);
+	const QString styleSheet=QString("div.user { font-family: '%1'; font-size: %2pt; } div.message, span.message { font-family: '%1'; font-size: %3pt; }").arg(static_cast<QString>(settingFont),StringConvert::Integer(static_cast<int>(settingFontSize)*1.333),StringConvert::Integer(static_cast<int>(settingFontSize)));
+	const qreal margin=static_cast<qreal>(settingFontSize)*1.333;
+	const bool rescaled=ChatImages::Shared().Scale(settingScaleImages ? QFontMetrics(QFont(settingFont,static_cast<int>(settingFontSize))).height() : 0,devicePixelRatioF());
+	if (view)
+	{
+		view->setStyleSheet(StyleSheet::Colors<ChatView>(settingForegroundColor,settingBackgroundColor));
+		view->Format(QFont(settingFont,static_cast<int>(settingFontSize)),settingForegroundColor,styleSheet,margin);
+		view->SetScrollback(static_cast<int>(settingScrollback));
+	}
+	else
+	{
+		chat->setStyleSheet(StyleSheet::Colors<PinnedTextEdit>(settingForegroundColor,settingBackgroundColor));
+		chat->setFontFamily(settingFont);
+		chat->setFontPointSize(settingFontSize);
+		chat->document()->setDefaultStyleSheet(styleSheet);
+		chat->document()->setDocumentMargin(margin);
+		chat->SetScrollback(static_cast<int>(settingScrollback));
+		if (rescaled) chat->Rescale();
+	}
 	status->setStyleSheet(StyleSheet::Colors<QLabel>(settingForegroundColor,settingBackgroundColor));
 	status->setFont(QFont(settingFont,static_cast<qreal>(settingFontSize)*0.833)); // QLabel doesn't have setFontFamily()
+
+	int interval=static_cast<int>(settingAppendInterval);
+	if (interval < 1) interval=std::max(1,qRound(1000.0/(screen() ? screen()->refreshRate() : 60.0)));
+	appendClock.setInterval(interval);
 }
 
 void ChatPane::Refresh()
 {
 	Format();
-	chat->viewport()->update();
+	if (!view) chat->viewport()->update(); // formatting the virtualized view already repaints it
 }
 
-void ChatPane::Message(std::shared_ptr<Chat::Message> message) const
+void ChatPane::Message(std::shared_ptr<Chat::Message> message)
 {
-	const QString imageTemplate(R"(<img style="vertical-align: middle;" src="%1" />)");
+	static const QLatin1String BADGE_OPEN("<img style='vertical-align: middle;' src='");
+	static const QLatin1String BADGE_CLOSE("' /> ");
+	static const QLatin1String EMOTE_OPEN(R"(<img style="vertical-align: middle;" src=")");
+	static const QLatin1String EMOTE_CLOSE(R"(" />)");
+
+	const QString &text=message->text;
+	const QString color=message->color.isValid() ? message->color.name() : static_cast<QString>(settingForegroundColor);
 
-	const QStringList &badgeList=message->badges;
-	QString badges;
-	for (const QString &icon : badgeList) badges.append(QString{"<img style='vertical-align: middle;' src='%1' /> "}.arg(icon));
+	// size the buffer for the worst case up front (every character escaped as &quot;) so appending never has to reallocate
+	qsizetype reserve=128+message->displayName.size()+color.size()+text.size()*6;
+	for (const QString &icon : message->badges) reserve+=BADGE_OPEN.size()+icon.size()+BADGE_CLOSE.size();
+	for (const Chat::Emote &emote : message->emotes) reserve+=EMOTE_OPEN.size()+emote.path.size()+EMOTE_CLOSE.size();
+	markup.resize(0);
+	markup.reserve(reserve);
 
-	int reserve=0;
-	for (const Chat::Emote &emote : message->emotes) reserve+=imageTemplate.size()+emote.path.size()-emote.name.size();
-	message->text.reserve(reserve);
+	markup.append(QLatin1String("<div>"));
+	for (const QString &icon : message->badges) markup.append(BADGE_OPEN).append(icon).append(BADGE_CLOSE);
+	markup.append(QLatin1String("</div><div class='user' style='color: ")).append(color).append(QLatin1String(";'>")).append(message->displayName);
+	markup.append(message->action ? QLatin1String(" <span class='message'>") : QLatin1String("</div><div class='message'>"));
 
-	Chat::EmoteList::const_reverse_iterator emote=message->emotes.crbegin();
-	for (int index=message->text.size()-1; index >= 0; index--)
+	// walk the text once, copying untouched runs in one go and swapping in escapes and emotes as they come up
+	Chat::EmoteList::const_iterator emote=message->emotes.cbegin();
+	qsizetype run=0;
+	qsizetype index=0;
+	while (index < text.size())
 	{
-		// replace entities
-		if (!message->html)
+		while (emote != message->emotes.cend() && emote->start < index) emote++; // overlapping or out of range positions from the server
+		if (emote != message->emotes.cend() && emote->start == index)
 		{
-			if (message->text.at(index) == QLatin1Char('<'))
-				message->text.replace(index,1,"&lt;");
-			else if (message->text.at(index) == QLatin1Char('>'))
-				message->text.replace(index,1,"&gt;");
-			else if (message->text.at(index) == QLatin1Char('&'))
-				message->text.replace(index,1,"&amp;");
-			else if (message->text.at(index) == QLatin1Char('"'))
-				message->text.replace(index,1,"&quot;");
+			markup.append(QStringView(text).mid(run,index-run));
+			markup.append(EMOTE_OPEN).append(emote->path).append(EMOTE_CLOSE);
+			index+=std::max<qsizetype>(emote->name.size(),1);
+			run=index;
+			emote++;
+			continue;
 		}
 
-		// replace emotes
-		if (emote != message->emotes.crend() && index == emote->start)
+		if (!message->html)
 		{
-			message->text.replace(index,emote->name.size(),imageTemplate.arg(emote->path));
-			emote++;
+			QLatin1String entity;
+			switch (text.at(index).unicode())
+			{
+			case u'<':
+				entity=QLatin1String("&lt;");
+				break;
+			case u'>':
+				entity=QLatin1String("&gt;");
+				break;
+			case u'&':
+				entity=QLatin1String("&amp;");
+				break;
+			case u'"':
+				entity=QLatin1String("&quot;");
+				break;
+			}
+			if (!entity.isEmpty())
+			{
+				markup.append(QStringView(text).mid(run,index-run)).append(entity);
+				run=index+1;
+			}
 		}
+		index++;
 	}
+	if (run < text.size()) markup.append(QStringView(text).mid(run));
+
+	markup.append(message->action ? QLatin1String("</span></div>") : QLatin1String("</div>"));
+
+	// remember which images are still downloading so only this line gets repainted when they land
+	QStringList resources;
+	for (const QString &icon : message->badges) Missing(icon,resources);
+	for (const Chat::Emote &emote : message->emotes) Missing(emote.path,resources);
+
+	// messages are held until the next frame so a flood of them costs one layout and one scroll
+	pending.push_back({QString(markup.constData(),markup.size()),message->id,resources}); // deep copy so the scratch buffer is never shared and keeps its capacity
+	if (!appendClock.isActive()) appendClock.start();
+}
+
+void ChatPane::Missing(const QString &source,QStringList &resources)
+{
+	const QUrl url(source);
+	if (url.scheme() != Cache::SCHEME_ASSET || Cache::Assets::Shared().Contains(url.path()) || resources.contains(source)) return;
+	resources.append(source);
+}
+
+void ChatPane::Flush()
+{
+	// anything that finished downloading while the line was queued will be picked up when it's laid out
+	for (ChatLine &line : pending) line.resources.removeIf([](const QString &resource) { return Cache::Assets::Shared().Contains(QUrl(resource).path()); });
+
+	if (view)
+		view->Append(pending);
+	else
+		chat->Append(pending);
+	pending.clear();
+}
 
-	if (message->action)
-		chat->Append(QString("<div>%4</div><div class='user' style='color: %3;'>%1 <span class='message'>%2</span></div>").arg(message->displayName,message->text,message->color.isValid() ? message->color.name() : settingForegroundColor,badges),message->id);
+void ChatPane::Reload(const QString &key)
+{
+	// most downloads are prefetches nothing is showing yet, and those get decoded when a line first lays them out
+	const QString resource=Cache::Assets::URL(key).toString();
+	if (view ? view->Waiting(resource) : chat->Waiting(resource))
+		Repaint(resource).Start(this);
+	else
+		Abandon(key); // lines laid out later read it from the cache, so nothing needs to keep waiting for it
+}
+
+Async::Task<void> ChatPane::Repaint(QString resource)
+{
+	co_await ChatImages::Shared().Preload(QUrl(resource));
+	if (view)
+		view->Reload(resource);
+	else
+		chat->Reload(resource);
+}
+
+void ChatPane::Abandon(const QString &key)
+{
+	const QString resource=Cache::Assets::URL(key).toString();
+	for (ChatLine &line : pending) line.resources.removeAll(resource);
+	if (view)
+		view->Abandon(resource);
 	else
-		chat->Append(QString("<div>%4</div><div class='user' style='color: %3;'>%1</div><div class='message'>%2</div>").arg(message->displayName,message->text,message->color.isValid() ? message->color.name() : settingForegroundColor,badges),message->id);
+		chat->Abandon(resource);
 }
 
 void ChatPane::DeleteMessage(const QString &id)
 {
-	chat->Remove(id);
+	if (auto line=std::find_if(pending.begin(),pending.end(),[&id](const ChatLine &line) { return line.id == id; }); line != pending.end())
+	{
+		pending.erase(line);
+		return;
+	}
+
+	if (view)
+		view->Remove(id);
+	else
+		chat->Remove(id);
 }
 
 void ChatPane::Print(const QString &text)
@@ -241,20 +379,25 @@ ApplicationSetting& ChatPane::StatusInterval()
 	return settingStatusInterval;
 }
 
-EphemeralPane::EphemeralPane(QWidget *parent,bool highPriority) : QWidget(parent), expired(false), highPriority(highPriority)
+ApplicationSetting& ChatPane::Scrollback()
 {
-	setVisible(false);
-	connect(this,&EphemeralPane::Finished,this,&EphemeralPane::Expire);
+	return settingScrollback;
 }
 
-void EphemeralPane::LowerPriority()
+ApplicationSetting& ChatPane::AppendInterval()
 {
-	highPriority=false;
+	return settingAppendInterval;
 }
 
-bool EphemeralPane::HighPriority() const
+ApplicationSetting& ChatPane::ScaleImages()
 {
-	return highPriority;
+	return settingScaleImages;
+}
+
+EphemeralPane::EphemeralPane(QWidget *parent) : QWidget(parent), expired(false)
+{
+	setVisible(false);
+	connect(this,&EphemeralPane::Finished,this,&EphemeralPane::Expire);
 }
 
 void EphemeralPane::Expire()
@@ -265,11 +408,11 @@ void EphemeralPane::Expire()
 	deleteLater();
 }
 
-VideoPane::VideoPane(const QString &path,QWidget *parent) noexcept(false) : EphemeralPane(parent), videoPlayer(BuildPlayer(this,1)), viewport(new QVideoWidget(this))
+VideoPane::VideoPane(const QString &path,QWidget *parent) noexcept(false) : EphemeralPane(parent), videoPlayer(nullptr), viewport(new QVideoWidget(this))
 {
 	if (!QFile(path).exists()) throw std::runtime_error(QString{"Video doesn't exist ("+path+")"}.toStdString());
+	videoPlayer=Media::Pool::Shared().Acquire(QUrl::fromLocalFile(path));
 	videoPlayer->setVideoOutput(viewport);
-	videoPlayer->setSource(QUrl::fromLocalFile(path));
 	connect(videoPlayer,&QMediaPlayer::playbackStateChanged,this,[this](QMediaPlayer::PlaybackState state) {
 		if (state == QMediaPlayer::StoppedState) emit Finished();
 	});
@@ -279,6 +422,11 @@ VideoPane::VideoPane(const QString &path,QWidget *parent) noexcept(false) : Ephe
 	layout()->addWidget(viewport);
 }
 
+VideoPane::~VideoPane()
+{
+	Media::Pool::Shared().Release(videoPlayer,this);
+}
+
 void VideoPane::showEvent(QShowEvent *event)
 {
 	videoPlayer->play();
@@ -298,7 +446,7 @@ QString VideoPane::Subsystem()
 
 const QString ScrollingPane::SETTINGS_CATEGORY="ScrollingPane";
 
-ScrollingPane::ScrollingPane(const QString &text,QWidget *parent) : EphemeralPane(parent,false),
+ScrollingPane::ScrollingPane(const QString &text,QWidget *parent) : EphemeralPane(parent),
 	commands(new ScrollingTextEdit(this)),
 	settingFont(SETTINGS_CATEGORY,"Font","Copperplate Gothic Bold"),
 	settingFontSize(SETTINGS_CATEGORY,"FontSize",20),
@@ -330,11 +478,135 @@ QString ScrollingPane::Subsystem()
 	return u"scrolling pane"_s;
 }
 
+AnnounceCanvas::AnnounceCanvas(QWidget *parent) : QWidget(parent), shadowRadius(0), margin(16), stale(true)
+{
+	setAttribute(Qt::WA_OpaquePaintEvent,false);
+}
+
+void AnnounceCanvas::SetText(const QString &text)
+{
+	if (this->text == text) return;
+	this->text=text;
+	Invalidate();
+}
+
+void AnnounceCanvas::SetImage(const QImage &image)
+{
+	this->image=image;
+	Invalidate();
+}
+
+void AnnounceCanvas::SetColors(const QColor &foreground,const QColor &background)
+{
+	this->foreground=foreground;
+	this->background=background;
+	Invalidate();
+}
+
+void AnnounceCanvas::SetShadow(const QColor &color,qreal radius)
+{
+	shadowColor=color;
+	shadowRadius=radius;
+	Invalidate();
+}
+
+int AnnounceCanvas::Margin() const
+{
+	return margin;
+}
+
+void AnnounceCanvas::Invalidate()
+{
+	stale=true;
+	update();
+}
+
+void AnnounceCanvas::Render()
+{
+	if (size().isEmpty()) return;
+	const qreal ratio=devicePixelRatioF();
+	frame=QPixmap(size()*ratio);
+	frame.setDevicePixelRatio(ratio);
+	frame.fill(Qt::transparent);
+	stale=false;
+
+	QPainter painter(&frame);
+	painter.setRenderHints(QPainter::Antialiasing|QPainter::TextAntialiasing|QPainter::SmoothPixmapTransform);
+
+	// the image covers the whole pane, cropped evenly on the long side
+	if (!image.isNull())
+	{
+		const int side=std::max(width(),height());
+		painter.drawImage(QRect(QPoint((width()-side)/2,(height()-side)/2),QSize(side,side)),image);
+	}
+	painter.fillRect(rect(),background);
+
+	QTextDocument document;
+	document.setDefaultFont(font());
+	document.setDocumentMargin(margin);
+	QTextOption option(Qt::AlignCenter);
+	option.setWrapMode(QTextOption::WordWrap);
+	document.setDefaultTextOption(option);
+	document.setHtml(text);
+	document.setTextWidth(width());
+	const QPointF origin(0,(height()-document.size().height())/2);
+	QAbstractTextDocumentLayout::PaintContext context;
+	context.palette=palette();
+	context.palette.setColor(QPalette::Text,foreground);
+
+	if (shadowRadius <= 0 || shadowColor.alpha() == 0)
+	{
+		painter.translate(origin);
+		document.documentLayout()->draw(&painter,context);
+		return;
+	}
+
+	// the glow is blurred here, once per size, by the same effect that used to run on every repaint
+	QImage glyphs(frame.size(),QImage::Format_ARGB32_Premultiplied);
+	glyphs.setDevicePixelRatio(ratio);
+	glyphs.fill(Qt::transparent);
+	QPainter glyphPainter(&glyphs);
+	glyphPainter.setRenderHints(QPainter::Antialiasing|QPainter::TextAntialiasing);
+	glyphPainter.translate(origin);
+	document.documentLayout()->draw(&glyphPainter,context);
+	glyphPainter.end();
+
+	QGraphicsScene scene;
+	scene.setSceneRect(rect());
+	QGraphicsPixmapItem *item=scene.addPixmap(QPixmap::fromImage(glyphs));
+	QGraphicsDropShadowEffect *shadow=new QGraphicsDropShadowEffect(); // the item takes ownership of the effect
+	shadow->setBlurRadius(shadowRadius);
+	shadow->setOffset(0,0);
+	shadow->setColor(shadowColor);
+	item->setGraphicsEffect(shadow);
+	scene.render(&painter,rect(),rect());
+}
+
+void AnnounceCanvas::paintEvent(QPaintEvent *event)
+{
+	Q_UNUSED(event)
+	if (stale || frame.size() != size()*devicePixelRatioF()) Render();
+	QPainter painter(this);
+	painter.drawPixmap(0,0,frame);
+}
+
+void AnnounceCanvas::resizeEvent(QResizeEvent *event)
+{
+	stale=true;
+	QWidget::resizeEvent(event);
+}
+
+void AnnounceCanvas::changeEvent(QEvent *event)
+{
+	if (event->type() == QEvent::FontChange || event->type() == QEvent::PaletteChange) stale=true;
+	QWidget::changeEvent(event);
+}
+
 const QString AnnouncePane::SETTINGS_CATEGORY="AnnouncePane";
 
 AnnouncePane::AnnouncePane(const Lines &lines,QWidget *parent) : EphemeralPane(parent),
 	lines(lines),
-	output(new QLabel(this)),
+	output(new AnnounceCanvas(this)),
 	settingDuration(SETTINGS_CATEGORY,"Duration",5000),
 	settingFont(SETTINGS_CATEGORY,"Font","Copperplate Gothic Bold"),
 	settingFontSize(SETTINGS_CATEGORY,"FontSize",20),
@@ -347,12 +619,8 @@ AnnouncePane::AnnouncePane(const Lines &lines,QWidget *parent) : EphemeralPane(p
 	verticalLayout->setContentsMargins(0,0,0,0);
 	verticalLayout->setSpacing(0);
 
-	output->setStyleSheet(StyleSheet::Colors<QLabel>(settingForegroundColor,settingBackgroundColor));
+	output->SetColors(settingForegroundColor,settingBackgroundColor);
 	output->setFont(QFont(settingFont,settingFontSize,QFont::Bold));
-	output->setMargin(16);
-	output->setAlignment(Qt::AlignCenter);
-	output->setWordWrap(true);
-	output->setTextFormat(Qt::RichText);
 
 	clock.setSingleShot(true);
 	connect(&clock,&QTimer::timeout,this,&AnnouncePane::Finished);
@@ -369,6 +637,12 @@ void AnnouncePane::SingleLine(const QString &text)
 	lines.emplace_back(text,1);
 }
 
+void AnnouncePane::SetLines(const Lines &lines)
+{
+	this->lines=lines;
+	AdjustText(width());
+}
+
 bool AnnouncePane::event(QEvent *event)
 {
 	if (event->type() == QEvent::Polish) Polish();
@@ -396,7 +670,7 @@ void AnnouncePane::resizeEvent(QResizeEvent *event)
 
 void AnnouncePane::AdjustText(int width)
 {
-	output->setText(BuildParagraph(width));
+	output->SetText(BuildParagraph(width));
 }
 
 void AnnouncePane::Polish()
@@ -411,8 +685,9 @@ QString AnnouncePane::BuildParagraph(int width)
 	for (const Line &line : lines)
 	{
 		font.setPointSizeF(output->font().pointSizeF()*line.size);
-		int pointSize=line.text.contains(QChar{32}) ? font.pointSize() : StringConvert::RestrictFontWidth(font,line.text,width-output->margin()*2);
-		if (line.size == 1 && font.pointSizeF() == output->font().pointSizeF())
+		const int available=width-output->Margin()*2;
+		int pointSize=line.text.contains(QChar{32}) ? TextFit::Wrapped(font,line.text,available) : TextFit::SingleLine(font,line.text,available);
+		if (line.size == 1 && pointSize == font.pointSize()) // nothing needed shrinking
 			paragraph.append(line.text);
 		else
 			paragraph.append(QString(R"(<span style="font-size: %2pt;">%1</span>)").arg(line.text,StringConvert::Integer(pointSize)));
@@ -456,9 +731,23 @@ QString AnnouncePane::Subsystem()
 	return u"announce pane"_s;
 }
 
-AudioAnnouncePane::AudioAnnouncePane(const Lines &lines,const QString &path,QWidget *parent) : AnnouncePane(lines,parent), audioPlayer(BuildPlayer(this,1)), path(path)
+AudioAnnouncePane::AudioAnnouncePane(const Lines &lines,const QString &path,QWidget *parent) : AnnouncePane(lines,parent), audioPlayer(nullptr), voice(0), path(path)
 {
 	if (!QFile(path).exists()) throw std::runtime_error(QString{"Audio doesn't exist ("+path+")"}.toStdString());
+
+	// short sounds that have played before come straight out of memory, everything else goes through a media player while the mixer decodes it for next time
+	Media::Mixer &mixer=Media::Mixer::Shared();
+	clip=mixer.Find(path);
+	if (clip)
+	{
+		connect(&mixer,&Media::Mixer::Finished,this,[this](int finished) {
+			if (finished == voice) emit Finished();
+		});
+		return;
+	}
+	mixer.Cache(path);
+
+	audioPlayer=Media::Pool::Shared().Acquire(QUrl::fromLocalFile(path));
 	connect(audioPlayer,&QMediaPlayer::playbackStateChanged,this,[this](QMediaPlayer::PlaybackState state) {
 		if (state == QMediaPlayer::StoppedState) emit Finished();
 	});
@@ -475,28 +764,62 @@ AudioAnnouncePane::AudioAnnouncePane(const QString &text,const QString &path,QWi
 	SingleLine(text);
 }
 
+AudioAnnouncePane::~AudioAnnouncePane()
+{
+	if (voice) Media::Mixer::Shared().Stop(voice);
+	Media::Pool::Shared().Release(audioPlayer,this);
+}
+
 void AudioAnnouncePane::showEvent(QShowEvent *event)
 {
+	if (clip)
+	{
+		if (voice)
+			Media::Mixer::Shared().Resume(voice);
+		else
+			voice=Media::Mixer::Shared().Play(clip);
+		emit DurationAvailable(clip->Duration());
+		QWidget::showEvent(event);
+		return;
+	}
+
+	if (Media::Pool::Ready(audioPlayer)) // prerolled, or shown before and then hidden by a higher priority pane
+	{
+		audioPlayer->play();
+		QWidget::showEvent(event);
+		return;
+	}
+
+	if (audioPlayer->mediaStatus() == QMediaPlayer::InvalidMedia)
+	{
+		emit Print(QString("Failed to load audio: %1").arg(audioPlayer->errorString()),"load audio",Subsystem());
+		emit Finished();
+		return;
+	}
+
+	disconnect(audioPlayer,&QMediaPlayer::mediaStatusChanged,this,nullptr);
 	connect(audioPlayer,&QMediaPlayer::mediaStatusChanged,this,[this,event](QMediaPlayer::MediaStatus status) {
 		if (status == QMediaPlayer::LoadedMedia)
 		{
+			disconnect(audioPlayer,&QMediaPlayer::mediaStatusChanged,this,nullptr);
 			audioPlayer->play();
 			QWidget::showEvent(event);
 			return;
 		}
 		if (status == QMediaPlayer::InvalidMedia)
 		{
+			disconnect(audioPlayer,&QMediaPlayer::mediaStatusChanged,this,nullptr);
 			emit Print(QString("Failed to load audio: %1").arg(audioPlayer->errorString()),"load audio",Subsystem());
 			emit Finished();
 		}
 		event->ignore();
 	});
-	audioPlayer->setSource(QUrl::fromLocalFile(path));
 }
 
 void AudioAnnouncePane::hideEvent(QHideEvent *event)
 {
-	audioPlayer->pause();
+	if (voice) Media::Mixer::Shared().Pause(voice);
+	if (audioPlayer) audioPlayer->pause();
 	QWidget::hideEvent(event);
 }
 
@@ -505,22 +828,8 @@ QString AudioAnnouncePane::Subsystem()
 	return u"audible announce pane"_s;
 }
 
-ImageAnnouncePane::ImageAnnouncePane(const Lines &lines,const QImage &image,QWidget *parent) : AnnouncePane(lines,parent), view(nullptr), stack(nullptr), shadow(nullptr), image(image), pixmap(nullptr)
+ImageAnnouncePane::ImageAnnouncePane(const Lines &lines,const QImage &image,QWidget *parent) : AnnouncePane(lines,parent), image(image)
 {
-	stack=new QStackedWidget(this);
-	qobject_cast<QStackedLayout*>(stack->layout())->setStackingMode(QStackedLayout::StackAll);
-
-	scene=new QGraphicsScene(this);
-	view=new QGraphicsView(scene);
-	view->setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
-	view->setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
-	pixmap=new QGraphicsPixmapItem(); // the scene takes ownership of the pixmap pointer
-	scene->addItem(pixmap);
-
-	shadow=new QGraphicsDropShadowEffect();
-	shadow->setBlurRadius(50); // TODO: abstract this out to a setting
-	shadow->setOffset(0,0);
-	output->setGraphicsEffect(shadow);
 }
 
 ImageAnnouncePane::ImageAnnouncePane(const QString &text,const QImage &image,QWidget *parent) : ImageAnnouncePane(Lines{},image,parent)
@@ -532,18 +841,24 @@ void ImageAnnouncePane::resizeEvent(QResizeEvent *event)
 {
 	if (!expired)
 	{
-		int coverSize=std::max(event->size().width(),event->size().height());
-		if (!image.isNull()) pixmap->setPixmap(QPixmap::fromImage(QImage(image).scaled(QSize(coverSize,coverSize))));
+		int side=std::max(event->size().width(),event->size().height());
+		coverSize=QSize(side,side);
+		if (!image.isNull()) Rescale(coverSize).Start(this);
 	}
 	AnnouncePane::resizeEvent(event);
 }
 
+Async::Task<void> ImageAnnouncePane::Rescale(QSize size)
+{
+	const QImage scaled=co_await Decode::Pool::Shared().Scale(image,size);
+	if (size != coverSize) co_return; // resized again while this one was scaling, so a newer one is on the way
+	output->SetImage(scaled);
+}
+
 void ImageAnnouncePane::Polish()
 {
-	shadow->setColor(settingAccentColor);
-	stack->addWidget(output);
-	stack->addWidget(view);
-	layout()->addWidget(stack);
+	output->SetShadow(settingAccentColor,50); // TODO: abstract this out to a setting
+	AnnouncePane::Polish();
 }
 
 QString ImageAnnouncePane::Subsystem()
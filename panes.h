@@ -3,11 +3,6 @@
 #include <QWidget>
 #include <QLabel>
 #include <QTextEdit>
-#include <QStackedWidget>
-#include <QGraphicsScene>
-#include <QGraphicsView>
-#include <QGraphicsDropShadowEffect>
-#include <QGraphicsPixmapItem>
 #include <QMediaPlayer>
 #include <QVideoWidget>
 #include <QTimer>
@@ -16,6 +11,7 @@
 #include "settings.h"
 #include "widgets.h"
 #include "entities.h"
+#include "media.h"
 
 struct Line
 {
@@ -67,40 +63,53 @@ public:
 	ApplicationSetting& ForegroundColor();
 	ApplicationSetting& BackgroundColor();
 	ApplicationSetting& StatusInterval();
+	ApplicationSetting& Scrollback();
+	ApplicationSetting& AppendInterval();
+	ApplicationSetting& ScaleImages();
 protected:
 	QLabel *agenda;
 	PinnedTextEdit *chat;
+	ChatView *view;
 	QLabel *status;
 	QTimer statusClock;
+	QTimer appendClock;
+	ChatLines pending;
 	std::queue<QString> statuses;
+	QString markup; // scratch space reused for every message so its capacity sticks around
 	ApplicationSetting settingFont;
 	ApplicationSetting settingFontSize;
 	ApplicationSetting settingForegroundColor;
 	ApplicationSetting settingBackgroundColor;
 	ApplicationSetting settingStatusInterval;
+	ApplicationSetting settingScrollback;
+	ApplicationSetting settingVirtualized;
+	ApplicationSetting settingAppendInterval;
+	ApplicationSetting settingScaleImages;
 	static const QString SETTINGS_CATEGORY;
 	void Format();
+	static void Missing(const QString &source,QStringList &resources);
+	Async::Task<void> Repaint(QString resource);
 signals:
 	void ContextMenu(QContextMenuEvent *event);
 public slots:
 	void Refresh();
 	void Print(const QString &text) override;
-	void Message(std::shared_ptr<Chat::Message> message) const;
+	void Message(std::shared_ptr<Chat::Message> message);
 	void DeleteMessage(const QString &id);
 protected slots:
 	void DismissStatus();
+	void Flush();
+	void Reload(const QString &key);
+	void Abandon(const QString &key);
 };
 
 class EphemeralPane : public QWidget
 {
 	Q_OBJECT
 public:
-	EphemeralPane(QWidget *parent,bool highPriority=true);
-	void LowerPriority();
-	bool HighPriority() const;
+	EphemeralPane(QWidget *parent);
 protected:
 	bool expired;
-	bool highPriority;
 	void Expire();
 	virtual QString Subsystem()=0;
 signals:
@@ -114,6 +123,7 @@ class VideoPane : public EphemeralPane
 	Q_OBJECT
 public:
 	VideoPane(const QString &path,QWidget *parent) noexcept(false);
+	~VideoPane();
 protected:
 	QMediaPlayer *videoPlayer;
 	QVideoWidget *viewport;
@@ -137,6 +147,40 @@ protected:
 	QString Subsystem() override;
 };
 
+/*!
+ * \brief Draws an announcement's image, text, and glow into a single cached pixmap
+ *
+ * Everything is rendered once per size and content change, so repainting
+ * during an announcement is a single pixmap blit. Only the widget's position
+ * is meant to change while it's on screen.
+ */
+class AnnounceCanvas : public QWidget
+{
+	Q_OBJECT
+public:
+	AnnounceCanvas(QWidget *parent);
+	void SetText(const QString &text);
+	void SetImage(const QImage &image);
+	void SetColors(const QColor &foreground,const QColor &background);
+	void SetShadow(const QColor &color,qreal radius);
+	int Margin() const;
+protected:
+	QString text;
+	QImage image;
+	QColor foreground;
+	QColor background;
+	QColor shadowColor;
+	qreal shadowRadius;
+	int margin;
+	QPixmap frame;
+	bool stale;
+	void Invalidate();
+	void Render();
+	void paintEvent(QPaintEvent *event) override;
+	void resizeEvent(QResizeEvent *event) override;
+	void changeEvent(QEvent *event) override;
+};
+
 class AnnouncePane : public EphemeralPane
 {
 	Q_OBJECT
@@ -144,6 +188,7 @@ public:
 	AnnouncePane(const Lines &lines,QWidget *parent);
 	AnnouncePane(const QString &text,QWidget *parent);
 	void Duration(const int duration) { clock.setInterval(duration); }
+	void SetLines(const Lines &lines);
 	ApplicationSetting& Font();
 	ApplicationSetting& FontSize();
 	ApplicationSetting& ForegroundColor();
@@ -152,7 +197,7 @@ public:
 	ApplicationSetting& Duration();
 protected:
 	Lines lines;
-	QLabel *output;
+	AnnounceCanvas *output;
 	QTimer clock;
 	ApplicationSetting settingDuration;
 	ApplicationSetting settingFont;
@@ -181,8 +226,11 @@ class AudioAnnouncePane : public AnnouncePane
 public:
 	AudioAnnouncePane(const Lines &lines,const QString &path,QWidget *parent);
 	AudioAnnouncePane(const QString &text,const QString &path,QWidget *parent);
+	~AudioAnnouncePane();
 protected:
 	QMediaPlayer *audioPlayer;
+	std::shared_ptr<const Media::Clip> clip;
+	int voice;
 	QString path;
 	void showEvent(QShowEvent *event) override;
 	void hideEvent(QHideEvent *event) override;
@@ -198,12 +246,9 @@ public:
 	ImageAnnouncePane(const Lines &lines,const QImage &image,QWidget *parent);
 	ImageAnnouncePane(const QString &text,const QImage &image,QWidget *parent);
 protected:
-	QGraphicsScene *scene;
-	QGraphicsView *view;
-	QStackedWidget *stack;
-	QGraphicsDropShadowEffect *shadow;
 	QImage image;
-	QGraphicsPixmapItem *pixmap;
+	QSize coverSize;
+	Async::Task<void> Rescale(QSize size);
 	void Polish() override;
 	void resizeEvent(QResizeEvent *event) override;
 	QString Subsystem() override;
@@ -4,23 +4,34 @@
 #include "security.h"
 #include "entities.h"
 #include "network.h"
+#include "binding.h"
+#include "twitch.h"
 
 const char *QUERY_PARAMETER_CLIENT_ID="client_id";
 const char *QUERY_PARAMETER_CLIENT_SECRET="client_secret";
 const char *QUERY_PARAMETER_GRANT_TYPE="grant_type";
 const char *QUERY_PARAMETER_REDIRECT_URI="redirect_uri";
 const char *QUERY_PARAMETER_SESSION_ID="state";
-const char *JSON_KEY_ACCESS_TOKEN="access";
-const char *JSON_KEY_REFRESH_TOKEN="refresh";
-const char *JSON_KEY_EXPIRY="expires_in";
-const char *JSON_KEY_SCOPES="scopes";
-const char *TWITCH_API_ENDPOINT_VALIDATE="https://id.twitch.tv/oauth2/validate";
 const char *SETTINGS_CATEGORY_REWIRE="Rewire";
 const char *OPERATION_LISTEN="listen to server";
 const char *OPERATION_AUTHENTICATE="authenticate";
 const char *ERROR_UKNOWN_REPONSE="Failed to understand response from server";
 const char *ERROR_MISSING_TOKEN="Tokens missing in response from server";
 
+struct RewireTokens
+{
+	QString access;
+	QString refresh;
+	static constexpr auto Fields() { return std::make_tuple(JSON::Required("access",&RewireTokens::access),JSON::Required("refresh",&RewireTokens::refresh)); }
+};
+
+struct TokenValidation
+{
+	int expiry;
+	QStringList scopes;
+	static constexpr auto Fields() { return std::make_tuple(JSON::Required("expires_in",&TokenValidation::expiry),JSON::Required("scopes",&TokenValidation::scopes)); }
+};
+
 const QStringList Security::SCOPES={
 	"analytics:read:extensions",
 	"analytics:read:games",
@@ -133,7 +144,7 @@ void Security::RewireConnected()
 	connect(rewireChannel,&QMqttSubscription::messageReceived,this,&Security::RewireMessage);
 
 	emit Listening();
-	ValidateTokenWithRewire(); // FIXME: should listening and validating be tied together in here?
+	ValidateTokens().Start(this); // FIXME: should listening and validating be tied together in here?
 }
 
 void Security::RewireError(QMqttClient::ClientError error)
@@ -185,105 +196,110 @@ void Security::RewireMessage(QMqttMessage message)
 		emit TokenRequestFailed();
 		return;
 	}
-	const QJsonObject object=parsedJSON().object();
-	auto jsonFieldAccessToken=object.find(JSON_KEY_ACCESS_TOKEN);
-	auto jsonFieldRefreshToken=object.find(JSON_KEY_REFRESH_TOKEN);
-	if (jsonFieldAccessToken == object.end() || jsonFieldRefreshToken == object.end())
+	RewireTokens tokens;
+	try
 	{
-		emit Print(ERROR_MISSING_TOKEN,OPERATION_LISTEN);
+		tokens=JSON::Decode<RewireTokens>(QJsonValue(parsedJSON().object()));
+	}
+
+	catch (const JSON::Error &exception)
+	{
+		emit Print(QString("%1 (%2)").arg(ERROR_MISSING_TOKEN,exception.what()),OPERATION_LISTEN);
 		emit TokenRequestFailed();
 		return;
 	}
 
-	settingOAuthToken.Set(jsonFieldAccessToken->toString());
-	settingRefreshToken.Set(jsonFieldRefreshToken->toString());
+	settingOAuthToken.Set(tokens.access);
+	settingRefreshToken.Set(tokens.refresh);
 
 	authorizing=false;
-	ObtainAdministratorProfile();
+	ObtainAdministratorProfile().Start(this);
 	tokenValidationTimer.start();
 }
 
-void Security::ValidateTokenWithRewire()
+Async::Task<void> Security::ValidateTokens()
+{
+	if (!co_await ValidateTokenWithRewire()) co_return;
+	if (!co_await ValidateTokenWithTwitch()) co_return;
+	co_await ObtainAdministratorProfile();
+}
+
+Async::Task<bool> Security::ValidateTokenWithRewire()
 {
 	// ask the server for the most recent auth and refresh tokens
-	Network::Request::Send(settingCallbackURL,Network::Method::GET,[this](QNetworkReply *reply) {
-		if (reply->error() || reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == 400) // I report back a 400 if the tokens can't be retrieved (ex. they're missing from the database)
-		{
-			emit Print("Tokens could not be retrieved from server",OPERATION_AUTHENTICATE);
-			AuthorizeUser();
-			return;
-		}
-
-		const JSON::ParseResult parsedJSON=JSON::Parse(reply->readAll());
-		if (!parsedJSON)
-		{
-			emit Print(ERROR_UKNOWN_REPONSE,OPERATION_AUTHENTICATE);
-			AuthorizeUser();
-			return;
-		}
-		const QJsonObject jsonObject=parsedJSON().object();
-		auto jsonFieldAccessToken=jsonObject.find(JSON_KEY_ACCESS_TOKEN);
-		auto jsonFieldRefreshToken=jsonObject.find(JSON_KEY_REFRESH_TOKEN);
-		if (jsonFieldAccessToken == jsonObject.end() || jsonFieldRefreshToken == jsonObject.end())
-		{
-			emit Print(ERROR_MISSING_TOKEN,OPERATION_LISTEN);
-			emit TokenRequestFailed();
-			return;
-		}
-
-		settingOAuthToken.Set(jsonFieldAccessToken->toString());
-		settingRefreshToken.Set(jsonFieldRefreshToken->toString());
-		ValidateTokenWithTwitch();
-	},{
+	const Network::Reply reply=co_await Network::Request::Await(settingCallbackURL,Network::Method::GET,{
 		{"session",settingRewireSession}
-	},{});
+	});
+
+	if (reply.error || reply.status == 400) // I report back a 400 if the tokens can't be retrieved (ex. they're missing from the database)
+	{
+		emit Print("Tokens could not be retrieved from server",OPERATION_AUTHENTICATE);
+		AuthorizeUser();
+		co_return false;
+	}
+
+	const JSON::ParseResult parsedJSON=JSON::Parse(reply.body);
+	if (!parsedJSON)
+	{
+		emit Print(ERROR_UKNOWN_REPONSE,OPERATION_AUTHENTICATE);
+		AuthorizeUser();
+		co_return false;
+	}
+	RewireTokens tokens;
+	try
+	{
+		tokens=JSON::Decode<RewireTokens>(QJsonValue(parsedJSON().object()));
+	}
+
+	catch (const JSON::Error &exception)
+	{
+		emit Print(QString("%1 (%2)").arg(ERROR_MISSING_TOKEN,exception.what()),OPERATION_LISTEN);
+		emit TokenRequestFailed();
+		co_return false;
+	}
+
+	settingOAuthToken.Set(tokens.access);
+	settingRefreshToken.Set(tokens.refresh);
+	co_return true;
 }
 
-void Security::ValidateTokenWithTwitch()
+Async::Task<bool> Security::ValidateTokenWithTwitch()
 {
 	// tokens received from the server are valid, now check with Twitch to see if they think they're valid (required per https://dev.twitch.tv/docs/authentication/validate-tokens)
-	Network::Request::Send({TWITCH_API_ENDPOINT_VALIDATE},Network::Method::GET,[this](QNetworkReply *reply) {
-		if (reply->error() || reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == 401) // 401 = access token is invalid
-		{
-			emit Print("Twitch is not recognizing access token",OPERATION_AUTHENTICATE);
-			AuthorizeUser();
-			return;
-		}
-
-		const JSON::ParseResult parsedJSON=JSON::Parse(reply->readAll());
-		if (!parsedJSON)
-		{
-			emit Print(ERROR_UKNOWN_REPONSE,OPERATION_AUTHENTICATE);
-			AuthorizeUser();
-			return;
-		}
-
-		const QJsonObject jsonObject=parsedJSON().object();
-		auto jsonFieldExpiry=jsonObject.find(JSON_KEY_EXPIRY);
-		auto jsonFieldScopes=jsonObject.find(JSON_KEY_SCOPES);
-		if (jsonFieldExpiry == jsonObject.end() || jsonFieldScopes == jsonObject.end())
-		{
-			emit Print("Twitch didn't include expiration in reply.",OPERATION_AUTHENTICATE);
-			AuthorizeUser();
-			return;
-		}
-
-		std::chrono::hours hoursRemaining=std::chrono::duration_cast<std::chrono::hours>(static_cast<std::chrono::seconds>(jsonFieldExpiry->toInt()));
-		QStringList tokenScopes=jsonFieldScopes->toVariant().toStringList();
-		QStringList requestedScopes=static_cast<QString>(settingScope).split(" ");
-		QSet<QString> scopesNeeded(requestedScopes.begin(),requestedScopes.end());
-		scopesNeeded.subtract(QSet<QString>{tokenScopes.begin(),tokenScopes.end()});
-
-		if (hoursRemaining > std::chrono::hours(1) && scopesNeeded.isEmpty()) // FIXME: I think this is the source of my "spurious reauth" problem.
-		{
-			ObtainAdministratorProfile();
-			return;
-		}
-		AuthorizeUser(); // FIXME: See above; need a way to tell the rewire server please ask for refresh token NOW. (instead of fully restarting auth process)
-	},{},{
+	const Network::Reply reply=co_await Network::Request::Await({Twitch::OAuth(Twitch::ENDPOINT_VALIDATE)},Network::Method::GET,{},{
 		{Network::CONTENT_TYPE,Network::CONTENT_TYPE_FORM},
 		{NETWORK_HEADER_AUTHORIZATION,"OAuth "_ba+static_cast<QByteArray>(settingOAuthToken)}
 	});
+
+	if (reply.error || reply.status == 401) // 401 = access token is invalid
+	{
+		emit Print("Twitch is not recognizing access token",OPERATION_AUTHENTICATE);
+		AuthorizeUser();
+		co_return false;
+	}
+
+	TokenValidation validation;
+	try
+	{
+		validation=JSON::Decode<TokenValidation>(reply.body);
+	}
+
+	catch (const JSON::Error &exception)
+	{
+		emit Print(QString("%1 (%2)").arg(ERROR_UKNOWN_REPONSE,exception.what()),OPERATION_AUTHENTICATE);
+		AuthorizeUser();
+		co_return false;
+	}
+
+	std::chrono::hours hoursRemaining=std::chrono::duration_cast<std::chrono::hours>(static_cast<std::chrono::seconds>(validation.expiry));
+	const QStringList &tokenScopes=validation.scopes;
+	QStringList requestedScopes=static_cast<QString>(settingScope).split(" ");
+	QSet<QString> scopesNeeded(requestedScopes.begin(),requestedScopes.end());
+	scopesNeeded.subtract(QSet<QString>{tokenScopes.begin(),tokenScopes.end()});
+
+	if (hoursRemaining > std::chrono::hours(1) && scopesNeeded.isEmpty()) co_return true; // FIXME: I think this is the source of my "spurious reauth" problem.
+	AuthorizeUser(); // FIXME: See above; need a way to tell the rewire server please ask for refresh token NOW. (instead of fully restarting auth process)
+	co_return false;
 }
 
 void Security::AuthorizeUser()
@@ -293,7 +309,7 @@ void Security::AuthorizeUser()
 	authorizing=true;
 
 	// trigger the OAuth process with Twitch
-	QUrl request("https://id.twitch.tv/oauth2/authorize");
+	QUrl request(Twitch::OAuth(Twitch::ENDPOINT_AUTHORIZE));
 	request.setQuery(QUrlQuery({
 		{QUERY_PARAMETER_CLIENT_ID,settingClientID},
 		{QUERY_PARAMETER_REDIRECT_URI,settingCallbackURL},
@@ -304,16 +320,20 @@ void Security::AuthorizeUser()
 	QDesktopServices::openUrl(request);
 }
 
-void Security::ObtainAdministratorProfile()
+Async::Task<void> Security::ObtainAdministratorProfile()
 {
-	Viewer::Remote *profile=new Viewer::Remote(*this,settingAdministrator);
-	connect(profile,&Viewer::Remote::Recognized,profile,[this](Viewer::Local profile) {
+	try
+	{
+		const Viewer::Local profile=co_await Viewer::Remote::Lookup(*this,settingAdministrator);
 		administratorID=profile.ID();
 		Initialize();
-	});
-	connect(profile,&Viewer::Remote::Unrecognized,this,[this]() {
+	}
+
+	catch (const std::runtime_error &exception)
+	{
+		emit Print(exception.what(),OPERATION_AUTHENTICATE);
 		AuthorizeUser();
-	});
+	}
 }
 
 const QString& Security::AdministratorID() const
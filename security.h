@@ -5,6 +5,7 @@
 #include <QTimer>
 #include <QMqttClient>
 #include "settings.h"
+#include "async.h"
 
 inline const char *QUERY_PARAMETER_CODE="code";
 inline const char *QUERY_PARAMETER_SCOPE="scope";
@@ -53,6 +54,10 @@ private:
 	bool tokensInitialized;
 	QTimer tokenValidationTimer;
 	bool authorizing;
+	Async::Task<void> ValidateTokens();
+	Async::Task<bool> ValidateTokenWithRewire();
+	Async::Task<bool> ValidateTokenWithTwitch();
+	Async::Task<void> ObtainAdministratorProfile();
 signals:
 	void Print(const QString &message,const QString operation=QString(),const QString subsystem=QString("security"));
 	void TokenRequestFailed();
@@ -62,9 +67,6 @@ signals:
 public slots:
 	void AuthorizeUser();
 private slots:
-	void ValidateTokenWithRewire();
-	void ValidateTokenWithTwitch();
-	void ObtainAdministratorProfile();
 	void RewireConnected();
 	void RewireError(QMqttClient::ClientError error);
 	void RewireMessage(QMqttMessage messasge);
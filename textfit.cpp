@@ -0,0 +1,104 @@
+#include <QFontMetricsF>
+#include <QStringList>
+#include <algorithm>
+#include <unordered_map>
+#include <functional>
+#include "textfit.h"
+
+namespace TextFit
+{
+	struct Face
+	{
+		Face(const QFont &font) : metrics(font) { }
+		QFontMetricsF metrics;
+		std::unordered_map<QString,qreal> advances; // keyed by character, or by surrogate pair
+	};
+
+	static const std::size_t FACES_LIMIT=128; // every point size a search tries is its own face, so this is a handful of fonts at every size
+	static std::unordered_map<QString,Face> faces;
+
+	static Face& Lookup(const QFont &font)
+	{
+		const QString key=font.key();
+		if (auto candidate=faces.find(key); candidate != faces.end()) return candidate->second;
+		if (faces.size() >= FACES_LIMIT) faces.clear(); // fonts hardly ever change, so starting over is cheaper than tracking which faces are in use
+		return faces.try_emplace(key,font).first->second;
+	}
+
+	static QFont Sized(QFont font,int pointSize)
+	{
+		font.setPointSize(pointSize);
+		return font;
+	}
+
+	static int Search(int largest,int guess,const std::function<bool(int)> &fits)
+	{
+		if (largest <= 1 || fits(largest)) return largest; // there's nothing smaller to try
+
+		// the guess is usually right on or one off, so check around it before falling back to bisecting the rest
+		guess=std::clamp(guess,1,largest-1);
+		int low=1;
+		int high=largest-1;
+		if (fits(guess))
+			low=guess;
+		else
+			high=guess-1;
+		while (low < high)
+		{
+			int middle=(low+high+1)/2;
+			if (fits(middle))
+				low=middle;
+			else
+				high=middle-1;
+		}
+		return std::max(low,1);
+	}
+
+	qreal Width(const QFont &font,QStringView text)
+	{
+		Face &face=Lookup(font);
+		qreal width=0;
+		for (qsizetype index=0; index < text.size(); index++)
+		{
+			qsizetype length=text.at(index).isHighSurrogate() && index+1 < text.size() ? 2 : 1;
+			const QString character=text.mid(index,length).toString();
+			auto advance=face.advances.find(character);
+			if (advance == face.advances.end()) advance=face.advances.try_emplace(character,face.metrics.horizontalAdvance(character)).first;
+			width+=advance->second;
+			index+=length-1;
+		}
+		return width;
+	}
+
+	int SingleLine(const QFont &font,const QString &text,int maxWidth)
+	{
+		const int largest=font.pointSize();
+		if (largest < 1 || maxWidth < 1) return largest;
+
+		// width grows more or less in proportion to point size, so one measurement gets close
+		const qreal width=Width(font,text);
+		if (width <= maxWidth) return largest;
+		return Search(largest,static_cast<int>(largest*maxWidth/width),[&font,&text,maxWidth](int pointSize) {
+			return Width(Sized(font,pointSize),text) <= maxWidth;
+		});
+	}
+
+	int Wrapped(const QFont &font,const QString &text,int maxWidth)
+	{
+		const int largest=font.pointSize();
+		if (largest < 1 || maxWidth < 1) return largest;
+
+		const QStringList words=text.split(' ',Qt::SkipEmptyParts);
+		auto fits=[&font,&words,maxWidth](int pointSize) {
+			// with no limit on the number of lines, the only thing that can't wrap is a single word, so each has to fit on its own
+			const QFont sized=Sized(font,pointSize);
+			return std::all_of(words.begin(),words.end(),[&sized,maxWidth](const QString &word) { return Width(sized,word) <= maxWidth; });
+		};
+
+		// start from the longest word, which is what usually decides the size when only the width is limited
+		qreal longest=0;
+		for (const QString &word : words) longest=std::max(longest,Width(font,word));
+		const int guess=longest > maxWidth ? static_cast<int>(largest*maxWidth/longest) : largest-1;
+		return Search(largest,guess,fits);
+	}
+}
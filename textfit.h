@@ -0,0 +1,22 @@
+#pragma once
+
+#include <QFont>
+#include <QString>
+#include <QStringView>
+
+/*!
+ * \brief Picks the largest point size, no larger than the font's own, that lets text fit a space
+ *
+ * Glyph advances are measured once per font and size and kept, so fitting
+ * the same font again only adds up numbers. The search starts from a guess
+ * scaled from a single measurement and narrows it down with a binary
+ * search, rather than stepping down one point at a time and re-measuring.
+ * Advances are added up without kerning, which errs on the side of a
+ * slightly smaller size.
+ */
+namespace TextFit
+{
+	qreal Width(const QFont &font,QStringView text);
+	int SingleLine(const QFont &font,const QString &text,int maxWidth);
+	int Wrapped(const QFont &font,const QString &text,int maxWidth);
+}
@@ -1,11 +1,17 @@
 #pragma once
 
 #include <QString>
+#include <QDateTime>
+#include <vector>
+#include "binding.h"
+#include "settings.h"
 
 namespace Twitch
 {
 	inline const char *API_HOST="https://api.twitch.tv/helix/";
 	inline const char *CONTENT_HOST="https://static-cdn.jtvnw.net/";
+	inline const char *OAUTH_HOST="https://id.twitch.tv/oauth2/";
+	inline const char *SETTINGS_CATEGORY_TWITCH="Twitch";
 
 	inline const char *ENDPOINT_CHAT_SETTINGS="chat/settings";
 	inline const char *ENDPOINT_STREAM_INFORMATION="streams";
@@ -13,20 +19,160 @@ namespace Twitch
 	inline const char *ENDPOINT_GAME_INFORMATION="games";
 	inline const char *ENDPOINT_USER_FOLLOWS="channels/followers";
 	inline const char *ENDPOINT_BADGES="chat/badges/global";
+	inline const char *ENDPOINT_CHANNEL_BADGES="chat/badges";
+	inline const char *ENDPOINT_CHANNEL_EMOTES="chat/emotes";
 	inline const char *ENDPOINT_SHOUTOUTS="chat/shoutouts";
 	inline const char *ENDPOINT_USERS="users";
 	inline const char *ENDPOINT_EVENTSUB="eventsub/subscriptions";
 	inline const char *ENDPOINT_EVENTSUB_SUBSCRIPTIONS="eventsub/subscriptions";
+	inline const char *ENDPOINT_EMOTES="emoticons/v2/%1/default/dark/1.0";
+	inline const char *ENDPOINT_VALIDATE="validate";
+	inline const char *ENDPOINT_AUTHORIZE="authorize";
+
+	struct Hosts
+	{
+		QString api;
+		QString content;
+		QString oauth;
+	};
+
+	//! Base URLs are read from settings once, so they can be pointed at a local stand-in for the live API
+	inline Hosts& Host()
+	{
+		static Hosts hosts{
+			.api=static_cast<QString>(ApplicationSetting(SETTINGS_CATEGORY_TWITCH,"APIHost",API_HOST)),
+			.content=static_cast<QString>(ApplicationSetting(SETTINGS_CATEGORY_TWITCH,"ContentHost",CONTENT_HOST)),
+			.oauth=static_cast<QString>(ApplicationSetting(SETTINGS_CATEGORY_TWITCH,"OAuthHost",OAUTH_HOST))
+		};
+		return hosts;
+	}
 
 	inline QString Endpoint(const QString &path)
 	{
-		return QString(API_HOST)+path;
+		return Host().api+path;
 	}
-	
-	inline const char *ENDPOINT_EMOTES="emoticons/v1/%1/1.0";
 
 	inline QString Content(const QString &path)
 	{
-		return QString(CONTENT_HOST)+path;
+		return Host().content+path;
+	}
+
+	inline QString OAuth(const QString &path)
+	{
+		return Host().oauth+path;
+	}
+
+	namespace Helix
+	{
+		template <typename T>
+		struct Response
+		{
+			std::vector<T> data;
+			static constexpr auto Fields() { return std::make_tuple(JSON::Required("data",&Response::data)); }
+		};
+
+		//! For lists where entries are independent of one another, so a malformed one is skipped rather than failing the lot
+		template <typename T>
+		struct Listing
+		{
+			JSON::Lenient<T> data;
+			static constexpr auto Fields() { return std::make_tuple(JSON::Required("data",&Listing::data)); }
+		};
+
+		//! Most lookups ask about a single user or channel, so only the first entry matters
+		template <typename T>
+		T First(const QByteArray &payload)
+		{
+			Response<T> response=JSON::Decode<Response<T>>(payload);
+			if (response.data.empty()) throw JSON::Error("No entries in data");
+			return std::move(response.data.front());
+		}
+
+		struct User
+		{
+			QString login;
+			QString id;
+			QString displayName;
+			QString profileImageURL;
+			QString description;
+			static constexpr auto Fields()
+			{
+				return std::make_tuple(
+					JSON::Required("login",&User::login),
+					JSON::Required("id",&User::id),
+					JSON::Required("display_name",&User::displayName),
+					JSON::Optional("profile_image_url",&User::profileImageURL),
+					JSON::Optional("description",&User::description)
+				);
+			}
+		};
+
+		struct Stream
+		{
+			QDateTime startedAt;
+			static constexpr auto Fields() { return std::make_tuple(JSON::Required("started_at",&Stream::startedAt)); }
+		};
+
+		struct Game
+		{
+			QString id;
+			QString name;
+			static constexpr auto Fields() { return std::make_tuple(JSON::Required("id",&Game::id),JSON::Optional("name",&Game::name)); }
+		};
+
+		struct Follower
+		{
+			QDateTime followedAt;
+			static constexpr auto Fields() { return std::make_tuple(JSON::Required("followed_at",&Follower::followedAt)); }
+		};
+
+		struct ChatSettings
+		{
+			bool emoteMode;
+			static constexpr auto Fields() { return std::make_tuple(JSON::Required("emote_mode",&ChatSettings::emoteMode)); }
+		};
+
+		struct BadgeVersion
+		{
+			QString id;
+			QString imageURL;
+			static constexpr auto Fields() { return std::make_tuple(JSON::Required("id",&BadgeVersion::id),JSON::Required("image_url_1x",&BadgeVersion::imageURL)); }
+		};
+
+		struct BadgeSet
+		{
+			QString id;
+			std::vector<BadgeVersion> versions;
+			static constexpr auto Fields() { return std::make_tuple(JSON::Required("set_id",&BadgeSet::id),JSON::Required("versions",&BadgeSet::versions)); }
+		};
+
+		struct Emote
+		{
+			QString id;
+			static constexpr auto Fields() { return std::make_tuple(JSON::Required("id",&Emote::id)); }
+		};
+
+		struct Transport
+		{
+			QString disconnectedAt;
+			static constexpr auto Fields() { return std::make_tuple(JSON::Optional("disconnected_at",&Transport::disconnectedAt)); }
+		};
+
+		struct EventSubscription
+		{
+			QString id;
+			QString type;
+			QDateTime createdAt;
+			std::optional<Transport> transport;
+			static constexpr auto Fields()
+			{
+				return std::make_tuple(
+					JSON::Required("id",&EventSubscription::id),
+					JSON::Required("type",&EventSubscription::type),
+					JSON::Required("created_at",&EventSubscription::createdAt),
+					JSON::Optional("transport",&EventSubscription::transport)
+				);
+			}
+		};
 	}
-}
\ No newline at end of file
+}
@@ -12,8 +12,17 @@
 #include <QMessageBox>
 #include <QInputDialog>
 #include <QTextFrame>
+#include <QAbstractTextDocumentLayout>
+#include <QPainter>
+#include <QGuiApplication>
+#include <cmath>
+#include <algorithm>
+#include <cstring>
+#include <limits>
 #include "globals.h"
 #include "widgets.h"
+#include "cache.h"
+#include "decode.h"
 
 namespace StyleSheet
 {
@@ -39,10 +48,193 @@ void StaticTextEdit::contextMenuEvent(QContextMenuEvent *event)
 	emit ContextMenu(event);
 }
 
-PinnedTextEdit::PinnedTextEdit(QWidget *parent) : QTextEdit(parent), scrollTransition(QPropertyAnimation(verticalScrollBar(),"sliderPosition"))
+const qsizetype ANIMATION_FRAMES_LIMIT=4*1024*1024; // bytes of decoded frames kept for any one animation
+const qsizetype ANIMATIONS_LIMIT=64*1024*1024; // bytes of decoded frames kept for all animations together
+const int ANIMATION_GRACE=250; // milliseconds past its longest frame an animation can go unpainted before it's treated as off screen
+
+ChatImages::ChatImages(QObject *parent) : QObject(parent), images(65536), animationSize(0), height(0), ratio(1)
+{
+	animationClock.setTimerType(Qt::PreciseTimer);
+	connect(&animationClock,&QTimer::timeout,this,&ChatImages::Advance);
+}
+
+QImage ChatImages::Image(const QUrl &url)
+{
+	const QString key=url.path();
+	if (auto animation=animations.find(key); animation != animations.end()) return animation->second.frames[animation->second.current];
+	if (QImage *image=images.object(key); image) return *image;
+
+	std::optional<QString> path=Cache::Assets::Shared().Path(key);
+	if (!path) return {};
+	QImageReader reader(*path);
+	QImage image=Scaled(reader.read());
+	if (image.isNull()) return {};
+	if (reader.supportsAnimation() && reader.imageCount() > 1 && Animate(key,image,reader)) return animations.at(key).frames.front();
+	images.insert(key,new QImage(image),std::max<qsizetype>(image.sizeInBytes()/1024,1));
+	return image;
+}
+
+Async::Task<void> ChatImages::Preload(QUrl url)
+{
+	const QString key=url.path();
+	if (animations.contains(key) || images.contains(key)) co_return;
+	std::optional<QString> path=Cache::Assets::Shared().Path(key);
+	if (!path) co_return;
+
+	// stills are decoded on the worker pool at their final size, animations are left for Image() to pick apart frame by frame
+	const int target=height > 0 ? qRound(height*ratio) : 0;
+	const qreal scale=ratio;
+	QImage image=co_await Decode::Pool::Shared().Run([path=*path,target]() {
+		QImageReader reader(path);
+		if (reader.supportsAnimation() && reader.imageCount() > 1) return QImage();
+		if (target < 1) return Decode::Pool::Read(reader,QSize());
+		const QSize size=reader.size();
+		if (size.isValid()) reader.setScaledSize(size.scaled(QSize(std::numeric_limits<int>::max(),target),Qt::KeepAspectRatio));
+		return reader.read().convertToFormat(QImage::Format_ARGB32_Premultiplied);
+	});
+	if (image.isNull() || target != (height > 0 ? qRound(height*ratio) : 0) || images.contains(key)) co_return; // scale changed or someone else got there first
+	if (target > 0) image.setDevicePixelRatio(scale);
+	images.insert(key,new QImage(image),std::max<qsizetype>(image.sizeInBytes()/1024,1));
+}
+
+bool ChatImages::Animated(const QUrl &url) const
+{
+	return animations.contains(url.path());
+}
+
+QImage ChatImages::Scaled(const QImage &image) const
+{
+	if (image.isNull() || height < 1 || image.height() == qRound(height*ratio)) return image;
+	QImage scaled=image.scaledToHeight(qRound(height*ratio),Qt::SmoothTransformation);
+	scaled.setDevicePixelRatio(ratio);
+	return scaled;
+}
+
+bool ChatImages::Animate(const QString &key,const QImage &first,QImageReader &reader)
+{
+	const QImage::Format format=QImage::Format_ARGB32_Premultiplied;
+	const qsizetype frameSize=first.convertToFormat(format).sizeInBytes();
+
+	// long animations keep every nth frame, each shown for as long as the ones it stands in for, so they fit under the limit
+	const int stride=std::max<int>(1,static_cast<int>((frameSize*reader.imageCount()+ANIMATION_FRAMES_LIMIT-1)/ANIMATION_FRAMES_LIMIT));
+	std::vector<QImage> frames{first.convertToFormat(format)};
+	std::vector<int> delays{0};
+	for (int index=0; ; index++)
+	{
+		int delay=reader.nextImageDelay();
+		delays.back()+=delay > 10 ? delay : 100; // browsers treat delays this short as "as fast as possible" and slow them down
+		if (!reader.canRead()) break;
+		QImage frame=reader.read();
+		if (frame.isNull()) break;
+		if ((index+1)%stride) continue;
+		frame=Scaled(frame).convertToFormat(format);
+		if (frame.size() != first.size()) frame=frame.scaled(first.size());
+		frames.push_back(frame);
+		delays.push_back(0);
+	}
+	if (frames.size() < 2) return false;
+	Evict(frameSize*static_cast<qsizetype>(frames.size()));
+
+	if (!animationTime.isValid()) animationTime.start();
+	Animation animation{
+		.atlas=QImage(first.width(),first.height()*static_cast<int>(frames.size()),format),
+		.frames={},
+		.ends={},
+		.current=0,
+		.longest=*std::max_element(delays.begin(),delays.end()),
+		.seen=animationTime.elapsed()
+	};
+	const qsizetype stripe=frames.front().sizeInBytes();
+	int end=0;
+	for (std::size_t index=0; index < frames.size(); index++)
+	{
+		std::memcpy(animation.atlas.bits()+stripe*index,frames[index].constBits(),stripe);
+		end+=delays[index];
+		animation.ends.push_back(end);
+	}
+
+	// each frame holds a reference to the atlas, so frames a document is still showing survive the animation being dropped
+	for (std::size_t index=0; index < frames.size(); index++)
+	{
+		QImage frame(animation.atlas.constBits()+stripe*index,first.width(),first.height(),animation.atlas.bytesPerLine(),format,[](void *atlas) {
+			delete static_cast<QImage*>(atlas);
+		},new QImage(animation.atlas));
+		frame.setDevicePixelRatio(first.devicePixelRatio());
+		animation.frames.push_back(frame);
+	}
+
+	animationSize+=animation.atlas.sizeInBytes();
+	animations.insert_or_assign(key,std::move(animation));
+	if (!animationClock.isActive())
+	{
+		const QScreen *screen=QGuiApplication::primaryScreen();
+		animationClock.setInterval(std::max(1,qRound(1000.0/(screen ? screen->refreshRate() : 60.0))));
+		animationClock.start();
+	}
+	return true;
+}
+
+void ChatImages::Evict(qsizetype needed)
 {
+	// documents still showing a dropped animation keep the frame they have as a still
+	while (!animations.empty() && animationSize+needed > ANIMATIONS_LIMIT)
+	{
+		auto oldest=std::min_element(animations.begin(),animations.end(),[](const auto &left,const auto &right) { return left.second.seen < right.second.seen; });
+		animationSize-=oldest->second.atlas.sizeInBytes();
+		animations.erase(oldest);
+	}
+}
+
+void ChatImages::Seen(const QUrl &url)
+{
+	if (auto animation=animations.find(url.path()); animation != animations.end()) animation->second.seen=animationTime.elapsed();
+}
+
+void ChatImages::Advance()
+{
+	if (animations.empty())
+	{
+		animationClock.stop();
+		return;
+	}
+
+	const qint64 now=animationTime.elapsed();
+	QStringList advanced;
+	for (auto &[key,animation] : animations)
+	{
+		if (now-animation.seen > animation.longest+ANIMATION_GRACE) continue; // every frame change on screen gets painted, so nothing is showing this one
+		const int position=static_cast<int>(now%animation.ends.back());
+		const std::size_t frame=std::upper_bound(animation.ends.begin(),animation.ends.end(),position)-animation.ends.begin();
+		if (frame == animation.current) continue;
+		animation.current=frame;
+		advanced.append(Cache::Assets::URL(key).toString());
+	}
+	if (!advanced.isEmpty()) emit Advanced(advanced);
+}
+
+bool ChatImages::Scale(int height,qreal ratio)
+{
+	if (this->height == height && this->ratio == ratio) return false;
+	this->height=height;
+	this->ratio=ratio;
+	images.clear();
+	animations.clear();
+	animationSize=0;
+	return true;
+}
+
+ChatImages& ChatImages::Shared()
+{
+	static ChatImages images;
+	return images;
+}
+
+PinnedTextEdit::PinnedTextEdit(QWidget *parent) : QTextEdit(parent), scrollback(0), scrollTransition(QPropertyAnimation(verticalScrollBar(),"sliderPosition"))
+{
+	setUndoRedoEnabled(false); // nobody edits chat, and the undo stack would otherwise hold on to every message ever removed
 	connect(&scrollTransition,&QPropertyAnimation::finished,this,&PinnedTextEdit::Tail);
 	connect(verticalScrollBar(),&QScrollBar::rangeChanged,this,&PinnedTextEdit::Scroll);
+	connect(&ChatImages::Shared(),&ChatImages::Advanced,this,&PinnedTextEdit::Animate);
 }
 
 void PinnedTextEdit::resizeEvent(QResizeEvent *event)
@@ -51,11 +243,71 @@ void PinnedTextEdit::resizeEvent(QResizeEvent *event)
 	QTextEdit::resizeEvent(event);
 }
 
+void PinnedTextEdit::paintEvent(QPaintEvent *event)
+{
+	QTextEdit::paintEvent(event);
+	for (const auto &[resource,rect] : Animations()) ChatImages::Shared().Seen(QUrl(resource));
+}
+
 void PinnedTextEdit::contextMenuEvent(QContextMenuEvent *event)
 {
 	emit ContextMenu(event);
 }
 
+std::vector<std::pair<QString,QRect>> PinnedTextEdit::Animations() const
+{
+	std::vector<std::pair<QString,QRect>> result;
+	QAbstractTextDocumentLayout *layout=document()->documentLayout();
+	const QPoint offset(horizontalScrollBar()->value(),verticalScrollBar()->value());
+	const QRect visible=viewport()->rect();
+
+	// chat is pinned to the bottom, so walk up from the newest line until one is above the top of the viewport
+	for (auto line=history.rbegin(); line != history.rend(); ++line)
+	{
+		QTextFrame *frame=line->second;
+		if (!frame) continue;
+		const QRect bounds=layout->frameBoundingRect(frame).toAlignedRect().translated(-offset);
+		if (bounds.bottom() < visible.top()) break;
+		if (!bounds.intersects(visible)) continue;
+
+		for (QTextFrame::iterator child=frame->begin(); !child.atEnd(); ++child)
+		{
+			const QTextBlock block=child.currentBlock();
+			if (!block.isValid()) continue;
+			for (QTextBlock::iterator candidate=block.begin(); !candidate.atEnd(); ++candidate)
+			{
+				const QTextFragment fragment=candidate.fragment();
+				if (!fragment.charFormat().isImageFormat()) continue;
+				const QUrl url(fragment.charFormat().toImageFormat().name());
+				if (!ChatImages::Shared().Animated(url)) continue;
+				const int width=static_cast<int>(std::ceil(ChatImages::Shared().Image(url).deviceIndependentSize().width()));
+
+				// a run of the same emote is one fragment with a character for each copy
+				QTextCursor cursor(document());
+				for (int position=fragment.position(); position < fragment.position()+fragment.length(); position++)
+				{
+					cursor.setPosition(position);
+					const QRect caret=cursorRect(cursor);
+					result.emplace_back(url.toString(),QRect(caret.left(),caret.top(),width,caret.height()));
+				}
+			}
+		}
+	}
+	return result;
+}
+
+QVariant PinnedTextEdit::loadResource(int type,const QUrl &name)
+{
+	if (name.scheme() != Cache::SCHEME_ASSET) return QTextEdit::loadResource(type,name);
+
+	// returning nothing leaves the document free to ask again once the download lands
+	QImage image=ChatImages::Shared().Image(name);
+	if (image.isNull()) return {};
+	document()->addResource(type,name,image);
+	resources.insert(name.toString());
+	return image;
+}
+
 void PinnedTextEdit::Scroll(int minimum,int maximum)
 {
 	Q_UNUSED(minimum)
@@ -71,14 +323,125 @@ void PinnedTextEdit::Tail()
 }
 
 
-void PinnedTextEdit::Append(const QString &text,const QString &id)
+void PinnedTextEdit::Append(const ChatLines &lines)
 {
+	if (lines.empty()) return;
 	Tail();
-	QTextCursor cursor=document()->rootFrame()->lastCursorPosition();
+
+	// one edit block means the document is laid out once for the whole batch instead of once per line
+	QTextCursor block(document());
+	block.beginEditBlock();
 	QTextFrameFormat format;
 	format.setBorderStyle(QTextFrameFormat::BorderStyle_None);
-	frames.try_emplace(id,cursor.insertFrame(format));
-	cursor.insertHtml(text);
+	for (const ChatLine &line : lines)
+	{
+		QTextCursor cursor=document()->rootFrame()->lastCursorPosition();
+		QTextFrame *frame=cursor.insertFrame(format);
+		frames.try_emplace(line.id,frame);
+		history.emplace_back(line.id,frame);
+		for (const QString &resource : line.resources) waiting[resource].push_back(frame);
+		cursor.insertHtml(line.markup);
+	}
+	const qreal removed=Trim(block); // in the same block, so the lines falling out of scrollback never get laid out again
+	block.endEditBlock();
+	Shift(removed);
+}
+
+void PinnedTextEdit::Reload(const QString &resource)
+{
+	auto candidate=waiting.find(resource);
+	if (candidate == waiting.end()) return;
+	std::vector<QPointer<QTextFrame>> targets=std::move(candidate->second);
+	waiting.erase(candidate);
+
+	const QUrl url(resource);
+	QImage image=ChatImages::Shared().Image(url);
+	if (image.isNull()) return;
+
+	// handing the document the image directly means only the frames that show it need to be laid out again
+	document()->addResource(QTextDocument::ImageResource,url,image);
+	resources.insert(resource);
+	for (const QPointer<QTextFrame> &frame : targets)
+	{
+		if (frame) document()->markContentsDirty(frame->firstPosition(),frame->lastPosition()-frame->firstPosition());
+	}
+}
+
+void PinnedTextEdit::Abandon(const QString &resource)
+{
+	// the image is never coming, so the lines showing it can stop waiting and keep their placeholder
+	waiting.erase(resource);
+}
+
+bool PinnedTextEdit::Waiting(const QString &resource) const
+{
+	auto candidate=waiting.find(resource);
+	if (candidate == waiting.end()) return false;
+	return std::any_of(candidate->second.begin(),candidate->second.end(),[](const QPointer<QTextFrame> &frame) { return !frame.isNull(); });
+}
+
+void PinnedTextEdit::Animate(const QStringList &resources)
+{
+	// frames are all the same size, so swapping the resource and repainting where it shows is enough
+	std::unordered_set<QString> swapped;
+	for (const auto &[resource,rect] : Animations())
+	{
+		if (!resources.contains(resource)) continue;
+		if (swapped.insert(resource).second) document()->addResource(QTextDocument::ImageResource,QUrl(resource),ChatImages::Shared().Image(QUrl(resource)));
+		viewport()->update(rect);
+	}
+}
+
+void PinnedTextEdit::Rescale()
+{
+	// registered resources take precedence over anything the document loaded itself, so replacing them is enough
+	for (const QString &resource : resources)
+	{
+		const QUrl url(resource);
+		QImage image=ChatImages::Shared().Image(url);
+		if (!image.isNull()) document()->addResource(QTextDocument::ImageResource,url,image);
+	}
+	document()->markContentsDirty(0,document()->characterCount());
+}
+
+void PinnedTextEdit::SetScrollback(qsizetype limit)
+{
+	scrollback=limit;
+	QTextCursor cursor(document());
+	cursor.beginEditBlock();
+	const qreal removed=Trim(cursor);
+	cursor.endEditBlock();
+	Shift(removed);
+}
+
+qreal PinnedTextEdit::Trim(QTextCursor &cursor)
+{
+	if (scrollback < 1 || static_cast<qsizetype>(history.size()) <= scrollback) return 0;
+
+	// the oldest lines were laid out long ago, so their heights are known without laying out the rest of the document
+	QAbstractTextDocumentLayout *layout=document()->documentLayout();
+	qreal height=0;
+	while (static_cast<qsizetype>(history.size()) > scrollback)
+	{
+		auto [id,frame]=std::move(history.front());
+		history.pop_front();
+		if (auto candidate=frames.find(id); candidate != frames.end() && candidate->second == frame) frames.erase(candidate);
+		if (!frame) continue;
+		height+=layout->frameBoundingRect(frame).height();
+		cursor.setPosition(frame->firstPosition()-1);
+		cursor.setPosition(frame->lastPosition()+1,QTextCursor::KeepAnchor);
+		cursor.removeSelectedText();
+	}
+	return height;
+}
+
+void PinnedTextEdit::Shift(qreal height)
+{
+	// removing from the top shrinks the document, so move the view up by the same amount to keep it from jumping
+	if (height <= 0) return;
+	scrollTransition.stop();
+	verticalScrollBar()->setValue(verticalScrollBar()->value()-static_cast<int>(height));
+	Tail();
 }
 
 void PinnedTextEdit::Remove(const QString &id)
@@ -93,6 +456,343 @@ void PinnedTextEdit::Remove(const QString &id)
 	frames.erase(frame);
 }
 
+QVariant ChatDocument::loadResource(int type,const QUrl &name)
+{
+	if (name.scheme() != Cache::SCHEME_ASSET) return QTextDocument::loadResource(type,name);
+
+	QImage image=ChatImages::Shared().Image(name);
+	if (image.isNull()) return {};
+	addResource(type,name,image);
+	if (ChatImages::Shared().Animated(name)) animated.insert(name.toString());
+	return image;
+}
+
+bool ChatDocument::Animated(const QStringList &resources) const
+{
+	return std::any_of(resources.begin(),resources.end(),[this](const QString &resource) { return animated.contains(resource); });
+}
+
+void ChatDocument::Advance()
+{
+	// only called while painting, so this is also what tells the clock the animations are on screen
+	for (const QString &resource : animated)
+	{
+		const QUrl url(resource);
+		ChatImages::Shared().Seen(url);
+		addResource(QTextDocument::ImageResource,url,ChatImages::Shared().Image(url));
+	}
+}
+
+const std::size_t CHAT_LAYOUTS_LIMIT=128; // comfortably more rows than fit on screen, so scrolling doesn't rebuild the ones still showing
+
+ChatLog::ChatLog(QObject *parent) : QAbstractListModel(parent), first(0), uses(0), scrollback(0) { }
+
+int ChatLog::rowCount(const QModelIndex &parent) const
+{
+	if (parent.isValid()) return 0;
+	return static_cast<int>(rows.size());
+}
+
+QVariant ChatLog::data(const QModelIndex &index,int role) const
+{
+	if (!index.isValid() || index.row() >= rowCount() || role != Qt::DisplayRole) return {};
+	return rows[index.row()].markup;
+}
+
+ChatLog::Row& ChatLog::At(int row)
+{
+	return rows.at(row);
+}
+
+ChatDocument* ChatLog::Document(int row)
+{
+	auto layout=layouts.find(first+row);
+	if (layout == layouts.end()) return nullptr;
+	layout->second.used=++uses;
+	return layout->second.document.get();
+}
+
+ChatDocument* ChatLog::Keep(int row,std::unique_ptr<ChatDocument> document)
+{
+	if (layouts.size() >= CHAT_LAYOUTS_LIMIT)
+	{
+		auto oldest=std::min_element(layouts.begin(),layouts.end(),[](const auto &left,const auto &right) { return left.second.used < right.second.used; });
+		layouts.erase(oldest);
+	}
+	return layouts.insert_or_assign(first+row,Layout{.document=std::move(document),.used=++uses}).first->second.document.get();
+}
+
+void ChatLog::Append(const ChatLines &lines)
+{
+	if (lines.empty()) return;
+	const int row=rowCount();
+	beginInsertRows({},row,row+static_cast<int>(lines.size())-1);
+	for (const ChatLine &line : lines)
+	{
+		Row &entry=rows.emplace_back();
+		entry.id=line.id;
+		entry.markup=line.markup;
+		if (!line.id.isEmpty()) serials.insert_or_assign(line.id,first+rows.size()-1);
+		for (const QString &resource : line.resources) waiting[resource].push_back(first+rows.size()-1);
+	}
+	endInsertRows();
+	Trim();
+}
+
+void ChatLog::Remove(const QString &id)
+{
+	auto serial=serials.find(id);
+	if (serial == serials.end()) return;
+	const int row=static_cast<int>(serial->second-first);
+
+	// the row stays until it scrolls out of the scrollback, so no other row's position changes
+	Row &entry=rows.at(row);
+	entry.markup.clear();
+	entry.width=-1;
+	layouts.erase(serial->second);
+	serials.erase(serial);
+	emit dataChanged(index(row),index(row));
+}
+
+void ChatLog::SetScrollback(qsizetype limit)
+{
+	scrollback=limit;
+	Trim();
+}
+
+void ChatLog::Trim()
+{
+	if (scrollback < 1 || static_cast<qsizetype>(rows.size()) <= scrollback) return;
+
+	const int count=static_cast<int>(static_cast<qsizetype>(rows.size())-scrollback);
+	beginRemoveRows({},0,count-1);
+	for (int index=0; index < count; index++)
+	{
+		if (auto serial=serials.find(rows.front().id); serial != serials.end() && serial->second == first) serials.erase(serial);
+		layouts.erase(first);
+		rows.pop_front();
+		first++;
+	}
+	endRemoveRows();
+}
+
+void ChatLog::Reload(const QString &resource,const QImage &image)
+{
+	auto candidate=waiting.find(resource);
+	if (candidate == waiting.end()) return;
+	std::vector<quint64> targets=std::move(candidate->second);
+	waiting.erase(candidate);
+
+	const QUrl url(resource);
+	for (quint64 serial : targets)
+	{
+		if (serial < first || serial-first >= rows.size()) continue; // already scrolled out of the scrollback
+		const int row=static_cast<int>(serial-first);
+		Row &entry=rows[row];
+		if (entry.width < 0) continue; // never measured, so it will pick the image up on its own
+		if (auto layout=layouts.find(serial); layout != layouts.end())
+		{
+			layout->second.document->addResource(QTextDocument::ImageResource,url,image);
+			layout->second.document->markContentsDirty(0,layout->second.document->characterCount());
+		}
+		entry.width=-1; // the image may have changed its height
+		emit dataChanged(index(row),index(row));
+	}
+}
+
+void ChatLog::Abandon(const QString &resource)
+{
+	waiting.erase(resource);
+}
+
+bool ChatLog::Waiting(const QString &resource) const
+{
+	auto candidate=waiting.find(resource);
+	if (candidate == waiting.end()) return false;
+
+	// rows that were never measured pick the image up on their own when they are
+	return std::any_of(candidate->second.begin(),candidate->second.end(),[this](quint64 serial) {
+		return serial >= first && serial-first < rows.size() && rows[serial-first].width >= 0;
+	});
+}
+
+void ChatLog::Invalidate()
+{
+	for (Row &row : rows) row.width=-1;
+	layouts.clear();
+}
+
+ChatDelegate::ChatDelegate(ChatLog &log,QObject *parent) : QStyledItemDelegate(parent), log(log), margin(0) { }
+
+std::unique_ptr<ChatDocument> ChatDelegate::Build(const QString &markup,int width) const
+{
+	std::unique_ptr<ChatDocument> document=std::make_unique<ChatDocument>();
+	document->setUndoRedoEnabled(false);
+	document->setDefaultFont(font);
+	document->setDefaultStyleSheet(styleSheet);
+	document->setDocumentMargin(margin/2);
+	document->setHtml(markup);
+	document->setTextWidth(width);
+	return document;
+}
+
+ChatDocument* ChatDelegate::Layout(int row,int width) const
+{
+	ChatDocument *document=log.Document(row);
+	if (!document) return log.Keep(row,Build(log.At(row).markup,width));
+	if (document->textWidth() != width) document->setTextWidth(width);
+	return document;
+}
+
+QSize ChatDelegate::sizeHint(const QStyleOptionViewItem &option,const QModelIndex &index) const
+{
+	// the view asks this of every row, so it only keeps the height and doesn't hold on to the layout it measured with
+	ChatLog::Row &entry=log.At(index.row());
+	if (entry.markup.isEmpty()) return {0,0};
+	const QAbstractItemView *view=qobject_cast<const QAbstractItemView*>(option.widget);
+	const int width=view ? view->viewport()->width() : option.rect.width();
+	if (entry.width != width)
+	{
+		qreal height=0;
+		if (ChatDocument *document=log.Document(index.row()); document)
+		{
+			document->setTextWidth(width);
+			height=document->size().height();
+		}
+		else
+		{
+			height=Build(entry.markup,width)->size().height();
+		}
+		entry.height=static_cast<int>(std::ceil(height));
+		entry.width=width;
+	}
+	return {width,entry.height};
+}
+
+void ChatDelegate::paint(QPainter *painter,const QStyleOptionViewItem &option,const QModelIndex &index) const
+{
+	if (log.At(index.row()).markup.isEmpty()) return;
+	const QAbstractItemView *view=qobject_cast<const QAbstractItemView*>(option.widget);
+	ChatDocument *document=Layout(index.row(),view ? view->viewport()->width() : option.rect.width());
+
+	QAbstractTextDocumentLayout::PaintContext context;
+	context.palette=option.palette;
+	context.palette.setColor(QPalette::Text,foreground);
+	context.clip=QRectF(0,0,option.rect.width(),option.rect.height());
+	document->Advance();
+	painter->save();
+	painter->translate(option.rect.topLeft());
+	painter->setClipRect(context.clip);
+	document->documentLayout()->draw(painter,context);
+	painter->restore();
+}
+
+void ChatDelegate::Format(const QFont &font,const QColor &foreground,const QString &styleSheet,qreal margin)
+{
+	this->font=font;
+	this->foreground=foreground;
+	this->styleSheet=styleSheet;
+	this->margin=margin;
+}
+
+ChatView::ChatView(QWidget *parent) : QListView(parent), delegate(log), scrollTransition(QPropertyAnimation(verticalScrollBar(),"sliderPosition"))
+{
+	setModel(&log);
+	setItemDelegate(&delegate);
+	setVerticalScrollMode(QAbstractItemView::ScrollPerPixel);
+	setResizeMode(QListView::Adjust);
+	setLayoutMode(QListView::Batched);
+	setSelectionMode(QAbstractItemView::NoSelection);
+	setFocusPolicy(Qt::NoFocus);
+	connect(&scrollTransition,&QPropertyAnimation::finished,this,&ChatView::Tail);
+	connect(verticalScrollBar(),&QScrollBar::rangeChanged,this,&ChatView::Scroll);
+	connect(&ChatImages::Shared(),&ChatImages::Advanced,this,&ChatView::Animate);
+}
+
+void ChatView::Animate(const QStringList &resources)
+{
+	// only the rows on screen are painted, so they're the only ones that need to know about a new frame
+	for (QModelIndex index=indexAt(QPoint(0,0)); index.isValid() && visualRect(index).top() < viewport()->height(); index=index.siblingAtRow(index.row()+1))
+	{
+		const ChatDocument *document=log.Document(index.row());
+		if (document && document->Animated(resources)) viewport()->update(visualRect(index));
+	}
+}
+
+void ChatView::Append(const ChatLines &lines)
+{
+	Tail();
+	log.Append(lines);
+}
+
+void ChatView::Remove(const QString &id)
+{
+	log.Remove(id);
+	scheduleDelayedItemsLayout();
+}
+
+void ChatView::SetScrollback(qsizetype limit)
+{
+	log.SetScrollback(limit);
+}
+
+void ChatView::Format(const QFont &font,const QColor &foreground,const QString &styleSheet,qreal margin)
+{
+	delegate.Format(font,foreground,styleSheet,margin);
+	Refresh();
+}
+
+void ChatView::Refresh()
+{
+	// layouts are rebuilt lazily the next time each row is measured or painted
+	log.Invalidate();
+	scheduleDelayedItemsLayout();
+	viewport()->update();
+}
+
+void ChatView::Reload(const QString &resource)
+{
+	QImage image=ChatImages::Shared().Image(QUrl(resource));
+	if (image.isNull()) return;
+	log.Reload(resource,image);
+	scheduleDelayedItemsLayout(); // the image may have changed the height of the rows that show it
+}
+
+void ChatView::Abandon(const QString &resource)
+{
+	log.Abandon(resource);
+}
+
+bool ChatView::Waiting(const QString &resource) const
+{
+	return log.Waiting(resource);
+}
+
+void ChatView::resizeEvent(QResizeEvent *event)
+{
+	Tail();
+	QListView::resizeEvent(event);
+}
+
+void ChatView::contextMenuEvent(QContextMenuEvent *event)
+{
+	emit ContextMenu(event);
+}
+
+void ChatView::Scroll(int minimum,int maximum)
+{
+	Q_UNUSED(minimum)
+	scrollTransition.setDuration((maximum-verticalScrollBar()->value())*10); // distance remaining * ms/step (10ms/1step)
+	scrollTransition.setStartValue(verticalScrollBar()->value());
+	scrollTransition.setEndValue(maximum);
+	scrollTransition.start();
+}
+
+void ChatView::Tail()
+{
+	if (scrollTransition.endValue() != verticalScrollBar()->maximum()) Scroll(scrollTransition.startValue().toInt(),verticalScrollBar()->maximum());
+}
+
 const int ScrollingTextEdit::PAUSE=5000;
 
 ScrollingTextEdit::ScrollingTextEdit(QWidget *parent) : QTextEdit(parent), scrollTransition(QPropertyAnimation(verticalScrollBar(),"sliderPosition"))
@@ -1404,6 +2104,7 @@ namespace UI
 				previewBackgroundColor(this,settings.backgroundColor),
 				selectBackgroundColor(Text::CHOOSE,this),
 				statusInterval(this),
+				scrollback(this),
 				settings(settings),
 				errorReport(errorReport)
 			{
@@ -1419,12 +2120,15 @@ namespace UI
 				foregroundColor.setText(settings.foregroundColor);
 				backgroundColor.setText(settings.backgroundColor);
 				statusInterval.setRange(TimeConvert::Milliseconds(TimeConvert::OneSecond()).count(),std::numeric_limits<int>::max());
+				scrollback.setRange(0,std::numeric_limits<int>::max());
+				scrollback.setValue(settings.scrollback);
 
 				Rows({
 					{Label(QStringLiteral("Font")),&font,Label(QStringLiteral("Size")),&fontSize,&selectFont},
 					{Label(QStringLiteral("Text Color")),&foregroundColor,&previewForegroundColor,&selectForegroundColor},
 					{Label(QStringLiteral("Background Color")),&backgroundColor,&previewBackgroundColor,&selectBackgroundColor},
-					{Label(QStringLiteral("Status Duration")),&statusInterval}
+					{Label(QStringLiteral("Status Duration")),&statusInterval},
+					{Label(QStringLiteral("Scrollback")),&scrollback}
 				});
 			}
 
@@ -1477,6 +2181,7 @@ namespace UI
 					if (object == &foregroundColor || object == &selectForegroundColor) emit Help(QStringLiteral("The color of chat message text"));
 					if (object == &backgroundColor || object == &selectBackgroundColor) emit Help(QStringLiteral("The color of the background behind chat messages"));
 					if (object == &statusInterval) emit Help(QStringLiteral("How long (in milliseconds) updates and error messages should display at the bottom of the chat pane"));
+					if (object == &scrollback) emit Help(QStringLiteral("How many chat messages to keep before the oldest are removed (0 keeps all of them)"));
 				}
 
 				if (event->type() == QEvent::HoverLeave) emit Help("");
@@ -1490,6 +2195,7 @@ namespace UI
 				settings.foregroundColor.Set(foregroundColor.text());
 				settings.backgroundColor.Set(backgroundColor.text());
 				settings.statusInterval.Set(statusInterval.value());
+				settings.scrollback.Set(scrollback.value());
 			}
 
 			Pane::Pane(Settings settings,std::shared_ptr<Feedback::Error> errorReport,QWidget *parent) : Category(parent,QStringLiteral("Panes")),
@@ -1608,14 +2314,28 @@ namespace UI
 
 			Music::Music(Settings settings,QWidget *parent) : Category(parent,QStringLiteral("Music")),
 				suppressedVolume(this),
+				crossfade(this),
+				normalize(this),
+				loudnessTarget(this),
 				settings(settings)
 			{
 				suppressedVolume.setRange(0,100);
 				suppressedVolume.setSuffix("%");
 				suppressedVolume.setValue(settings.suppressedVolume);
+				crossfade.setRange(0,15000);
+				crossfade.setSingleStep(500);
+				crossfade.setSuffix(" ms");
+				crossfade.setValue(settings.crossfade);
+				normalize.setChecked(settings.normalize);
+				loudnessTarget.setRange(-40,-5);
+				loudnessTarget.setSuffix(" LUFS");
+				loudnessTarget.setValue(settings.loudnessTarget);
 
 				Rows({
-					{Label(QStringLiteral("Suppressed Volume")),&suppressedVolume}
+					{Label(QStringLiteral("Suppressed Volume")),&suppressedVolume},
+					{Label(QStringLiteral("Crossfade")),&crossfade},
+					{Label(QStringLiteral("Normalize Loudness")),&normalize},
+					{Label(QStringLiteral("Loudness Target")),&loudnessTarget}
 				});
 			}
 
@@ -1624,6 +2344,9 @@ namespace UI
 				if (event->type() == QEvent::HoverEnter)
 				{
 					if (object == &suppressedVolume) emit Help(QStringLiteral("The volume the music should duck to when another pane is playing audio."));
+					if (object == &crossfade) emit Help(QStringLiteral("How long (in milliseconds) one song fades into the next. At 0, the next song starts the moment the previous one ends."));
+					if (object == &normalize) emit Help(QStringLiteral("Turn down songs that are louder than the loudness target, once they've been measured in the background. Quieter songs play as they are."));
+					if (object == &loudnessTarget) emit Help(QStringLiteral("How loud (in LUFS) songs should be when loudness is normalized. -18 is the ReplayGain reference level, lower values leave more songs within reach."));
 				}
 
 				if (event->type() == QEvent::HoverLeave) emit Help("");
@@ -1633,6 +2356,9 @@ namespace UI
 			void Music::Save()
 			{
 				settings.suppressedVolume.Set(suppressedVolume.value());
+				settings.crossfade.Set(crossfade.value());
+				settings.normalize.Set(normalize.isChecked());
+				settings.loudnessTarget.Set(loudnessTarget.value());
 			}
 
 			Bot::Bot(Settings settings,std::shared_ptr<Feedback::Error> errorReport,QWidget *parent) : Category(parent,QStringLiteral("Bot Core")),
@@ -2074,9 +2800,21 @@ namespace UI
 	{
 		Dialog::Dialog(QWidget *parent) : QDialog(parent,Qt::Dialog|Qt::CustomizeWindowHint|Qt::WindowTitleHint|Qt::WindowCloseButtonHint),
 			layout(this),
-			users(this)
+			users(this),
+			decoding(this),
+			schedule(this),
+			mixing(this),
+			decodes(0),
+			decodeTime(0),
+			slowestDecode(0),
+			effects(0),
+			effectLatency(0),
+			slowestEffect(0)
 		{
 			layout.addWidget(&users);
+			layout.addWidget(&decoding);
+			layout.addWidget(&schedule);
+			layout.addWidget(&mixing);
 			setModal(false);
 			setSizeGripEnabled(true);
 		}
@@ -2108,6 +2846,28 @@ namespace UI
 		{
 			setWindowTitle(QStringLiteral("Metrics (%1)").arg(StringConvert::Integer(users.count())));
 		}
+
+		void Dialog::Decoded(qint64 microseconds,const QSize &size)
+		{
+			Q_UNUSED(size)
+			decodes++;
+			decodeTime+=microseconds;
+			slowestDecode=std::max(slowestDecode,microseconds);
+			decoding.setText(QStringLiteral("Images decoded: %1 (%2 ms average, %3 ms slowest)").arg(QString::number(decodes),QString::number(decodeTime/decodes/1000.0,'f',1),QString::number(slowestDecode/1000.0,'f',1)));
+		}
+
+		void Dialog::Scheduled(int highPriority,int lowPriority,qint64 averageWait,qint64 longestWait,int dropped)
+		{
+			schedule.setText(QStringLiteral("Alerts waiting: %1 high, %2 low (%3 s average wait, %4 s longest, %5 dropped)").arg(StringConvert::Integer(highPriority),StringConvert::Integer(lowPriority),QString::number(averageWait/1000.0,'f',1),QString::number(longestWait/1000.0,'f',1),StringConvert::Integer(dropped)));
+		}
+
+		void Dialog::Mixed(qint64 microseconds)
+		{
+			effects++;
+			effectLatency+=microseconds;
+			slowestEffect=std::max(slowestEffect,microseconds);
+			mixing.setText(QStringLiteral("Sound effects played: %1 (%2 ms average latency, %3 ms slowest)").arg(QString::number(effects),QString::number(effectLatency/effects/1000.0,'f',1),QString::number(slowestEffect/1000.0,'f',1)));
+		}
 	}
 
 	namespace VibePlaylist
@@ -2115,6 +2875,10 @@ namespace UI
 		Dialog::Dialog(const File::List &files,QWidget *parent) : QDialog(parent),
 			layout(this),
 			list(0,static_cast<int>(Columns::MAX),this),
+			scanControls(this),
+			scanControlsLayout(&scanControls),
+			scanStatus(&scanControls),
+			cancelScan(Text::BUTTON_CANCEL,&scanControls),
 			buttons(this),
 			add(Text::BUTTON_ADD,this),
 			remove(Text::BUTTON_REMOVE,this),
@@ -2125,10 +2889,15 @@ namespace UI
 			volume(Qt::Horizontal,&mediaControls),
 			start("\u23F5",&mediaControls),
 			stop("\u23F9",&mediaControls),
-			files(files)
+			files(files),
+			scanCancelled(std::make_shared<std::atomic<bool>>(false)),
+			scansQueued(0),
+			scansFinished(0),
+			scanFailurePrompt(false)
 		{
 			setLayout(&layout);
 
+			scanControls.hide();
 			list.setHorizontalHeaderLabels({"Artist","Album","Title","Path"});
 			list.setSelectionBehavior(QAbstractItemView::SelectRows);
 			list.setSelectionMode(QAbstractItemView::ExtendedSelection);
@@ -2145,6 +2914,12 @@ namespace UI
 			list.setSortingEnabled(true);
 			layout.addWidget(&list);
 
+			scanControlsLayout.setContentsMargins(0,0,0,0);
+			scanControlsLayout.addWidget(&scanStatus,1);
+			scanControlsLayout.addWidget(&cancelScan,0);
+			layout.addWidget(&scanControls);
+			connect(&cancelScan,&QPushButton::clicked,this,&Dialog::CancelScan);
+
 			mediaControlsLayout.addWidget(&stop,0);
 			mediaControlsLayout.addWidget(&start,0);
 			mediaControlsLayout.addWidget(&volume,1);
@@ -2177,6 +2952,13 @@ namespace UI
 			for (QTableWidgetItem *item : items) list.selectRow(item->row());
 		}
 
+		Dialog::~Dialog()
+		{
+			*scanCancelled=true;
+			scanners.clear();
+			scanners.waitForDone();
+		}
+
 		void Dialog::showEvent(QShowEvent *event)
 		{
 			setMinimumWidth(ScreenWidthThird(this));
@@ -2198,44 +2980,135 @@ namespace UI
 			Add(paths,true);
 		}
 
-		void Dialog::Add(const QString &path)
+		void Dialog::Fill(int row,const Music::Metadata &metadata)
 		{
-			Music::ID3::Tag tag=Music::ID3::Tag{path};
-			auto artist=tag.Artist();
-			auto title=tag.Title();
-			if (!title || !artist) return;
-			auto album=tag.AlbumTitle();
-			list.insertRow(list.rowCount());
-			int row=list.rowCount()-1;
-			list.setItem(row,0,ReadOnlyItem(*artist));
-			list.setItem(row,1,ReadOnlyItem(album ? *album : QString{}));
-			list.setItem(row,2,ReadOnlyItem(*title));
-			list.setItem(row,static_cast<int>(Columns::PATH),ReadOnlyItem(path));
+			list.setItem(row,static_cast<int>(Columns::ARTIST),ReadOnlyItem(metadata.artist));
+			list.setItem(row,static_cast<int>(Columns::ALBUM),ReadOnlyItem(metadata.album));
+			list.setItem(row,static_cast<int>(Columns::TITLE),ReadOnlyItem(metadata.title));
 		}
 
 		void Dialog::Add(const QStringList &paths,bool failurePrompt)
 		{
+			// rows go in straight away with the file name standing in for the title, tags are read on the worker pool and filled in as they arrive
 			list.setSortingEnabled(false);
-			QStringList failed;
-			for (const QString &file : paths)
+			if (scansFinished == scansQueued)
 			{
-				try
+				scansQueued=0;
+				scansFinished=0;
+				scanFailures.clear();
+				scanFailurePrompt=false;
+				scanClock.start();
+			}
+			scanFailurePrompt|=failurePrompt;
+
+			for (const QString &path : paths)
+			{
+				const int row=list.rowCount();
+				list.insertRow(row);
+				list.setItem(row,static_cast<int>(Columns::PATH),ReadOnlyItem(path));
+				if (std::optional<Music::Metadata> metadata=Music::MetadataCache::Shared().Cached(path); metadata)
 				{
-					Add(file);
+					if (metadata->title.isEmpty() || metadata->artist.isEmpty())
+						list.removeRow(row);
+					else
+						Fill(row,*metadata);
+					continue;
 				}
-				catch (const std::runtime_error &exception)
+
+				QTableWidgetItem *placeholder=ReadOnlyItem(QFileInfo(path).completeBaseName());
+				placeholder->setForeground(palette().mid());
+				list.setItem(row,static_cast<int>(Columns::TITLE),placeholder);
+
+				const QPersistentModelIndex index=list.model()->index(row,static_cast<int>(Columns::PATH));
+				scansQueued++;
+				scanners.start([this,cancelled=scanCancelled,index,path]() {
+					if (*cancelled) return;
+					Music::Metadata metadata;
+					QString error;
+					try
+					{
+						metadata=Music::MetadataCache::Parse(path);
+					}
+
+					catch (const std::exception &exception)
+					{
+						error=exception.what();
+					}
+
+					QMetaObject::invokeMethod(this,[this,cancelled,index,path,metadata,error]() {
+						if (!*cancelled) Scanned(index,path,metadata,error);
+					},Qt::QueuedConnection);
+				});
+			}
+
+			if (scansFinished == scansQueued)
+			{
+				FinishScan();
+			}
+			else
+			{
+				save.setEnabled(false); // rows still waiting on their tags may yet turn out to be unplayable
+				cancelScan.show();
+				scanControls.show();
+			}
+		}
+
+		void Dialog::Scanned(const QPersistentModelIndex &row,const QString &path,const Music::Metadata &metadata,const QString &error)
+		{
+			scansFinished++;
+			if (error.isEmpty()) Music::MetadataCache::Shared().Store(path,metadata);
+			if (row.isValid()) // the row may have been removed while its file was being read
+			{
+				if (!error.isEmpty())
+				{
+					scanFailures.append(QString{"%1: %2"}.arg(path,error));
+					list.removeRow(row.row());
+				}
+				else if (metadata.title.isEmpty() || metadata.artist.isEmpty())
+				{
+					list.removeRow(row.row());
+				}
+				else
 				{
-					failed.append(QString{"%1: %2"}.arg(file,exception.what()));
+					Fill(row.row(),metadata);
 				}
 			}
-			if (failurePrompt && !failed.isEmpty())
+
+			const qint64 elapsed=std::max<qint64>(scanClock.elapsed(),1);
+			scanStatus.setText(QStringLiteral("Reading tags: %1 of %2 (%3 files/s)").arg(StringConvert::Integer(scansFinished),StringConvert::Integer(scansQueued),QString::number(scansFinished*1000.0/elapsed,'f',1)));
+			if (scansFinished == scansQueued) FinishScan();
+		}
+
+		void Dialog::FinishScan()
+		{
+			save.setEnabled(true);
+			cancelScan.hide();
+			scanControls.setVisible(scansQueued > 0);
+			if (scansQueued > 0) scanStatus.setText(QStringLiteral("Read tags from %1 files in %2 s (%3 files/s)").arg(StringConvert::Integer(scansFinished),QString::number(scanClock.elapsed()/1000.0,'f',1),QString::number(scansFinished*1000.0/std::max<qint64>(scanClock.elapsed(),1),'f',1)));
+			if (scanFailurePrompt && !scanFailures.isEmpty())
 			{
-				QMessageBox{QMessageBox::Warning,"Failed to add files",failed.join('\n'),QMessageBox::Ok}.exec();
+				QMessageBox{QMessageBox::Warning,"Failed to add files",scanFailures.join('\n'),QMessageBox::Ok}.exec();
 			}
+			scanFailures.clear();
 			list.setSortingEnabled(true);
 			list.resizeColumnsToContents();
 		}
 
+		void Dialog::CancelScan()
+		{
+			// results already on their way are ignored, anything not started yet never will be
+			*scanCancelled=true;
+			scanCancelled=std::make_shared<std::atomic<bool>>(false);
+			scanners.clear();
+			for (int row=list.rowCount()-1; row >= 0; row--)
+			{
+				if (!list.item(row,static_cast<int>(Columns::ARTIST))) list.removeRow(row);
+			}
+			scansFinished=scansQueued;
+			scanFailurePrompt=false;
+			FinishScan();
+		}
+
 		void Dialog::Remove()
 		{
 			QList<QTableWidgetItem*> items=list.selectedItems();
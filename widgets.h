@@ -1,6 +1,10 @@
 #pragma once
 
 #include <QTextEdit>
+#include <QTextDocument>
+#include <QListView>
+#include <QAbstractListModel>
+#include <QStyledItemDelegate>
 #include <QTextBlockUserData>
 #include <QTimer>
 #include <QPropertyAnimation>
@@ -24,8 +28,15 @@
 #include <QSizeGrip>
 #include <QDialog>
 #include <QDir>
+#include <QPointer>
+#include <QCache>
+#include <QElapsedTimer>
+#include <QImageReader>
+#include <QThreadPool>
 #include <unordered_set>
+#include <deque>
 #include <concepts>
+#include <atomic>
 #include "entities.h"
 
 namespace StyleSheet
@@ -57,18 +68,97 @@ signals:
 	void ContextMenu(QContextMenuEvent *event);
 };
 
+struct ChatLine
+{
+	QString markup;
+	QString id;
+	QStringList resources; // images the line shows that haven't been downloaded yet
+};
+using ChatLines=std::vector<ChatLine>;
+
+/*!
+ * \brief Decoded badge and emote images shared by every chat document
+ *
+ * Each image is read from the asset cache and decoded once, optionally
+ * scaled down to the height of a line of chat, and then handed to any
+ * document that asks for the same URL. The least recently used images are
+ * dropped once the decoded size passes the limit.
+ *
+ * Animated images are decoded into a single atlas with every frame stacked
+ * on top of each other, and the frames handed out are views into it. One
+ * clock, running at the display's refresh rate, picks the current frame of
+ * every animation from the time elapsed since it started, so all copies of
+ * an emote stay in step and frames are simply skipped when a tick is late.
+ * Documents report the animations they paint, and one that hasn't been
+ * painted through a whole frame is off screen and stops advancing until it
+ * is again. When the frames pass their limit, the animations that were
+ * painted longest ago are dropped first.
+ */
+class ChatImages : public QObject
+{
+	Q_OBJECT
+public:
+	ChatImages(QObject *parent=nullptr);
+	QImage Image(const QUrl &url);
+	Async::Task<void> Preload(QUrl url);
+	bool Animated(const QUrl &url) const;
+	void Seen(const QUrl &url);
+	bool Scale(int height,qreal ratio);
+	static ChatImages& Shared();
+protected:
+	struct Animation
+	{
+		QImage atlas;
+		std::vector<QImage> frames;
+		std::vector<int> ends; // when each frame stops showing, in milliseconds from the start of the loop
+		std::size_t current;
+		int longest; // longest any one frame shows, in milliseconds
+		qint64 seen; // when it was last painted, on the animation clock
+	};
+	QCache<QString,QImage> images; // cost is in kilobytes
+	std::unordered_map<QString,Animation> animations;
+	qsizetype animationSize;
+	QTimer animationClock;
+	QElapsedTimer animationTime;
+	int height; // in device independent pixels, 0 leaves images at their natural size
+	qreal ratio;
+	QImage Scaled(const QImage &image) const;
+	bool Animate(const QString &key,const QImage &first,QImageReader &reader);
+	void Evict(qsizetype needed);
+signals:
+	void Advanced(const QStringList &resources);
+protected slots:
+	void Advance();
+};
+
 class PinnedTextEdit : public QTextEdit
 {
 	Q_OBJECT
 public:
 	PinnedTextEdit(QWidget *parent);
-	void Append(const QString &text,const QString &id);
+	void Append(const ChatLines &lines);
 	void Remove(const QString &id);
+	void SetScrollback(qsizetype limit);
+	void Reload(const QString &resource);
+	void Abandon(const QString &resource);
+	bool Waiting(const QString &resource) const;
+	void Rescale();
+protected slots:
+	void Animate(const QStringList &resources);
 protected:
 	std::unordered_map<QString,QTextFrame*> frames;
+	std::unordered_set<QString> resources;
+	std::deque<std::pair<QString,QPointer<QTextFrame>>> history;
+	std::unordered_map<QString,std::vector<QPointer<QTextFrame>>> waiting;
+	qsizetype scrollback;
 	QPropertyAnimation scrollTransition;
+	qreal Trim(QTextCursor &cursor);
+	void Shift(qreal height);
+	std::vector<std::pair<QString,QRect>> Animations() const;
 	void resizeEvent(QResizeEvent *event) override;
+	void paintEvent(QPaintEvent *event) override;
 	void contextMenuEvent(QContextMenuEvent *event) override;
+	QVariant loadResource(int type,const QUrl &name) override;
 signals:
 	void ContextMenu(QContextMenuEvent *event);
 protected slots:
@@ -76,6 +166,113 @@ protected slots:
 	void Scroll(int minimum,int maximum);
 };
 
+//! Text document that can resolve images held in the asset cache
+class ChatDocument : public QTextDocument
+{
+	Q_OBJECT
+public:
+	ChatDocument(QObject *parent=nullptr) : QTextDocument(parent) { }
+	bool Animated(const QStringList &resources) const;
+	void Advance();
+protected:
+	std::unordered_set<QString> animated;
+	QVariant loadResource(int type,const QUrl &name) override;
+};
+
+class ChatLog : public QAbstractListModel
+{
+	Q_OBJECT
+public:
+	struct Row
+	{
+		QString id;
+		QString markup; // empty once the message has been deleted
+		int width=-1; // what the height was measured at, -1 until it's been measured
+		int height=0;
+	};
+	ChatLog(QObject *parent=nullptr);
+	int rowCount(const QModelIndex &parent=QModelIndex()) const override;
+	QVariant data(const QModelIndex &index,int role=Qt::DisplayRole) const override;
+	Row& At(int row);
+	ChatDocument* Document(int row);
+	ChatDocument* Keep(int row,std::unique_ptr<ChatDocument> document);
+	void Append(const ChatLines &lines);
+	void Remove(const QString &id);
+	void SetScrollback(qsizetype limit);
+	void Invalidate();
+	void Reload(const QString &resource,const QImage &image);
+	void Abandon(const QString &resource);
+	bool Waiting(const QString &resource) const;
+protected:
+	struct Layout
+	{
+		std::unique_ptr<ChatDocument> document;
+		quint64 used;
+	};
+	std::deque<Row> rows;
+	std::unordered_map<QString,quint64> serials;
+	std::unordered_map<QString,std::vector<quint64>> waiting;
+	std::unordered_map<quint64,Layout> layouts; // only for the rows painted most recently, keyed by serial
+	quint64 first; // serial of the row at the top
+	quint64 uses;
+	qsizetype scrollback;
+	void Trim();
+};
+
+/*!
+ * \brief Measures and paints chat rows
+ *
+ * Every row is measured once per width and only its height is kept, so
+ * scrolling and new messages never touch the rows that are already there.
+ * A full text layout is built only for a row that's being painted, and only
+ * the most recently painted ones are kept around.
+ */
+class ChatDelegate : public QStyledItemDelegate
+{
+	Q_OBJECT
+public:
+	ChatDelegate(ChatLog &log,QObject *parent=nullptr);
+	void paint(QPainter *painter,const QStyleOptionViewItem &option,const QModelIndex &index) const override;
+	QSize sizeHint(const QStyleOptionViewItem &option,const QModelIndex &index) const override;
+	void Format(const QFont &font,const QColor &foreground,const QString &styleSheet,qreal margin);
+protected:
+	ChatLog &log;
+	QFont font;
+	QColor foreground;
+	QString styleSheet;
+	qreal margin;
+	std::unique_ptr<ChatDocument> Build(const QString &markup,int width) const;
+	ChatDocument* Layout(int row,int width) const;
+};
+
+//! Alternative to PinnedTextEdit that keeps a height for every row and a text layout only for the rows on screen
+class ChatView : public QListView
+{
+	Q_OBJECT
+public:
+	ChatView(QWidget *parent);
+	void Append(const ChatLines &lines);
+	void Remove(const QString &id);
+	void SetScrollback(qsizetype limit);
+	void Format(const QFont &font,const QColor &foreground,const QString &styleSheet,qreal margin);
+	void Refresh();
+	void Reload(const QString &resource);
+	void Abandon(const QString &resource);
+	bool Waiting(const QString &resource) const;
+protected:
+	ChatLog log;
+	ChatDelegate delegate;
+	QPropertyAnimation scrollTransition;
+	void resizeEvent(QResizeEvent *event) override;
+	void contextMenuEvent(QContextMenuEvent *event) override;
+signals:
+	void ContextMenu(QContextMenuEvent *event);
+protected slots:
+	void Tail();
+	void Scroll(int minimum,int maximum);
+	void Animate(const QStringList &resources);
+};
+
 class ScrollingTextEdit : public QTextEdit
 {
 	Q_OBJECT
@@ -271,6 +468,7 @@ namespace UI
 		inline const char *BUTTON_ADD="&Add";
 		inline const char *BUTTON_REMOVE="&Remove";
 		inline const char *BUTTON_CLOSE="&Close";
+		inline const char *BUTTON_CANCEL="&Cancel";
 	}
 
 	namespace Security
@@ -544,6 +742,7 @@ namespace UI
 					ApplicationSetting foregroundColor;
 					ApplicationSetting backgroundColor;
 					ApplicationSetting statusInterval;
+					ApplicationSetting scrollback;
 				};
 				Chat(Settings settings,std::shared_ptr<Feedback::Error> errorReport,QWidget *parent);
 				void Save() override;
@@ -558,6 +757,7 @@ namespace UI
 				Color previewBackgroundColor;
 				QPushButton selectBackgroundColor;
 				QSpinBox statusInterval;
+				QSpinBox scrollback;
 				Settings settings;
 				std::shared_ptr<Feedback::Error> errorReport;
 				bool eventFilter(QObject *object,QEvent *event) override;
@@ -619,11 +819,17 @@ namespace UI
 				struct Settings
 				{
 					ApplicationSetting &suppressedVolume;
+					ApplicationSetting &crossfade;
+					ApplicationSetting &normalize;
+					ApplicationSetting &loudnessTarget;
 				};
 				Music(Settings settings,QWidget *parent);
 				void Save() override;
 			protected:
 				QSpinBox suppressedVolume;
+				QSpinBox crossfade;
+				QCheckBox normalize;
+				QSpinBox loudnessTarget;
 				Settings settings;
 				bool eventFilter(QObject *object,QEvent *event) override;
 			};
@@ -774,14 +980,26 @@ namespace UI
 		public:
 			Dialog(QWidget *parent);
 		protected:
-			QHBoxLayout layout;
+			QVBoxLayout layout;
 			QListWidget users;
+			QLabel decoding;
+			QLabel schedule;
+			QLabel mixing;
+			qint64 decodes;
+			qint64 decodeTime;
+			qint64 slowestDecode;
+			qint64 effects;
+			qint64 effectLatency;
+			qint64 slowestEffect;
 			static const QString TITLE;
 			void UpdateTitle();
 		public slots:
 			void Joined(const QString &user);
 			void Acknowledged(const QString &name);
 			void Parted(const QString &user);
+			void Decoded(qint64 microseconds,const QSize &size);
+			void Scheduled(int highPriority,int lowPriority,qint64 averageWait,qint64 longestWait,int dropped);
+			void Mixed(qint64 microseconds);
 		};
 	}
 
@@ -802,9 +1020,14 @@ namespace UI
 		public:
 			Dialog(const File::List &files,QWidget *parent);
 			Dialog(const File::List &files,const QString currentlyPlayingFile,QWidget *parent);
+			~Dialog();
 		protected:
 			QVBoxLayout layout;
 			QTableWidget list;
+			QFrame scanControls;
+			QHBoxLayout scanControlsLayout;
+			QLabel scanStatus;
+			QPushButton cancelScan;
 			QDialogButtonBox buttons;
 			QPushButton add;
 			QPushButton remove;
@@ -817,9 +1040,18 @@ namespace UI
 			QPushButton stop;
 			const File::List &files;
 			QDir initialAddFilesPath;
+			QThreadPool scanners;
+			std::shared_ptr<std::atomic<bool>> scanCancelled;
+			QElapsedTimer scanClock;
+			int scansQueued;
+			int scansFinished;
+			QStringList scanFailures;
+			bool scanFailurePrompt;
 			void Save();
-			void Add(const QString &path);
+			void Fill(int row,const Music::Metadata &metadata);
 			void Add(const QStringList &paths,bool failurePrompt);
+			void Scanned(const QPersistentModelIndex &row,const QString &path,const Music::Metadata &metadata,const QString &error);
+			void FinishScan();
 			void showEvent(QShowEvent *event) override;
 			static const int COLUMN_COUNT;
 		signals:
@@ -831,6 +1063,7 @@ namespace UI
 			void Add();
 			void Remove();
 			void Play(QTableWidgetItem *item);
+			void CancelScan();
 		};
 	}
 
@@ -13,7 +13,9 @@
 #include <QJsonObject>
 #include <chrono>
 #include <stdexcept>
+#include <algorithm>
 #include "window.h"
+#include "media.h"
 
 const char *SETTINGS_CATEGORY_WINDOW="Window";
 
@@ -23,8 +25,18 @@ using PrintUI=QOverload<const QString&>;
 Window::Window() : QMainWindow(nullptr),
 	background(new QWidget(this)),
 	livePersistentPane(nullptr),
+	highPriorityEphemeralPane(nullptr),
+	lowPriorityEphemeralPane(nullptr),
+	musicSuppressed(false),
+	ephemeralPaneWaits(0),
+	ephemeralPaneWaitTime(0),
+	longestEphemeralPaneWait(0),
+	droppedEphemeralPanes(0),
 	settingWindowSize(SETTINGS_CATEGORY_WINDOW,"Size",ScreenThird()),
 	settingBackgroundColor(SETTINGS_CATEGORY_WINDOW,"BackgroundColor","#ff000000"),
+	settingHighPriorityExpiry(SETTINGS_CATEGORY_WINDOW,"HighPriorityExpiry",0), // in seconds, 0 never drops them
+	settingLowPriorityExpiry(SETTINGS_CATEGORY_WINDOW,"LowPriorityExpiry",60),
+	settingAggregationWindow(SETTINGS_CATEGORY_WINDOW,"AggregationWindow",15), // in seconds, how long after the first of a burst that more of the same get folded into it
 	configureOptions("Options",this),
 	configureCommands("Commands",this),
 	configureEventSubscriptions("Event Subscriptions",this),
@@ -32,6 +44,7 @@ Window::Window() : QMainWindow(nullptr),
 	vibePlaylist("Vibe Playlist",this),
 	status("Status",this)
 {
+	schedulerClock.start();
 	setAttribute(Qt::WA_TranslucentBackground,true);
 	setFixedSize(settingWindowSize);
 
@@ -75,134 +88,158 @@ void Window::SwapPersistentPane(PersistentPane *pane)
 
 void Window::AnnounceArrival(const QString &name,std::shared_ptr<QImage> profileImage,const QString &audioPath)
 {
-	try
-	{
-		MultimediaAnnouncePane *pane=new MultimediaAnnouncePane({
-			{"Please welcome",1},
-			{name,1.5},
-			{"to the chat",1}
-		},*profileImage,audioPath,this);
-		connect(pane,&MultimediaAnnouncePane::Print,this,PrintLog::of(&Window::Print));
-		StageEphemeralPane(pane);
-	}
-
-	catch (const std::runtime_error &exception)
-	{
-		emit Print(exception.what(),"announce arrival");
-	}
+	StageEphemeralPane({
+		.build=[this,name,profileImage,audioPath]() -> EphemeralPane* {
+			MultimediaAnnouncePane *pane=new MultimediaAnnouncePane({
+				{"Please welcome",1},
+				{name,1.5},
+				{"to the chat",1}
+			},*profileImage,audioPath,this);
+			connect(pane,&MultimediaAnnouncePane::Print,this,PrintLog::of(&Window::Print));
+			return pane;
+		},
+		.operation="announce arrival",
+		.media=audioPath
+	});
 }
 
 void Window::AnnounceRedemption(const QString &name,const QString& rewardTitle,const QString& message)
 {
-	AnnouncePane *pane=new AnnouncePane({
-		{name,1.5},
-		{"has redeemed",1},
-		{rewardTitle,1.5},
-		{message,1}
-	},this);
-	connect(pane,&AnnouncePane::Print,this,PrintLog::of(&Window::Print));
-	pane->LowerPriority();
-	StageEphemeralPane(pane);
+	StageEphemeralPane({
+		.build=[this,name,rewardTitle,message]() -> EphemeralPane* {
+			AnnouncePane *pane=new AnnouncePane({
+				{name,1.5},
+				{"has redeemed",1},
+				{rewardTitle,1.5},
+				{message,1}
+			},this);
+			connect(pane,&AnnouncePane::Print,this,PrintLog::of(&Window::Print));
+			return pane;
+		},
+		.operation="announce redemption",
+		.highPriority=false
+	});
 }
 
 void Window::AnnounceSubscription(const QString &name,const QString &audioPath)
 {
-	try
-	{
-		AudioAnnouncePane *pane=new AudioAnnouncePane({
-			{name,1.5},
-			{"has subscribed!",1}
-		},audioPath,this);
+	StageAggregatedPane(u"subscription"_s,name,1,[](const AggregatedPane &aggregate) -> Lines {
+		if (aggregate.names.size() < 2) return {{aggregate.names.value(0),1.5},{"has subscribed!",1}};
+		QString names=aggregate.names.first(std::min(static_cast<int>(aggregate.names.size()),3)).join(", ");
+		if (aggregate.names.size() > 3) names.append(u" and %1 more"_s.arg(StringConvert::Integer(static_cast<int>(aggregate.names.size())-3)));
+		return {{names,1.5},{"have subscribed!",1}};
+	},[this,audioPath](const Lines &lines) -> AnnouncePane* {
+		AudioAnnouncePane *pane=new AudioAnnouncePane(lines,audioPath,this);
 		connect(pane,&AudioAnnouncePane::Print,this,PrintLog::of(&Window::Print));
-		StageEphemeralPane(pane);
-	}
-
-	catch (const std::runtime_error &exception)
-	{
-		emit Print(exception.what(),"announce subscription");
-	}
+		return pane;
+	},{
+		.operation="announce subscription",
+		.media=audioPath
+	});
 }
 
-void Window::AnnounceRaid(const QString &name,const unsigned int viewers,const QString &audioPath)
+void Window::AnnounceGiftSubscription(const QString &gifter,const unsigned int count,const QString &audioPath)
 {
-	try
-	{
-		AudioAnnouncePane *pane=new AudioAnnouncePane({
-			{name,1.5},
-			{"is raiding with",1},
-			{StringConvert::PositiveInteger(viewers),1.5},
-			{"viewers",1}
-		},audioPath,this);
+	StageAggregatedPane(u"gift subscription/"_s+gifter,gifter,static_cast<int>(count),[gifter](const AggregatedPane &aggregate) -> Lines {
+		return {
+			{gifter,1.5},
+			{"has gifted",1},
+			{StringConvert::Integer(aggregate.count),1.5},
+			{aggregate.count == 1 ? "subscription!" : "subscriptions!",1}
+		};
+	},[this,audioPath](const Lines &lines) -> AnnouncePane* {
+		AudioAnnouncePane *pane=new AudioAnnouncePane(lines,audioPath,this);
 		connect(pane,&AudioAnnouncePane::Print,this,PrintLog::of(&Window::Print));
-		StageEphemeralPane(pane);
-	}
+		return pane;
+	},{
+		.operation="announce gift subscription",
+		.media=audioPath
+	});
+}
 
-	catch (const std::runtime_error &exception)
-	{
-		emit Print(exception.what(),"announce raid");
-	}
+void Window::AnnounceRaid(const QString &name,const unsigned int viewers,const QString &audioPath)
+{
+	StageEphemeralPane({
+		.build=[this,name,viewers,audioPath]() -> EphemeralPane* {
+			AudioAnnouncePane *pane=new AudioAnnouncePane({
+				{name,1.5},
+				{"is raiding with",1},
+				{StringConvert::PositiveInteger(viewers),1.5},
+				{"viewers",1}
+			},audioPath,this);
+			connect(pane,&AudioAnnouncePane::Print,this,PrintLog::of(&Window::Print));
+			return pane;
+		},
+		.operation="announce raid",
+		.media=audioPath
+	});
 }
 
 void Window::AnnounceCheer(const QString &name,const unsigned int count,const QString &message,const QString &videoPath)
 {
-	try
-	{
-		VideoPane *pane=new VideoPane(videoPath,this);
-		connect(pane,&VideoPane::Print,this,PrintLog::of(&Window::Print));
-		StageEphemeralPane(pane);
-		StageEphemeralPane(new AnnouncePane({
-			{QString("%1 has cheered").arg(name),0.5},
-			{message,1.5},
-			{QString("for %1 bits").arg(StringConvert::Integer(count)),0.5}
-		},this));
-	}
-
-	catch (const std::runtime_error &exception)
-	{
-		emit Print(exception.what(),"announce bits cheered");
-	}
+	StageEphemeralPane({
+		.build=[this,videoPath]() -> EphemeralPane* {
+			VideoPane *pane=new VideoPane(videoPath,this);
+			connect(pane,&VideoPane::Print,this,PrintLog::of(&Window::Print));
+			return pane;
+		},
+		.operation="announce bits cheered",
+		.media=videoPath
+	});
+	StageEphemeralPane({
+		.build=[this,name,count,message]() -> EphemeralPane* {
+			return new AnnouncePane({
+				{QString("%1 has cheered").arg(name),0.5},
+				{message,1.5},
+				{QString("for %1 bits").arg(StringConvert::Integer(count)),0.5}
+			},this);
+		},
+		.operation="announce bits cheered"
+	});
 }
 
 void Window::AnnounceTextWall(const QString &message,const QString &audioPath)
 {
-	try
-	{
-		AudioAnnouncePane *pane=new AudioAnnouncePane({
-			{message,0.5},
-		},audioPath,this);
-		connect(pane,&AudioAnnouncePane::Print,this,PrintLog::of(&Window::Print));
-		StageEphemeralPane(pane);
-	}
-
-	catch (const std::runtime_error &exception)
-	{
-		emit Print(exception.what(),"announce wall-of-text");
-	}
+	StageEphemeralPane({
+		.build=[this,message,audioPath]() -> EphemeralPane* {
+			AudioAnnouncePane *pane=new AudioAnnouncePane({
+				{message,0.5},
+			},audioPath,this);
+			connect(pane,&AudioAnnouncePane::Print,this,PrintLog::of(&Window::Print));
+			return pane;
+		},
+		.operation="announce wall-of-text",
+		.media=audioPath
+	});
 }
 
 void Window::AnnounceDeniedCommand(const QString &videoPath)
 {
-	try
-	{
-		VideoPane *pane=new VideoPane(videoPath,this);
-		connect(pane,&VideoPane::Print,this,PrintLog::of(&Window::Print));
-		StageEphemeralPane(pane);
-	}
-
-	catch (const std::runtime_error &exception)
-	{
-		emit Print(exception.what(),"play denial video");
-	}
+	StageEphemeralPane({
+		.build=[this,videoPath]() -> EphemeralPane* {
+			VideoPane *pane=new VideoPane(videoPath,this);
+			connect(pane,&VideoPane::Print,this,PrintLog::of(&Window::Print));
+			return pane;
+		},
+		.operation="play denial video",
+		.media=videoPath
+	});
 }
 
 void Window::AnnounceHypeTrainProgress(int level,double progress)
 {
-	AnnouncePane *pane=new AnnouncePane({
-		{u"Hype Train!"_s,0.5},
-		{u"Level %1"_s.arg(level),2},
-		{u"%1% of the way to level "_s.arg(progress*100,0,'f',2)+StringConvert::Integer(level+1),1}
-	},this);
-	StageEphemeralPane(pane);
+	StageAggregatedPane(u"hype train"_s,QString(),0,[level,progress](const AggregatedPane&) -> Lines {
+		return {
+			{u"Hype Train!"_s,0.5},
+			{u"Level %1"_s.arg(level),2},
+			{u"%1% of the way to level "_s.arg(progress*100,0,'f',2)+StringConvert::Integer(level+1),1}
+		};
+	},[this](const Lines &lines) -> AnnouncePane* {
+		return new AnnouncePane(lines,this);
+	},{
+		.operation="announce hype train progress",
+		.expiry=std::chrono::seconds(30) // the next progress update makes this one meaningless
+	});
 }
 
 void Window::ShowChat()
@@ -218,51 +255,67 @@ void Window::ShowChat()
 
 void Window::PlayVideo(const QString &path)
 {
-	try
-	{
-		VideoPane *pane=new VideoPane(path,this);
-		connect(pane,&VideoPane::Print,this,PrintLog::of(&Window::Print));
-		StageEphemeralPane(pane);
-	}
-
-	catch (const std::runtime_error &exception)
-	{
-		emit Print(exception.what(),"play video");
-	}
+	StageEphemeralPane({
+		.build=[this,path]() -> EphemeralPane* {
+			VideoPane *pane=new VideoPane(path,this);
+			connect(pane,&VideoPane::Print,this,PrintLog::of(&Window::Print));
+			return pane;
+		},
+		.operation="play video",
+		.media=path
+	});
 }
 
 void Window::PlayAudio(const QString &viewer,const QString &message,const QString &path)
 {
-	try
-	{
-		AudioAnnouncePane *pane=new AudioAnnouncePane({
-			{viewer,1.5},
-			{message,1}
-		},path,this);
-		connect(pane,&AudioAnnouncePane::Print,this,PrintLog::of(&Window::Print));
-		StageEphemeralPane(pane);
-	}
-
-	catch (const std::runtime_error &exception)
-	{
-		emit Print(exception.what(),"play audio");
-	}
+	StageEphemeralPane({
+		.build=[this,viewer,message,path]() -> EphemeralPane* {
+			AudioAnnouncePane *pane=new AudioAnnouncePane({
+				{viewer,1.5},
+				{message,1}
+			},path,this);
+			connect(pane,&AudioAnnouncePane::Print,this,PrintLog::of(&Window::Print));
+			return pane;
+		},
+		.operation="play audio",
+		.media=path
+	});
 }
 
 void Window::ShowPortraitVideo(const QString &path)
 {
-	try
-	{
-		VideoPane *pane=new VideoPane(path,this);
-		connect(pane,&VideoPane::Print,this,PrintLog::of(&Window::Print));
-		pane->LowerPriority();
-		StageEphemeralPane(pane);
-	}
+	StageEphemeralPane({
+		.build=[this,path]() -> EphemeralPane* {
+			VideoPane *pane=new VideoPane(path,this);
+			connect(pane,&VideoPane::Print,this,PrintLog::of(&Window::Print));
+			return pane;
+		},
+		.operation="show portrait video",
+		.media=path,
+		.highPriority=false
+	});
+}
 
-	catch (const std::runtime_error &exception)
+void Window::AnnounceSongRequest(const QString &name,const QString &song,const QString &artist)
+{
+	Lines lines;
+	lines.emplace_back(name,1.0);
+	lines.emplace_back("requested",0.5);
+	lines.emplace_back(song,1.0);
+	if (!artist.isEmpty())
 	{
-		emit Print(exception.what(),"show portrait video");
+		lines.emplace_back("by",0.5);
+		lines.emplace_back(artist,0.75);
 	}
+	StageEphemeralPane({
+		.build=[this,lines]() -> EphemeralPane* {
+			AnnouncePane *pane=new AnnouncePane(lines,this);
+			connect(pane,&AnnouncePane::Print,this,PrintLog::of(&Window::Print));
+			return pane;
+		},
+		.operation="announce song request",
+		.highPriority=false
+	});
 }
 
 void Window::ShowCommandList(std::vector<std::tuple<QString,QStringList,QString>> descriptions)
@@ -279,21 +332,32 @@ void Window::ShowCommandList(std::vector<std::tuple<QString,QStringList,QString>
 		if (QStringList aliases=std::get<1>(command); !aliases.empty()) text.append(QString("<span class='aliases'>%1<br></span>").arg("!"+std::get<1>(command).join(", !")));
 		text.append(QString("<span class='description'>%1</span><br></div>").arg(std::get<2>(command)));
 	}
-	ScrollingPane *pane=new ScrollingPane(text,this);
-	connect(pane,&ScrollingPane::Print,this,PrintLog::of(&Window::Print));
-	StageEphemeralPane(pane);
+	StageEphemeralPane({
+		.build=[this,text]() -> EphemeralPane* {
+			ScrollingPane *pane=new ScrollingPane(text,this);
+			connect(pane,&ScrollingPane::Print,this,PrintLog::of(&Window::Print));
+			return pane;
+		},
+		.operation="show command list",
+		.highPriority=false
+	});
 }
 
 void Window::ShowCommand(const QString &name,const QString &description)
 {
-	if (!highPriorityEphemeralPanes.empty()) return;
-	AnnouncePane *pane=new AnnouncePane({
-		{u"!"_s+name,1.5},
-		{description,1}
-	},this);
-	connect(pane,&AnnouncePane::Print,this,PrintLog::of(&Window::Print));
-	pane->LowerPriority();
-	StageEphemeralPane(pane);
+	if (highPriorityEphemeralPane || !highPriorityEphemeralPanes.empty()) return;
+	StageEphemeralPane({
+		.build=[this,name,description]() -> EphemeralPane* {
+			AnnouncePane *pane=new AnnouncePane({
+				{u"!"_s+name,1.5},
+				{description,1}
+			},this);
+			connect(pane,&AnnouncePane::Print,this,PrintLog::of(&Window::Print));
+			return pane;
+		},
+		.operation="show command",
+		.highPriority=false
+	});
 }
 
 void Window::ShowPanicText(const QString &text)
@@ -304,14 +368,19 @@ void Window::ShowPanicText(const QString &text)
 
 void Window::Shoutout(const QString &name,const QString &description,std::shared_ptr<QImage> profileImage)
 {
-	ImageAnnouncePane *pane=new ImageAnnouncePane({
-		{"Drop a follow on",1},
-		{name,1.5},
-		{description,0.5}
-	},*profileImage,this);
-	connect(pane,&ImageAnnouncePane::Print,this,PrintLog::of(&Window::Print));
-	pane->Duration(10000); // TODO: change from hardcoded to configurable duration
-	StageEphemeralPane(pane);
+	StageEphemeralPane({
+		.build=[this,name,description,profileImage]() -> EphemeralPane* {
+			ImageAnnouncePane *pane=new ImageAnnouncePane({
+				{"Drop a follow on",1},
+				{name,1.5},
+				{description,0.5}
+			},*profileImage,this);
+			connect(pane,&ImageAnnouncePane::Print,this,PrintLog::of(&Window::Print));
+			pane->Duration(10000); // TODO: change from hardcoded to configurable duration
+			return pane;
+		},
+		.operation="shoutout"
+	});
 }
 
 void Window::ShowFollowage(const QString &name,std::chrono::years years,std::chrono::months months,std::chrono::days days)
@@ -333,9 +402,14 @@ void Window::ShowFollowage(const QString &name,std::chrono::years years,std::chr
 		finalLine.append(QString("%1 %2").arg(StringConvert::Integer(days.count()),StringConvert::NumberAgreement("day","days",NumberConvert::Positive(days.count()))));
 	}
 	if (!finalLine.isEmpty()) lines.emplace_back(finalLine,years.count() > 0 ? 1 : 1.5);
-	AnnouncePane *pane=new AnnouncePane(lines,this);
-	connect(pane,&AnnouncePane::Print,this,PrintLog::of(&Window::Print));
-	StageEphemeralPane(pane);
+	StageEphemeralPane({
+		.build=[this,lines]() -> EphemeralPane* {
+			AnnouncePane *pane=new AnnouncePane(lines,this);
+			connect(pane,&AnnouncePane::Print,this,PrintLog::of(&Window::Print));
+			return pane;
+		},
+		.operation="show duration"
+	});
 }
 
 void Window::ShowTimezone(const QString &timezone)
@@ -361,105 +435,201 @@ void Window::ShowUptime(std::chrono::hours hours,std::chrono::minutes minutes,st
 		finalLine.append(QString("%1 %2").arg(StringConvert::Integer(seconds.count()),StringConvert::NumberAgreement("second","seconds",NumberConvert::Positive(seconds.count()))));
 	}
 	if (!finalLine.isEmpty()) lines.emplace_back(finalLine,hours.count() > 0 ? 1 : 1.5);
-	AnnouncePane *pane=new AnnouncePane(lines,this);
-	connect(pane,&AnnouncePane::Print,this,PrintLog::of(&Window::Print));
-	StageEphemeralPane(pane);
+	StageEphemeralPane({
+		.build=[this,lines]() -> EphemeralPane* {
+			AnnouncePane *pane=new AnnouncePane(lines,this);
+			connect(pane,&AnnouncePane::Print,this,PrintLog::of(&Window::Print));
+			return pane;
+		},
+		.operation="show duration"
+	});
 }
 
 void Window::ShowCurrentSong(const QString &song,const QString &album,const QString &artist,const QImage coverArt)
 {
-	ImageAnnouncePane *pane=new ImageAnnouncePane({
-		{"Now playing",0.5},
-		{song,1.0},
-		{"by",0.5},
-		{artist,0.75},
-		{"from the ablum",0.5},
-		{album,0.75}
-	},coverArt,this);
-	connect(pane,&ImageAnnouncePane::Print,this,PrintLog::of(&Window::Print));
-	pane->LowerPriority();
-	StageEphemeralPane(pane);
+	StageEphemeralPane({
+		.build=[this,song,album,artist,coverArt]() -> EphemeralPane* {
+			ImageAnnouncePane *pane=new ImageAnnouncePane({
+				{"Now playing",0.5},
+				{song,1.0},
+				{"by",0.5},
+				{artist,0.75},
+				{"from the ablum",0.5},
+				{album,0.75}
+			},coverArt,this);
+			connect(pane,&ImageAnnouncePane::Print,this,PrintLog::of(&Window::Print));
+			return pane;
+		},
+		.operation="show current song",
+		.highPriority=false
+	});
 }
 
 void Window::ShowCurrentSong(const QString &song,const QString &artist,const QImage coverArt)
 {
-	ImageAnnouncePane *pane=new ImageAnnouncePane({
-		{"Now playing",0.5},
-		{song,1.0},
-		{"by",0.5},
-		{artist,0.75}
-	},coverArt,this);
-	connect(pane,&ImageAnnouncePane::Print,this,PrintLog::of(&Window::Print));
-	pane->LowerPriority();
-	StageEphemeralPane(pane);
+	StageEphemeralPane({
+		.build=[this,song,artist,coverArt]() -> EphemeralPane* {
+			ImageAnnouncePane *pane=new ImageAnnouncePane({
+				{"Now playing",0.5},
+				{song,1.0},
+				{"by",0.5},
+				{artist,0.75}
+			},coverArt,this);
+			connect(pane,&ImageAnnouncePane::Print,this,PrintLog::of(&Window::Print));
+			return pane;
+		},
+		.operation="show current song",
+		.highPriority=false
+	});
 }
 
-void Window::StageEphemeralPane(EphemeralPane *pane)
+void Window::StageEphemeralPane(StagedPane pane)
 {
-	connect(pane,&EphemeralPane::Expired,this,&Window::ReleaseLiveEphemeralPane);
-	background->layout()->addWidget(pane);
-	if (pane->HighPriority())
+	const qint64 now=schedulerClock.elapsed();
+	const QString operation=pane.operation;
+	pane.queued=now;
+	if (pane.expiry.count() < 1)
 	{
-		if (highPriorityEphemeralPanes.empty())
-		{
-			if (!lowPriorityEphemeralPanes.empty()) lowPriorityEphemeralPanes.front()->hide();
-			highPriorityEphemeralPanes.push(pane);
-			livePersistentPane->hide();
-			pane->show();
-			emit SuppressMusic();
-		}
-		else
-		{
-			connect(highPriorityEphemeralPanes.back(),&EphemeralPane::Finished,pane,&EphemeralPane::show);
-			highPriorityEphemeralPanes.push(pane);
-		}
+		const qint64 expiry=pane.highPriority ? static_cast<qint64>(settingHighPriorityExpiry) : static_cast<qint64>(settingLowPriorityExpiry);
+		if (expiry > 0) pane.expiry=std::chrono::seconds(expiry);
 	}
+
+	if (pane.highPriority)
+		highPriorityEphemeralPanes.push_back(std::move(pane));
 	else
+		lowPriorityEphemeralPanes.push_back(std::move(pane));
+	emit Staged(operation);
+	ReportSchedule();
+	Advance();
+}
+
+void Window::StageAggregatedPane(const QString &key,const QString &name,int count,std::function<Lines(const AggregatedPane&)> describe,std::function<AnnouncePane*(const Lines&)> build,StagedPane staged)
+{
+	const qint64 now=schedulerClock.elapsed();
+	if (auto candidate=aggregatedPanes.find(key); candidate != aggregatedPanes.end())
 	{
-		if (lowPriorityEphemeralPanes.empty())
-		{
-			if (highPriorityEphemeralPanes.empty())
-			{
-				livePersistentPane->hide();
-				pane->show();
-			}
-		}
-		else
+		// anything still waiting in the queue hasn't been seen yet, so it can take more regardless of the window
+		AggregatedPane &aggregate=candidate->second;
+		if (!aggregate.built || (aggregate.pane && now-aggregate.opened <= static_cast<qint64>(settingAggregationWindow)*1000))
 		{
-			connect(lowPriorityEphemeralPanes.back(),&EphemeralPane::Finished,pane,&EphemeralPane::show);
+			aggregate.count+=count;
+			if (!name.isEmpty()) aggregate.names.append(name);
+			aggregate.describe=std::move(describe);
+			if (aggregate.pane) aggregate.pane->SetLines(aggregate.describe(aggregate));
+			return;
 		}
-		lowPriorityEphemeralPanes.push(pane);
+		aggregatedPanes.erase(candidate);
 	}
+
+	aggregatedPanes.insert({key,{
+		.count=count,
+		.names=name.isEmpty() ? QStringList{} : QStringList{name},
+		.opened=now,
+		.describe=std::move(describe)
+	}});
+	staged.build=[this,key,build=std::move(build)]() -> EphemeralPane* {
+		AggregatedPane &aggregate=aggregatedPanes.at(key);
+		aggregate.built=true; // set first so a pane that fails to build doesn't keep swallowing events
+		aggregate.pane=build(aggregate.describe(aggregate));
+		return aggregate.pane;
+	};
+	staged.aggregate=key;
+	StageEphemeralPane(std::move(staged));
 }
 
-void Window::ReleaseLiveEphemeralPane()
+EphemeralPane* Window::BuildEphemeralPane(std::deque<StagedPane> &queue)
 {
-	// determine which queue the pane came from and remove it
-	if (highPriorityEphemeralPanes.empty())
+	while (!queue.empty())
 	{
-		if (lowPriorityEphemeralPanes.empty())
+		StagedPane staged=std::move(queue.front());
+		queue.pop_front();
+		const qint64 now=schedulerClock.elapsed();
+		if (staged.expiry.count() > 0 && now-staged.queued > staged.expiry.count())
 		{
-			throw std::logic_error("Ran out of ephemeral panes but messages still coming in to remove them"); // FIXME: this is undefined behavior since it's being thrown from a slot
+			droppedEphemeralPanes++;
+			if (!staged.aggregate.isEmpty()) aggregatedPanes.erase(staged.aggregate); // otherwise it would keep swallowing events for a pane that's never coming
+			emit Print(QString("Dropped an alert that waited %1 seconds").arg(StringConvert::Integer(static_cast<int>((now-staged.queued)/1000))),staged.operation);
+			continue;
 		}
-		else
+
+		try
+		{
+			EphemeralPane *pane=staged.build();
+			connect(pane,&EphemeralPane::Expired,this,&Window::ReleaseLiveEphemeralPane);
+			background->layout()->addWidget(pane);
+			ephemeralPaneWaits++;
+			ephemeralPaneWaitTime+=now-staged.queued;
+			longestEphemeralPaneWait=std::max(longestEphemeralPaneWait,now-staged.queued);
+			return pane;
+		}
+
+		catch (const std::runtime_error &exception)
 		{
-			lowPriorityEphemeralPanes.pop();
+			if (!staged.aggregate.isEmpty()) aggregatedPanes.erase(staged.aggregate);
+			emit Print(exception.what(),staged.operation);
 		}
 	}
-	else
+	return nullptr;
+}
+
+void Window::Advance()
+{
+	if (!highPriorityEphemeralPane)
 	{
-		highPriorityEphemeralPanes.pop();
+		highPriorityEphemeralPane=BuildEphemeralPane(highPriorityEphemeralPanes);
+		if (highPriorityEphemeralPane)
+		{
+			if (lowPriorityEphemeralPane) lowPriorityEphemeralPane->hide(); // picks up where it left off once the high priority panes are done
+			livePersistentPane->hide();
+			highPriorityEphemeralPane->show();
+		}
 	}
 
-	// check what's left and return to chat if empty
-	if (highPriorityEphemeralPanes.empty())
+	if (highPriorityEphemeralPane)
 	{
-		if (lowPriorityEphemeralPanes.empty())
-			livePersistentPane->show();
+		if (!musicSuppressed) emit SuppressMusic();
+		musicSuppressed=true;
+	}
+	else
+	{
+		if (musicSuppressed) emit RestoreMusic();
+		musicSuppressed=false;
+
+		if (!lowPriorityEphemeralPane) lowPriorityEphemeralPane=BuildEphemeralPane(lowPriorityEphemeralPanes);
+		if (lowPriorityEphemeralPane)
+		{
+			livePersistentPane->hide();
+			lowPriorityEphemeralPane->show();
+		}
 		else
-			lowPriorityEphemeralPanes.front()->show();
-		emit RestoreMusic();
+		{
+			livePersistentPane->show();
+		}
 	}
+	Preroll();
+	ReportSchedule();
+}
+
+void Window::Preroll()
+{
+	// high priority panes always go next, and if the pane turns out to be expired its player just gets recycled later
+	const std::deque<StagedPane> &queue=highPriorityEphemeralPanes.empty() ? lowPriorityEphemeralPanes : highPriorityEphemeralPanes;
+	if (queue.empty() || queue.front().media.isEmpty()) return;
+	if (Media::Mixer::Shared().Find(queue.front().media)) return; // already in memory, nothing to open
+	Media::Pool::Shared().Preroll(QUrl::fromLocalFile(queue.front().media));
+}
+
+void Window::ReleaseLiveEphemeralPane()
+{
+	EphemeralPane *pane=qobject_cast<EphemeralPane*>(sender());
+	if (pane == highPriorityEphemeralPane) highPriorityEphemeralPane=nullptr;
+	if (pane == lowPriorityEphemeralPane) lowPriorityEphemeralPane=nullptr;
+	Advance();
+}
+
+void Window::ReportSchedule()
+{
+	emit ScheduleChanged(static_cast<int>(highPriorityEphemeralPanes.size()),static_cast<int>(lowPriorityEphemeralPanes.size()),ephemeralPaneWaits > 0 ? ephemeralPaneWaitTime/ephemeralPaneWaits : 0,longestEphemeralPaneWait,droppedEphemeralPanes);
 }
 
 void Window::Resize(const QSize &dimensions)
@@ -487,6 +657,11 @@ ApplicationSetting& Window::Dimensions()
 	return settingWindowSize;
 }
 
+ApplicationSetting& Window::AggregationWindow()
+{
+	return settingAggregationWindow;
+}
+
 void Window::contextMenuEvent(QContextMenuEvent *event)
 {
 	QMenu menu(this);
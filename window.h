@@ -2,10 +2,37 @@
 
 #include <QMainWindow>
 #include <QAction>
-#include <queue>
+#include <QElapsedTimer>
+#include <QPointer>
+#include <deque>
+#include <unordered_map>
+#include <functional>
 #include "panes.h"
 #include "settings.h"
 
+//! Description of an ephemeral pane that's waiting its turn, the pane itself isn't built until it's about to be shown
+struct StagedPane
+{
+	std::function<EphemeralPane*()> build;
+	QString operation; // reported along with anything that goes wrong building the pane
+	QString media; // audio or video the pane plays, opened ahead of time while the pane before it is still up
+	bool highPriority=true;
+	std::chrono::milliseconds expiry{0}; // dropped if it hasn't been shown by then, 0 uses the window's setting
+	QString aggregate; // key of the burst this pane shows, if any, forgotten along with the pane if it never makes it on screen
+	qint64 queued=0;
+};
+
+//! A burst of the same kind of event from the same source, folded into one pane whose text keeps up with the tally
+struct AggregatedPane
+{
+	int count=0;
+	QStringList names;
+	qint64 opened=0;
+	bool built=false;
+	QPointer<AnnouncePane> pane;
+	std::function<Lines(const AggregatedPane&)> describe; // the latest event's, so anything that isn't a tally reflects the most recent state
+};
+
 class Window : public QMainWindow
 {
 	Q_OBJECT
@@ -13,13 +40,26 @@ public:
 	Window();
 	ApplicationSetting& BackgroundColor();
 	ApplicationSetting& Dimensions();
+	ApplicationSetting& AggregationWindow();
 protected:
 	QWidget *background;
 	PersistentPane *livePersistentPane;
-	std::queue<EphemeralPane*> highPriorityEphemeralPanes;
-	std::queue<EphemeralPane*> lowPriorityEphemeralPanes;
+	EphemeralPane *highPriorityEphemeralPane;
+	EphemeralPane *lowPriorityEphemeralPane;
+	std::deque<StagedPane> highPriorityEphemeralPanes;
+	std::deque<StagedPane> lowPriorityEphemeralPanes;
+	std::unordered_map<QString,AggregatedPane> aggregatedPanes;
+	QElapsedTimer schedulerClock;
+	bool musicSuppressed;
+	qint64 ephemeralPaneWaits;
+	qint64 ephemeralPaneWaitTime;
+	qint64 longestEphemeralPaneWait;
+	int droppedEphemeralPanes;
 	ApplicationSetting settingWindowSize;
 	ApplicationSetting settingBackgroundColor;
+	ApplicationSetting settingHighPriorityExpiry;
+	ApplicationSetting settingLowPriorityExpiry;
+	ApplicationSetting settingAggregationWindow;
 	QAction configureOptions;
 	QAction configureCommands;
 	QAction configureEventSubscriptions;
@@ -28,6 +68,12 @@ protected:
 	QAction status;
 	void SwapPersistentPane(PersistentPane *pane);
 	void ReleaseLiveEphemeralPane();
+	void StageEphemeralPane(StagedPane pane);
+	void StageAggregatedPane(const QString &key,const QString &name,int count,std::function<Lines(const AggregatedPane&)> describe,std::function<AnnouncePane*(const Lines&)> build,StagedPane staged);
+	EphemeralPane* BuildEphemeralPane(std::deque<StagedPane> &queue);
+	void Advance();
+	void Preroll();
+	void ReportSchedule();
 	const QSize ScreenThird();
 	void contextMenuEvent(QContextMenuEvent *event) override;
 	void closeEvent(QCloseEvent *event) override;
@@ -47,11 +93,14 @@ signals:
 	void ShowVibePlaylist();
 	void ShowStatus();
 	void CloseRequested(QCloseEvent *event);
+	void ScheduleChanged(int highPriority,int lowPriority,qint64 averageWait,qint64 longestWait,int dropped);
+	void Staged(const QString &operation);
 public slots:
 	void ShowChat();
 	void AnnounceArrival(const QString &name,std::shared_ptr<QImage> profileImage,const QString &audioPath);
 	void AnnounceRedemption(const QString &name,const QString &rewardTitle,const QString &message);
 	void AnnounceSubscription(const QString &name,const QString &audioPath);
+	void AnnounceGiftSubscription(const QString &gifter,const unsigned int count,const QString &audioPath);
 	void AnnounceRaid(const QString &name,const unsigned int viewers,const QString &audioPath);
 	void AnnounceCheer(const QString &name,const unsigned int count,const QString &message,const QString &videoPath);
 	void AnnounceTextWall(const QString &message,const QString &audioPath);
@@ -62,6 +111,7 @@ public slots:
 	void ShowPortraitVideo(const QString &path);
 	void ShowCurrentSong(const QString &song,const QString &album,const QString &artist,const QImage coverArt);
 	void ShowCurrentSong(const QString &song,const QString &artist,const QImage coverArt);
+	void AnnounceSongRequest(const QString &name,const QString &song,const QString &artist);
 	void ShowCommandList(std::vector<std::tuple<QString,QStringList,QString>> descriptions);
 	void ShowCommand(const QString &name,const QString &description);
 	void ShowPanicText(const QString &text);
@@ -70,8 +120,6 @@ public slots:
 	void ShowTimezone(const QString &timezone);
 	void ShowUptime(std::chrono::hours hours,std::chrono::minutes minutes,std::chrono::seconds seconds);
 	void Resize(const QSize &dimensions);
-protected slots:
-	void StageEphemeralPane(EphemeralPane *pane);
 };
 
 class Win32Window : public Window